@@ -0,0 +1,499 @@
+#include "AssetLoader.h"
+#include "CPUTrace.h"
+#include "Mipmaps.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+#include <SDL2/SDL_log.h>
+
+// Mid grey, opaque
+static constexpr uint32_t PlaceholderTexel = 0xFF808080;
+// The images are prepared on the workers, which already keep every core busy: the mip and block compression bands
+// run on the worker itself instead of fanning out to more threads per image
+static constexpr unsigned int WorkerBandThreads = 1;
+
+// The image and its mip chain
+static bool LoadImage(const std::filesystem::path& fileName, bool flipRows, bool mipmaps, std::vector<ImageRGBA>& levels)
+{
+	levels.resize(1);
+	if (!DecodeImage(fileName, flipRows, levels[0])) return false;
+	if (!mipmaps) return true;
+
+	std::vector<ImageRGBA> chain = Mipmaps::BuildChain(levels[0], true, WorkerBandThreads);
+	std::move(chain.begin(), chain.end(), std::back_inserter(levels));
+	return true;
+}
+
+// From the cache, or decoded, compressed and cached for the next run
+static bool LoadCompressedImage(const std::filesystem::path& fileName, bool flipRows, bool mipmaps, BlockCompression::CompressedImage& image)
+{
+	const uint32_t cacheFlags = (flipRows ? TextureCache::FlippedRows : 0) | (mipmaps ? TextureCache::Mipmaps : 0);
+	TextureCache::View cached;
+	if (TextureCache::Load(fileName, cached, cacheFlags))
+	{
+		image.format = cached.header->format;
+		image.levels.assign(cached.header->levels, cached.header->levels + cached.header->levelCount);
+		uint64_t size = 0;
+		for (const BlockCompression::Level& level : image.levels) size = std::max(size, level.offset + level.size);
+		image.data.assign(cached.data, cached.data + size);
+		return true;
+	}
+
+	ImageRGBA decoded;
+	if (!DecodeImage(fileName, flipRows, decoded)) return false;
+	image = BlockCompression::Compress(decoded, mipmaps, WorkerBandThreads);
+	if (!TextureCache::Store(fileName, image, cacheFlags))
+		SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_WARN, "[TextureCache] Could not write the cache of %s", fileName.string().c_str());
+	return true;
+}
+
+AssetLoader::AssetLoader(unsigned int threadCount)
+{
+	if (threadCount == 0) threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	for (unsigned int t = 0; t < threadCount; ++t) m_workers.emplace_back(&AssetLoader::WorkerMain, this);
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_jobAdded.notify_all();
+	for (std::thread& worker : m_workers) worker.join();
+}
+
+void AssetLoader::WorkerMain()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAdded.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop) return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void AssetLoader::Enqueue(std::function<void()> job, bool critical)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (critical) m_jobs.push_front(std::move(job));
+		else m_jobs.push_back(std::move(job));
+	}
+	m_jobAdded.notify_one();
+}
+
+void AssetLoader::LoadMesh(Mesh& target, const Mesh* placeholder, std::string name, std::function<PreparedMesh()> prepare, std::vector<VertexAttributeDescriptor> vertexAttribs, bool critical)
+{
+	target.placeholder = placeholder;
+	++m_pending;
+	if (critical) ++m_criticalPending;
+
+	auto upload = std::make_shared<MeshUpload>();
+	upload->target = &target;
+	upload->name = std::move(name);
+	upload->vertexAttribs = std::move(vertexAttribs);
+	upload->critical = critical;
+
+	Enqueue([this, upload, prepare = std::move(prepare)]()
+	{
+		CPU_TRACE_SCOPE("AssetLoader::PrepareMesh");
+		try
+		{
+			upload->prepared = prepare();
+		}
+		catch (...)
+		{
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR, SDL_LOG_PRIORITY_ERROR, "[AssetLoader] Error while loading %s", upload->name.c_str());
+			upload->failed = true;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (upload->critical) m_finishedMeshes.push_front(upload);
+			else m_finishedMeshes.push_back(upload);
+		}
+		m_jobFinished.notify_all();
+	}, critical);
+}
+
+void AssetLoader::LoadTexture(GLuint texture, GLenum target, std::vector<std::filesystem::path> files, bool generateMipmaps, bool critical, bool compressed)
+{
+	// Complete right away, with one texel per face
+	glBindTexture(target, texture);
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		const GLenum role = target == GL_TEXTURE_CUBE_MAP ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i) : target;
+		glTexImage2D(role, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &PlaceholderTexel);
+	}
+	glBindTexture(target, 0);
+	SetupTextureSampling(target, texture, generateMipmaps);
+
+	auto upload = std::make_shared<TextureUpload>();
+	upload->texture = texture;
+	upload->target = target;
+	upload->files = std::move(files);
+	upload->generateMipmaps = generateMipmaps;
+	upload->critical = critical;
+	upload->compressed = compressed;
+	StartTexture(std::move(upload));
+}
+
+void AssetLoader::LoadMaterialTexture(Materials& materials, uint32_t material, std::filesystem::path file, bool critical, bool compressed)
+{
+	auto upload = std::make_shared<TextureUpload>();
+	upload->target = GL_TEXTURE_2D_ARRAY;
+	upload->materials = &materials;
+	upload->material = material;
+	upload->files.push_back(std::move(file));
+	upload->critical = critical;
+	upload->compressed = compressed;
+	StartTexture(std::move(upload));
+}
+
+void AssetLoader::StartTexture(std::shared_ptr<TextureUpload> upload)
+{
+	++m_pending;
+	if (upload->critical) ++m_criticalPending;
+
+	if (upload->compressed) upload->compressedImages.resize(upload->files.size());
+	else upload->images.resize(upload->files.size());
+	upload->imagesLeft = upload->files.size();
+
+	// The images are decoded in parallel, e.g. the faces of a cube map
+	for (size_t i = 0; i < upload->files.size(); ++i)
+	{
+		Enqueue([this, upload, i]()
+		{
+			CPU_TRACE_SCOPE("AssetLoader::DecodeImage");
+			// Cube map faces are top-down, like the decoded images
+			const bool flipRows = upload->target != GL_TEXTURE_CUBE_MAP;
+			const bool loaded = upload->compressed ?
+				LoadCompressedImage(upload->files[i], flipRows, upload->generateMipmaps, upload->compressedImages[i]) :
+				LoadImage(upload->files[i], flipRows, upload->generateMipmaps, upload->images[i]);
+			if (!loaded) upload->failed = true;
+			if (--upload->imagesLeft != 0) return;
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (upload->critical) m_finishedTextures.push_front(upload);
+				else m_finishedTextures.push_back(upload);
+			}
+			m_jobFinished.notify_all();
+		}, upload->critical);
+	}
+}
+
+size_t AssetLoader::Allocate(size_t bytes, bool partial, GLintptr& offset)
+{
+	const size_t available = SegmentSize - m_segmentUsed;
+	if (bytes > available && (!partial || available == 0)) return 0;
+
+	const size_t granted = std::min(bytes, available);
+	offset = static_cast<GLintptr>(m_segment * SegmentSize + m_segmentUsed);
+	m_segmentUsed = std::min(SegmentSize, (m_segmentUsed + granted + Alignment - 1) / Alignment * Alignment);
+	return granted;
+}
+
+void AssetLoader::Complete(bool critical)
+{
+	--m_pending;
+	if (critical) --m_criticalPending;
+}
+
+void AssetLoader::FinishMesh(PreparedMesh&& prepared, Mesh& target, GLuint vboID, GLuint iboID, const std::vector<VertexAttributeDescriptor>& vertexAttribs)
+{
+	const GLsizei vertexSize = prepared.vertexSize;
+	target = std::move(prepared.mesh); // Also clears the placeholder
+	target.mesh.vboID = vboID;
+	target.mesh.iboID = iboID;
+	target.mesh.vaoID = CreateVertexArray(vboID, iboID, vertexSize, vertexAttribs);
+}
+
+void AssetLoader::CreateMesh(PreparedMesh&& prepared, Mesh& target, const std::vector<VertexAttributeDescriptor>& vertexAttribs)
+{
+	GLuint buffers[2];
+	glCreateBuffers(2, buffers);
+	glNamedBufferStorage(buffers[0], std::max<size_t>(prepared.vertexData.size(), 1), prepared.vertexData.empty() ? nullptr : prepared.vertexData.data(), 0);
+	glNamedBufferStorage(buffers[1], std::max<size_t>(prepared.indexData.size(), 1), prepared.indexData.empty() ? nullptr : prepared.indexData.data(), 0);
+	FinishMesh(std::move(prepared), target, buffers[0], buffers[1], vertexAttribs);
+}
+
+bool AssetLoader::Upload(MeshUpload& upload)
+{
+	if (upload.failed)
+	{
+		Complete(upload.critical);
+		return true;
+	}
+
+	PreparedMesh& prepared = upload.prepared;
+	if (upload.vboID == 0)
+	{
+		glCreateBuffers(1, &upload.vboID);
+		glNamedBufferStorage(upload.vboID, std::max<size_t>(prepared.vertexData.size(), 1), nullptr, 0);
+		glCreateBuffers(1, &upload.iboID);
+		glNamedBufferStorage(upload.iboID, std::max<size_t>(prepared.indexData.size(), 1), nullptr, 0);
+	}
+
+	// Large buffers are copied over several frames, the mesh is only swapped in after the last piece
+	auto copy = [this](const std::vector<uint8_t>& data, GLuint buffer, size_t& done)
+	{
+		while (done < data.size())
+		{
+			GLintptr offset;
+			const size_t bytes = Allocate(data.size() - done, true, offset);
+			if (bytes == 0) return false;
+			std::memcpy(m_ringMemory + offset, data.data() + done, bytes);
+			glCopyNamedBufferSubData(m_ringBuffer, buffer, offset, static_cast<GLintptr>(done), static_cast<GLsizeiptr>(bytes));
+			done += bytes;
+		}
+		return true;
+	};
+	if (!copy(prepared.vertexData, upload.vboID, upload.vertexBytesDone)) return false;
+	if (!copy(prepared.indexData, upload.iboID, upload.indexBytesDone)) return false;
+
+	FinishMesh(std::move(prepared), *upload.target, upload.vboID, upload.iboID, upload.vertexAttribs);
+	upload.vboID = upload.iboID = 0;
+	Complete(upload.critical);
+	return true;
+}
+
+bool AssetLoader::Upload(TextureUpload& upload)
+{
+	if (upload.failed)
+	{
+		Complete(upload.critical);
+		return true;
+	}
+
+	// Every level of every face
+	struct Piece
+	{
+		GLint face;
+		GLint level;
+		GLsizei width;
+		GLsizei height;
+		const void* data;
+		size_t bytes;
+	};
+	std::vector<Piece> pieces;
+	GLenum format = GL_RGBA8;
+	bool matching = true;
+	if (upload.compressed)
+	{
+		format = BlockCompression::GLFormat(upload.compressedImages.front().format);
+		for (size_t i = 0; i < upload.compressedImages.size(); ++i)
+		{
+			const BlockCompression::CompressedImage& image = upload.compressedImages[i];
+			matching &= image.format == upload.compressedImages.front().format;
+			for (size_t level = 0; level < image.levels.size(); ++level)
+			{
+				const BlockCompression::Level& extent = image.levels[level];
+				pieces.push_back({ static_cast<GLint>(i), static_cast<GLint>(level), static_cast<GLsizei>(extent.width), static_cast<GLsizei>(extent.height),
+					image.data.data() + extent.offset, static_cast<size_t>(extent.size) });
+			}
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < upload.images.size(); ++i)
+		{
+			for (size_t level = 0; level < upload.images[i].size(); ++level)
+			{
+				const ImageRGBA& image = upload.images[i][level];
+				pieces.push_back({ static_cast<GLint>(i), static_cast<GLint>(level), image.width, image.height, image.pixels.data(), image.pixels.size() * sizeof(uint32_t) });
+			}
+		}
+	}
+
+	// The storage is allocated once for all the faces, they have to match
+	const size_t faceCount = upload.compressed ? upload.compressedImages.size() : upload.images.size();
+	const size_t levelCount = pieces.size() / std::max<size_t>(faceCount, 1);
+	matching = matching && !pieces.empty() && pieces.size() == levelCount * faceCount;
+	for (size_t i = 0; i < pieces.size() && matching; ++i)
+	{
+		const Piece& first = pieces[i % levelCount];
+		matching = pieces[i].face == static_cast<GLint>(i / levelCount) && pieces[i].width == first.width && pieces[i].height == first.height;
+	}
+	if (!matching)
+	{
+		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR, SDL_LOG_PRIORITY_ERROR, "[AssetLoader] The images of %s don't match", upload.files.front().string().c_str());
+		Complete(upload.critical);
+		return true;
+	}
+
+	// All the faces at once, a cube map with faces of different sizes would be incomplete in between.
+	// More than a segment is uploaded straight from memory
+	size_t totalBytes = 0;
+	for (const Piece& piece : pieces) totalBytes += piece.bytes + Alignment;
+	const bool staged = totalBytes <= SegmentSize;
+	if (staged && totalBytes > SegmentSize - m_segmentUsed) return false;
+
+	// Replaces the placeholder, every level is allocated up front. A material's array already has its storage
+	GLuint texture = upload.texture;
+	GLint firstLayer = 0;
+	if (upload.materials)
+	{
+		const MaterialLayer layer = upload.materials->Allocate(upload.material, pieces[0].width, pieces[0].height, static_cast<GLsizei>(levelCount), format);
+		if (layer.texture == 0)
+		{
+			Complete(upload.critical);
+			return true;
+		}
+		texture = layer.texture;
+		firstLayer = layer.layer;
+	}
+	else glTextureStorage2D(texture, static_cast<GLsizei>(levelCount), format, pieces[0].width, pieces[0].height);
+	if (staged) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ringBuffer);
+
+	for (const Piece& piece : pieces)
+	{
+		const void* source = piece.data;
+		if (staged)
+		{
+			GLintptr offset;
+			Allocate(piece.bytes, false, offset);
+			std::memcpy(m_ringMemory + offset, source, piece.bytes);
+			source = reinterpret_cast<const void*>(offset);
+		}
+
+		// The faces of a cube map are its layers for the DSA functions
+		const bool layered = upload.target == GL_TEXTURE_CUBE_MAP || upload.target == GL_TEXTURE_2D_ARRAY;
+		const GLint layer = firstLayer + piece.face;
+		if (upload.compressed && layered)
+			glCompressedTextureSubImage3D(texture, piece.level, 0, 0, layer, piece.width, piece.height, 1, format, static_cast<GLsizei>(piece.bytes), source);
+		else if (upload.compressed)
+			glCompressedTextureSubImage2D(texture, piece.level, 0, 0, piece.width, piece.height, format, static_cast<GLsizei>(piece.bytes), source);
+		else if (layered)
+			glTextureSubImage3D(texture, piece.level, 0, 0, layer, piece.width, piece.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, source);
+		else
+			glTextureSubImage2D(texture, piece.level, 0, 0, piece.width, piece.height, GL_RGBA, GL_UNSIGNED_BYTE, source);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// The mip chain was built on the workers
+	if (!upload.materials) glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	Complete(upload.critical);
+	return true;
+}
+
+void AssetLoader::Update()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (; !m_finishedMeshes.empty(); m_finishedMeshes.pop_front())
+		{
+			if (m_finishedMeshes.front()->critical) m_meshUploads.push_front(m_finishedMeshes.front());
+			else m_meshUploads.push_back(m_finishedMeshes.front());
+		}
+		for (; !m_finishedTextures.empty(); m_finishedTextures.pop_front())
+		{
+			if (m_finishedTextures.front()->critical) m_textureUploads.push_front(m_finishedTextures.front());
+			else m_textureUploads.push_back(m_finishedTextures.front());
+		}
+	}
+	if (m_meshUploads.empty() && m_textureUploads.empty()) return;
+
+	CPU_TRACE_SCOPE("AssetLoader::Update");
+	if (m_ringBuffer == 0)
+	{
+		constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(1, &m_ringBuffer);
+		glNamedBufferStorage(m_ringBuffer, SegmentCount * SegmentSize, nullptr, flags);
+		m_ringMemory = static_cast<uint8_t*>(glMapNamedBufferRange(m_ringBuffer, 0, SegmentCount * SegmentSize, flags));
+	}
+
+	// The segment of this frame is still read by the GPU, try again next frame
+	GLsync& fence = m_segmentFences[m_segment];
+	if (fence)
+	{
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED) return;
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+	m_segmentUsed = 0;
+
+	bool full = false;
+	while (!full && !m_textureUploads.empty())
+	{
+		if (Upload(*m_textureUploads.front())) m_textureUploads.pop_front();
+		else full = true;
+	}
+	while (!full && !m_meshUploads.empty())
+	{
+		if (Upload(*m_meshUploads.front())) m_meshUploads.pop_front();
+		else full = true;
+	}
+
+	if (m_segmentUsed > 0)
+	{
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_segment = (m_segment + 1) % SegmentCount;
+	}
+}
+
+void AssetLoader::WaitForWorkers()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobFinished.wait_for(lock, std::chrono::milliseconds(1), [this]() { return !m_finishedMeshes.empty() || !m_finishedTextures.empty(); });
+}
+
+void AssetLoader::WaitForCritical()
+{
+	CPU_TRACE_SCOPE("AssetLoader::WaitForCritical");
+	for (Update(); m_criticalPending > 0; Update()) WaitForWorkers();
+}
+
+void AssetLoader::WaitForAll()
+{
+	CPU_TRACE_SCOPE("AssetLoader::WaitForAll");
+	for (Update(); m_pending > 0; Update()) WaitForWorkers();
+}
+
+void AssetLoader::Clean()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+		m_jobs.clear();
+	}
+	m_jobAdded.notify_all();
+	for (std::thread& worker : m_workers) worker.join();
+	m_workers.clear();
+
+	// Meshes in the middle of their upload
+	for (const std::shared_ptr<MeshUpload>& upload : m_meshUploads)
+	{
+		glDeleteBuffers(1, &upload->vboID);
+		glDeleteBuffers(1, &upload->iboID);
+	}
+	m_meshUploads.clear();
+	m_textureUploads.clear();
+	m_finishedMeshes.clear();
+	m_finishedTextures.clear();
+
+	for (GLsync& fence : m_segmentFences)
+	{
+		if (fence) glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (m_ringBuffer)
+	{
+		glUnmapNamedBuffer(m_ringBuffer);
+		glDeleteBuffers(1, &m_ringBuffer);
+		m_ringBuffer = 0;
+		m_ringMemory = nullptr;
+	}
+}
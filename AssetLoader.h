@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "BlockCompression.h"
+#include "GLUtils.hpp"
+#include "Materials.h"
+#include "Mesh.h"
+
+// Loads meshes and textures in the background. Reading, parsing, mesh processing and image decoding run on a pool of
+// worker threads, the GL side runs in Update on the render thread: the data is copied through a persistently mapped
+// staging ring, one segment per frame, and a segment is only written again after the fence of its frame has signaled.
+// Until then the meshes draw their placeholder and the textures hold a single texel.
+class AssetLoader
+{
+public:
+	// A mesh in its final vertex format, with the index buffer already packed
+	struct PreparedMesh
+	{
+		Mesh mesh; // Everything but the GL objects, mesh.mesh only has the index count, type and submeshes
+		GLsizei vertexSize = 0;
+		std::vector<uint8_t> vertexData;
+		std::vector<uint8_t> indexData;
+	};
+
+	// 0 threads: one less than the cores, at least one
+	explicit AssetLoader(unsigned int threadCount = 0);
+	~AssetLoader();
+	AssetLoader(const AssetLoader&) = delete;
+	AssetLoader& operator=(const AssetLoader&) = delete;
+
+	// prepare runs on a worker, target draws placeholder until the result is uploaded. The name is for the log.
+	// Critical assets are prepared and uploaded first, WaitForCritical waits for them
+	void LoadMesh(Mesh& target, const Mesh* placeholder, std::string name, std::function<PreparedMesh()> prepare, std::vector<VertexAttributeDescriptor> vertexAttribs, bool critical = false);
+	// The texture (generated by the caller) gets a placeholder texel until the images are decoded and uploaded.
+	// A cube map has six files, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, all of them are uploaded together.
+	// The mip chains are built on the workers and the textures end up in immutable storage.
+	// Compressed textures are block compressed on the workers too, and cached next to the files (TextureCache)
+	void LoadTexture(GLuint texture, GLenum target, std::vector<std::filesystem::path> files, bool generateMipmaps = true, bool critical = false, bool compressed = false);
+	// The same for the texture of a material, mipmapped, into a layer of the array of its size and format (Materials::Allocate).
+	// The material samples the placeholder array until then
+	void LoadMaterialTexture(Materials& materials, uint32_t material, std::filesystem::path file, bool critical = false, bool compressed = false);
+
+	// Uploads from the finished work as much as the current ring segment holds. Render thread only
+	void Update();
+	void WaitForCritical();
+	void WaitForAll();
+
+	// Creates the GL objects of a mesh right away, without the ring
+	static void CreateMesh(PreparedMesh&& prepared, Mesh& target, const std::vector<VertexAttributeDescriptor>& vertexAttribs);
+
+	// Stops the workers and releases the GL objects, while the context is still current
+	void Clean();
+
+private:
+	static constexpr size_t SegmentCount = 3;
+	static constexpr size_t SegmentSize = 8 << 20;
+	static constexpr size_t Alignment = 256;
+
+	struct MeshUpload
+	{
+		Mesh* target = nullptr;
+		std::string name;
+		std::vector<VertexAttributeDescriptor> vertexAttribs;
+		PreparedMesh prepared;
+		bool failed = false;
+		bool critical = false;
+		GLuint vboID = 0;
+		GLuint iboID = 0;
+		size_t vertexBytesDone = 0;
+		size_t indexBytesDone = 0;
+	};
+
+	struct TextureUpload
+	{
+		GLuint texture = 0;
+		GLenum target = GL_TEXTURE_2D;
+		Materials* materials = nullptr; // Instead of the texture, for a material's layer
+		uint32_t material = 0;
+		std::vector<std::filesystem::path> files;
+		std::vector<std::vector<ImageRGBA>> images; // Per file, with the mip chain if mipmapped
+		std::vector<BlockCompression::CompressedImage> compressedImages; // Instead of the images if compressed
+		std::atomic<size_t> imagesLeft{ 0 }; // Decoded by separate jobs, the last one hands the upload over
+		std::atomic<bool> failed{ false };
+		bool generateMipmaps = true;
+		bool critical = false;
+		bool compressed = false;
+	};
+
+	void WorkerMain();
+	void Enqueue(std::function<void()> job, bool critical);
+	// Decodes the images on the workers and queues the upload
+	void StartTexture(std::shared_ptr<TextureUpload> upload);
+	// Waits until a worker finishes something, or a little while
+	void WaitForWorkers();
+
+	// Space in the segment of this frame, at most bytes or nothing if partial isn't allowed. Returns the granted size
+	size_t Allocate(size_t bytes, bool partial, GLintptr& offset);
+	// False if it needs more ring space than what is left in this frame
+	bool Upload(MeshUpload&);
+	bool Upload(TextureUpload&);
+	void Complete(bool critical);
+	static void FinishMesh(PreparedMesh&& prepared, Mesh& target, GLuint vboID, GLuint iboID, const std::vector<VertexAttributeDescriptor>& vertexAttribs);
+
+	// Worker side
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_jobs;
+	std::mutex m_mutex; // For the jobs and the finished queues
+	std::condition_variable m_jobAdded;
+	std::condition_variable m_jobFinished;
+	bool m_stop = false;
+	std::deque<std::shared_ptr<MeshUpload>> m_finishedMeshes;
+	std::deque<std::shared_ptr<TextureUpload>> m_finishedTextures;
+
+	// Render thread side
+	std::deque<std::shared_ptr<MeshUpload>> m_meshUploads;
+	std::deque<std::shared_ptr<TextureUpload>> m_textureUploads;
+	size_t m_pending = 0;
+	size_t m_criticalPending = 0;
+
+	GLuint m_ringBuffer = 0;
+	uint8_t* m_ringMemory = nullptr;
+	std::array<GLsync, SegmentCount> m_segmentFences = {};
+	size_t m_segment = 0;
+	size_t m_segmentUsed = 0;
+};
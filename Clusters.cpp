@@ -0,0 +1,131 @@
+#include "Clusters.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define CLUSTERS_SSE2
+#endif
+
+static_assert(ClusterGrid::SizeX * ClusterGrid::SizeY % 4 == 0, "A slice has to be a multiple of the SIMD width");
+
+uint32_t ClusterGrid::GetSlice(float depth) const {
+	float slice = std::log(depth / m_ZNear) / std::log(m_ZFar / m_ZNear) * SizeZ;
+	return static_cast<uint32_t>(std::clamp(slice, 0.0f, SizeZ - 1.0f));
+}
+
+void ClusterGrid::buildBounds(const Camera& camera) {
+	m_Angle = camera.GetAngle();
+	m_Aspect = camera.GetAspect();
+	m_ZNear = camera.GetZNear();
+	m_ZFar = camera.GetZFar();
+
+	for (std::vector<float>* bound : { &m_MinX, &m_MinY, &m_MinZ, &m_MaxX, &m_MaxY, &m_MaxZ }) bound->resize(Count);
+
+	const float tanY = std::tan(m_Angle * 0.5f);
+	const float tanX = tanY * m_Aspect;
+
+	for (uint32_t z = 0; z < SizeZ; ++z) {
+		const float nearDepth = m_ZNear * std::pow(m_ZFar / m_ZNear, static_cast<float>(z) / SizeZ);
+		const float farDepth = m_ZNear * std::pow(m_ZFar / m_ZNear, static_cast<float>(z + 1) / SizeZ);
+
+		for (uint32_t y = 0; y < SizeY; ++y) {
+			const float y0 = -1.0f + 2.0f * y / SizeY;
+			const float y1 = -1.0f + 2.0f * (y + 1) / SizeY;
+
+			for (uint32_t x = 0; x < SizeX; ++x) {
+				const float x0 = -1.0f + 2.0f * x / SizeX;
+				const float x1 = -1.0f + 2.0f * (x + 1) / SizeX;
+				const uint32_t index = x + y * SizeX + z * SizeX * SizeY;
+
+				// The side planes go through the eye, so the extremes are on the near or far corners
+				m_MinX[index] = std::min(x0 * tanX * nearDepth, x0 * tanX * farDepth);
+				m_MaxX[index] = std::max(x1 * tanX * nearDepth, x1 * tanX * farDepth);
+				m_MinY[index] = std::min(y0 * tanY * nearDepth, y0 * tanY * farDepth);
+				m_MaxY[index] = std::max(y1 * tanY * nearDepth, y1 * tanY * farDepth);
+				m_MinZ[index] = -farDepth;
+				m_MaxZ[index] = -nearDepth;
+			}
+		}
+	}
+}
+
+void ClusterGrid::binSphere(uint32_t light, const glm::vec3& center, float radius) {
+	const float minDepth = -center.z - radius;
+	const float maxDepth = -center.z + radius;
+	if (maxDepth < m_ZNear || minDepth > m_ZFar) return;
+
+	const uint32_t fromSlice = GetSlice(std::max(minDepth, m_ZNear));
+	const uint32_t toSlice = GetSlice(std::min(maxDepth, m_ZFar));
+	const float radius2 = radius * radius;
+
+	for (uint32_t z = fromSlice; z <= toSlice; ++z) {
+		const uint32_t first = z * SizeX * SizeY;
+		const uint32_t last = first + SizeX * SizeY;
+#ifdef CLUSTERS_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 cx = _mm_set1_ps(center.x);
+		const __m128 cy = _mm_set1_ps(center.y);
+		const __m128 cz = _mm_set1_ps(center.z);
+		const __m128 r2 = _mm_set1_ps(radius2);
+
+		for (uint32_t i = first; i < last; i += 4) {
+			// Distance of the center from the box along each axis, 0 if inside
+			__m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_MinX[i]), cx), zero), _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&m_MaxX[i])), zero));
+			__m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_MinY[i]), cy), zero), _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&m_MaxY[i])), zero));
+			__m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_MinZ[i]), cz), zero), _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&m_MaxZ[i])), zero));
+			__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			const int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, r2));
+			if (!mask) continue;
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if (mask & (1 << lane)) m_Pairs.emplace_back(i + lane, light);
+			}
+		}
+#else
+		for (uint32_t i = first; i < last; ++i) {
+			float dx = std::max(m_MinX[i] - center.x, 0.0f) + std::max(center.x - m_MaxX[i], 0.0f);
+			float dy = std::max(m_MinY[i] - center.y, 0.0f) + std::max(center.y - m_MaxY[i], 0.0f);
+			float dz = std::max(m_MinZ[i] - center.z, 0.0f) + std::max(center.z - m_MaxZ[i], 0.0f);
+			if (dx * dx + dy * dy + dz * dz <= radius2) m_Pairs.emplace_back(i, light);
+		}
+#endif
+	}
+}
+
+void ClusterGrid::Build(const Camera& camera, const std::vector<glm::vec4>& spheres) {
+	if (m_Angle != camera.GetAngle() || m_Aspect != camera.GetAspect() || m_ZNear != camera.GetZNear() || m_ZFar != camera.GetZFar())
+		buildBounds(camera);
+
+	const glm::mat4 view = camera.GetViewMatrix();
+
+	m_Pairs.clear();
+	for (uint32_t i = 0; i < spheres.size(); ++i) {
+		binSphere(i, glm::vec3(view * glm::vec4(glm::vec3(spheres[i]), 1.0f)), spheres[i].w);
+	}
+
+	// Counting sort by cell, the light order inside a cell is kept
+	m_Cells.assign(Count, { 0, 0 });
+	for (const auto& pair : m_Pairs) ++m_Cells[pair.first].count;
+
+	uint32_t offset = 0;
+	for (Cell& cell : m_Cells) {
+		cell.offset = offset;
+		offset += cell.count;
+		cell.count = 0;
+	}
+
+	m_Indices.resize(m_Pairs.size());
+	for (const auto& pair : m_Pairs) {
+		Cell& cell = m_Cells[pair.first];
+		m_Indices[cell.offset + cell.count++] = pair.second;
+	}
+}
+
+const std::vector<ClusterGrid::Cell>& ClusterGrid::GetCells() const {
+	return m_Cells;
+}
+
+const std::vector<uint32_t>& ClusterGrid::GetIndices() const {
+	return m_Indices;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "Camera.h"
+
+// View frustum sliced into froxels: screen space tiles in x,y and exponential slices in depth.
+// Binning is CPU only, the result is uploaded by Lights.
+class ClusterGrid {
+public:
+	static constexpr uint32_t SizeX = 16;
+	static constexpr uint32_t SizeY = 9;
+	static constexpr uint32_t SizeZ = 24;
+	static constexpr uint32_t Count = SizeX * SizeY * SizeZ;
+
+	struct Cell {
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	// Spheres are world space position + radius
+	void Build(const Camera&, const std::vector<glm::vec4>&);
+
+	const std::vector<Cell>& GetCells() const;
+	const std::vector<uint32_t>& GetIndices() const;
+
+	uint32_t GetSlice(float) const;
+
+private:
+	// Structure of arrays for the froxel bounds (view space), one slice is SizeX * SizeY contiguous cells
+	std::vector<float> m_MinX, m_MinY, m_MinZ;
+	std::vector<float> m_MaxX, m_MaxY, m_MaxZ;
+
+	std::vector<Cell> m_Cells;
+	std::vector<uint32_t> m_Indices;
+	std::vector<std::pair<uint32_t, uint32_t>> m_Pairs; // cell, light pairs before sorting
+
+	float m_Angle = 0.0f;
+	float m_Aspect = 0.0f;
+	float m_ZNear = 0.0f;
+	float m_ZFar = 0.0f;
+
+	void buildBounds(const Camera&);
+	void binSphere(uint32_t, const glm::vec3&, float);
+};
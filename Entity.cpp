@@ -1,16 +1,10 @@
 #include "Entity.h"
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 
-GLuint Entity::LastTextureID = 0;
-GLuint Entity::LastProgramID = 0;
-
-void Entity::Reset() {
-    LastProgramID = 0;
-}
-
-Entity::Entity(const Mesh* mesh, const GLuint texture, const glm::vec3& position = { 0.0f, 0.0f, 0.0f }, const glm::vec3& rotation = { 0.0f, 0.0f, 0.0f }, const glm::vec3& scale = { 1.0f, 1.0f, 1.0f }) :
+Entity::Entity(const Mesh* mesh, const uint32_t material, const glm::vec3& position = { 0.0f, 0.0f, 0.0f }, const glm::vec3& rotation = { 0.0f, 0.0f, 0.0f }, const glm::vec3& scale = { 1.0f, 1.0f, 1.0f }) :
 	mesh(mesh),
-	textureID(texture),
+	material(material),
 	position(position),
 	rotation(rotation),
 	scale(scale) {}
@@ -33,6 +27,53 @@ glm::mat4 Entity::GetLocalModelMatrix() const {
         glm::scale(glm::mat4(1.0f), scale);
 }
 
+glm::mat4 Entity::GetDrawMatrix() const {
+    return GetLocalModelMatrix() * DrawnMesh().dequantize;
+}
+
+// Relative band around the view's threshold where the level of detail is kept, see Meshlets::View::lodHysteresis
+static constexpr float LodHysteresis = 0.25f;
+
+size_t Entity::SelectLod(const Meshlets::View& view, const glm::mat4& model) const {
+    const Mesh& drawn = DrawnMesh();
+    // The views without hysteresis start from the full detail and don't touch the camera's level
+    uint8_t unkept = 0;
+    uint8_t& current = view.lodHysteresis ? cameraLod : unkept;
+    const float hysteresis = view.lodHysteresis ? LodHysteresis : 0.0f;
+    if (drawn.lods.size() < 2 || view.pixelsPerUnit <= 0.0f) return current = 0;
+
+    // Pixels per unit of the mesh's own space at the bounding sphere
+    const float maxScale = std::max({ std::abs(scale.x), std::abs(scale.y), std::abs(scale.z) });
+    float pixelsPerUnit = view.pixelsPerUnit * maxScale;
+    if (!view.orthographic) {
+        const glm::vec3 center = glm::vec3(model * glm::vec4(drawn.center, 1.0f));
+        const float distance = glm::length(center - view.eye) - drawn.radius * maxScale;
+        if (distance <= 0.0f) return current = 0;
+        pixelsPerUnit /= distance;
+    }
+
+    auto projectedError = [&](size_t level) { return drawn.lods[level].error * pixelsPerUnit; };
+    size_t level = std::min<size_t>(current, drawn.lods.size() - 1);
+    while (level > 0 && projectedError(level) > view.lodThreshold * (1.0f + hysteresis)) --level;
+    while (level + 1 < drawn.lods.size() && projectedError(level + 1) < view.lodThreshold * (1.0f - hysteresis)) ++level;
+    current = static_cast<uint8_t>(level);
+    return level;
+}
+
+void Entity::Draw(const Meshlets::View& view) const {
+    const Mesh& drawn = DrawnMesh();
+    const glm::mat4 model = GetLocalModelMatrix();
+    const size_t level = SelectLod(view, model);
+    if (level == 0) {
+        Meshlets::Draw(drawn.mesh, drawn.meshlets, model, view);
+        return;
+    }
+
+    // The coarser levels are small, they are drawn whole
+    const MeshLod& lod = drawn.lods[level];
+    DrawOGLObjectRange(drawn.mesh, lod.indexOffset, lod.indexCount);
+}
+
 void Entity::SetGenerateReflection(bool generateReflection) {
     if (generateReflection) {
         environmentMap = std::make_unique<EnvironmentMap>(mesh->center + position, 1);
@@ -45,16 +86,8 @@ bool Entity::GetGenerateReflection() const {
     return environmentMap.get();
 };
 
-void Entity::SetTexture(GLuint program) const {
-    if (program != LastProgramID) {
-        LastProgramID = program;
-        LastTextureID = 0;
-    }
-
-    if (LastTextureID != textureID) {
-        LastTextureID = textureID;
-        glBindTextureUnit(0, textureID);
-    }
+void Entity::SetMaterial() const {
+    Materials::SetIndex(material);
 }
 
 void Entity::Update(const std::vector<Entity>& entities) {
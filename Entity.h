@@ -4,16 +4,18 @@
 #include <memory>
 #include "GLUtils.hpp"
 #include "EnvironmentMap.h"
+#include "Materials.h"
 #include "Mesh.h"
 
 class Entity {
-	static GLuint LastTextureID;
-	static GLuint LastProgramID;
+	// Last level of detail in the camera view, for the hysteresis
+	mutable uint8_t cameraLod = 0;
+	size_t SelectLod(const Meshlets::View&, const glm::mat4&) const;
+	// The mesh, or its placeholder while it is loading
+	const Mesh& DrawnMesh() const { return mesh->placeholder ? *mesh->placeholder : *mesh; }
 public:
-	static void Reset();
-
 	const Mesh* mesh;
-	const GLuint textureID;
+	const uint32_t material; // Index in Materials
 	
 	glm::vec3 position;
 	glm::vec3 rotation;
@@ -25,12 +27,17 @@ public:
 
 	std::unique_ptr<EnvironmentMap> environmentMap;
 
-	Entity(const Mesh*, const GLuint, const glm::vec3&, const glm::vec3&, const glm::vec3&);
+	Entity(const Mesh*, const uint32_t, const glm::vec3&, const glm::vec3&, const glm::vec3&);
 	void SetGenerateReflection(bool);
 	bool GetGenerateReflection() const;
 
 	glm::mat4 GetLocalModelMatrix() const;
+	// The model matrix for the vertex data in the buffers, includes the dequantization of the mesh
+	glm::mat4 GetDrawMatrix() const;
+	// Draws the mesh at the level of detail the view needs, skipping the meshlets that are culled in the view
+	void Draw(const Meshlets::View&) const;
 	void Update(const std::vector<Entity>&);
-	void SetTexture(GLuint) const;
+	// The material index for the draws of the bound program, see Materials::Bind
+	void SetMaterial() const;
 	void Moved() {};
 };
\ No newline at end of file
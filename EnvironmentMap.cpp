@@ -1,6 +1,7 @@
 #include "EnvironmentMap.h"
 #include "Entity.h"
 #include "Logs.h"
+#include "CPUTrace.h"
 #include "ProgramBuilder.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -36,7 +37,7 @@ EnvironmentMap::EnvironmentMap(glm::vec3 center, float radius) : resolution(480)
 			glDeleteProgram(shaderID);
 		});
 	}
-	transforms = getTransform(center, radius);
+	updatePosition(center, radius);
 	createFrameBuffer(resolution);
 }
 
@@ -59,6 +60,7 @@ void EnvironmentMap::ClearTexture(GLint from, GLint to) {
 }
 
 void EnvironmentMap::UpdateScene(const std::vector<Entity>& entities) {
+	CPU_TRACE_SCOPE("EnvironmentMap::UpdateScene");
 	bool update = (int)(refreshTime + 6.0f / frequency) > (int)refreshTime;
 	int from = (int)refreshTime;
 	refreshTime = std::fmod(refreshTime + 6.0f / frequency, 6.0f);
@@ -87,12 +89,22 @@ void EnvironmentMap::UpdateScene(const std::vector<Entity>& entities) {
 
 	glUniformMatrix4fv(1, 6, GL_FALSE, (float*)transforms.data());
 	glUniform1iv(7, 6, updateValues.data());
+
+	// Reflections are blurred by the surface, a coarser level of detail is fine
+	Meshlets::View cullView;
+	cullView.eye = center;
+	cullView.pixelsPerUnit = Meshlets::PixelsPerUnit(transforms[0], static_cast<float>(resolution));
+	cullView.lodThreshold = 2.0f;
+	cullView.lodHysteresis = false;
+	for (size_t face = 0; face < updateValues.size(); ++face) {
+		if (updateValues[face]) cullView.frusta.push_back(Meshlets::ExtractFrustum(transforms[face]));
+	}
+
 	for (const Entity& entity : entities) {
 		if (entity.reflected) {
-			entity.SetTexture(shaderID);
-			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(entity.GetLocalModelMatrix()));
-			glBindVertexArray(entity.mesh->mesh.vaoID);
-			glDrawElements(GL_TRIANGLES, entity.mesh->mesh.count, GL_UNSIGNED_INT, nullptr);
+			entity.SetMaterial();
+			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(entity.GetDrawMatrix()));
+			entity.Draw(cullView);
 		}
 	}
 	
@@ -135,6 +147,7 @@ void EnvironmentMap::createFrameBuffer(GLint resolution) {
 }
 
 void EnvironmentMap::updatePosition(glm::vec3 center, float radius) {
+	this->center = center;
 	transforms = getTransform(center, radius);
 }
 
@@ -13,6 +13,7 @@ class EnvironmentMap {
 	GLuint m_CubeMap = 0;
 	GLuint m_CubeMapDepth = 0;
 	std::array<glm::mat4, 6> transforms;
+	glm::vec3 center;
 	float refreshTime;
 
 	void ClearTexture(GLint, GLint);
@@ -0,0 +1,40 @@
+#include "FrameConstants.h"
+#include "Meshlets.h"
+#include "CPUTrace.h"
+#include <algorithm>
+#include <iterator>
+
+FrameConstants::FrameConstants() {
+	glCreateBuffers(1, &m_Buffer);
+	glNamedBufferStorage(m_Buffer, sizeof(FrameData), nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+FrameConstants::~FrameConstants() {
+	glDeleteBuffers(1, &m_Buffer);
+}
+
+void FrameConstants::Update(const Camera& camera, const glm::ivec4& viewport, const glm::vec2& jitter) {
+	CPU_TRACE_SCOPE("FrameConstants::Update");
+	m_Data.view = camera.GetViewMatrix();
+	m_Data.proj = camera.GetProj();
+	// Shifts the clip space x and y by jitter pixels after the perspective divide
+	m_Data.proj[2][0] += 2.0f * jitter.x / static_cast<float>(std::max(viewport.z, 1));
+	m_Data.proj[2][1] += 2.0f * jitter.y / static_cast<float>(std::max(viewport.w, 1));
+	m_Data.viewProj = m_Data.proj * m_Data.view;
+	m_Data.invView = glm::inverse(m_Data.view);
+	m_Data.invProj = glm::inverse(m_Data.proj);
+	m_Data.invViewProj = m_Data.invView * m_Data.invProj;
+
+	const Meshlets::Frustum frustum = Meshlets::ExtractFrustum(m_Data.viewProj);
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), m_Data.frustumPlanes);
+	m_Data.viewport = glm::vec4(viewport);
+	m_Data.jitter = jitter;
+	m_Data.zNearFar = glm::vec2(camera.GetZNear(), camera.GetZFar());
+
+	glNamedBufferSubData(m_Buffer, 0, sizeof(FrameData), &m_Data);
+	glBindBufferBase(GL_UNIFORM_BUFFER, Binding, m_Buffer);
+}
+
+const FrameData& FrameConstants::Get() const {
+	return m_Data;
+}
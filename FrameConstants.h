@@ -0,0 +1,37 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "Camera.h"
+
+// GPU side layout of the FrameConstants block of Shaders/frame.glsl, std140
+struct FrameData {
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::mat4 viewProj;
+	glm::mat4 invView;
+	glm::mat4 invProj;
+	glm::mat4 invViewProj;
+	glm::vec4 frustumPlanes[6]; // World space, normalized, pointing inwards
+	glm::vec4 viewport; // x, y, width, height
+	glm::vec2 jitter;
+	glm::vec2 zNearFar;
+};
+
+// The camera matrices, their inverses, the frustum and the viewport of the frame in a uniform buffer.
+// Computed once per frame in Update, every pass reads them from the buffer instead of inverting and uploading its own copies.
+class FrameConstants {
+	GLuint m_Buffer = 0;
+	FrameData m_Data = {};
+public:
+	static constexpr GLuint Binding = 0;
+
+	FrameConstants();
+	~FrameConstants();
+	FrameConstants(const FrameConstants&) = delete;
+	FrameConstants& operator=(const FrameConstants&) = delete;
+
+	// Once per frame before the passes, also binds the buffer to Binding.
+	// A jitter (in pixels, for a temporal pass) offsets the projection, the matrices of the buffer are the jittered ones
+	void Update(const Camera&, const glm::ivec4& viewport, const glm::vec2& jitter = glm::vec2(0));
+	const FrameData& Get() const;
+};
@@ -0,0 +1,295 @@
+#include "Headless.h"
+
+// GLEW
+#include <GL/glew.h>
+
+// SDL, only for logging and image loading, no video subsystem
+#include <SDL2/SDL.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+#include "MyApp.h"
+#include "CPUTrace.h"
+#include "Logs.h"
+#include "Mipmaps.h"
+#include "ProgramBuilder.h"
+
+#if __has_include(<EGL/egl.h>)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HEADLESS_EGL
+#endif
+
+namespace
+{
+	struct HeadlessOptions
+	{
+		int width = 1280;
+		int height = 720;
+		int frames = 100;
+		glm::vec3 eye = glm::vec3(10, 40, 10);
+		glm::vec3 at = glm::vec3(0, 15, 0);
+		const char* output = nullptr;
+		const char* profile = nullptr;
+		const char* trace = nullptr;
+		int benchMips = 0; // Largest texture size of the mip generation benchmark, 0 renders frames
+	};
+
+	bool ParseVec3(const char* text, glm::vec3& result)
+	{
+		return std::sscanf(text, "%f,%f,%f", &result.x, &result.y, &result.z) == 3;
+	}
+
+	bool ParseOptions(int argc, char* args[], HeadlessOptions& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			std::string_view arg = args[i];
+			// The flags without a value, main handles --obj-streaming before this
+			if (arg == "--headless" || arg == "--obj-streaming") continue;
+			if (i + 1 >= argc)
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Missing value for %s", args[i]);
+				return false;
+			}
+
+			const char* value = args[++i];
+			bool valid = true;
+			if (arg == "--width") valid = std::sscanf(value, "%d", &options.width) == 1 && options.width > 0;
+			else if (arg == "--height") valid = std::sscanf(value, "%d", &options.height) == 1 && options.height > 0;
+			else if (arg == "--frames") valid = std::sscanf(value, "%d", &options.frames) == 1 && options.frames > 0;
+			else if (arg == "--eye") valid = ParseVec3(value, options.eye);
+			else if (arg == "--at") valid = ParseVec3(value, options.at);
+			else if (arg == "--output") options.output = value;
+			else if (arg == "--profile") options.profile = value;
+			else if (arg == "--trace") options.trace = value;
+			else if (arg == "--bench-mips") valid = std::sscanf(value, "%d", &options.benchMips) == 1 && options.benchMips >= 1024;
+			else
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Unknown option %s", args[i - 1]);
+				return false;
+			}
+
+			if (!valid)
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Invalid value for %s: %s", args[i - 1], value);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Binary PPM, rows flipped since GL reads bottom-up
+	bool WritePPM(const char* fileName, int width, int height, const std::vector<unsigned char>& rgb)
+	{
+		std::ofstream image(fileName, std::ios::binary);
+		if (!image.is_open()) return false;
+
+		image << "P6\n" << width << " " << height << "\n255\n";
+		for (int y = height - 1; y >= 0; --y)
+			image.write(reinterpret_cast<const char*>(rgb.data()) + static_cast<size_t>(y) * width * 3, static_cast<std::streamsize>(width) * 3);
+		return true;
+	}
+}
+
+#ifdef HEADLESS_EGL
+
+int RunHeadless(int argc, char* args[])
+{
+	HeadlessOptions options;
+	if (!ParseOptions(argc, args, options)) return 1;
+
+	//
+	// 1: EGL display, surfaceless if Mesa supports it
+	//
+
+	EGLDisplay display = EGL_NO_DISPLAY;
+	auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+	if (getPlatformDisplay) display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint eglMajor = 0, eglMinor = 0;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor))
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Error during the EGL initialization: 0x%x", eglGetError());
+		return 1;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Desktop OpenGL is not supported by EGL");
+		eglTerminate(display);
+		return 1;
+	}
+
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_STENCIL_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0)
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] No suitable EGL config");
+		eglTerminate(display);
+		return 1;
+	}
+
+	//
+	// 2: Same GL 4.6 core context as the windowed mode
+	//
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 6,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef _DEBUG
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Error during the creation of the OGL context: 0x%x", eglGetError());
+		eglTerminate(display);
+		return 1;
+	}
+
+	// Without EGL_KHR_surfaceless_context fall back to a pbuffer, we never draw into it anyway
+	EGLSurface surface = EGL_NO_SURFACE;
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+		if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Error while making the context current: 0x%x", eglGetError());
+			eglDestroyContext(display, context);
+			eglTerminate(display);
+			return 1;
+		}
+	}
+
+	// GLEW built for GLX reports the missing X display, but loads the entry points anyway
+	glewExperimental = GL_TRUE;
+	GLenum error = glewInit();
+	if (error != GLEW_OK && error != GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[GLEW] Error during the initialization of glew.");
+		return 1;
+	}
+
+	SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "[Headless] EGL %d.%d, %s, %s", eglMajor, eglMinor,
+		reinterpret_cast<const char*>(glGetString(GL_RENDERER)), reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+	//
+	// 3: Render into our own framebuffer at a fixed resolution
+	//
+
+	GLuint frameBuffer = 0, colorTexture = 0, depthTexture = 0;
+	glCreateFramebuffers(1, &frameBuffer);
+	glCreateTextures(GL_TEXTURE_2D, 1, &colorTexture);
+	glTextureStorage2D(colorTexture, 1, GL_RGBA8, options.width, options.height);
+	glNamedFramebufferTexture(frameBuffer, GL_COLOR_ATTACHMENT0, colorTexture, 0);
+	glCreateTextures(GL_TEXTURE_2D, 1, &depthTexture);
+	glTextureStorage2D(depthTexture, 1, GL_DEPTH24_STENCIL8, options.width, options.height);
+	glNamedFramebufferTexture(frameBuffer, GL_DEPTH_STENCIL_ATTACHMENT, depthTexture, 0);
+	CheckFramebufferError(frameBuffer);
+
+	int result = 0;
+	if (options.benchMips > 0) Mipmaps::Benchmark(options.benchMips);
+	else
+	{
+		ProgramBuilder::BeginBatch();
+		CMyApp app;
+		const bool initialized = app.Init();
+		ProgramBuilder::EndBatch();
+		if (!initialized)
+		{
+			SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[app.Init] Error during the initialization of the application!");
+			result = 1;
+		}
+		else
+		{
+			// Everything loaded, so the frames and their timings don't depend on the loader threads
+			app.WaitForAssets();
+			app.SetOutputFramebuffer(frameBuffer);
+			app.SetCamera(options.eye, options.at);
+			app.Resize(options.width, options.height);
+
+			// Fixed time step, so runs are comparable
+			constexpr float deltaTime = 1.0f / 60.0f;
+			std::vector<double> frameTimes;
+			frameTimes.reserve(options.frames);
+			for (int frame = 0; frame < options.frames; ++frame)
+			{
+				CPU_TRACE_SCOPE("Frame");
+				auto start = std::chrono::steady_clock::now();
+
+				app.Update({ frame * deltaTime, deltaTime });
+				app.Render();
+				glFinish();
+
+				frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			}
+
+			double total = 0.0;
+			for (double time : frameTimes) total += time;
+			SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "[Headless] %d frames at %dx%d, %.3f ms/frame on average",
+				options.frames, options.width, options.height, total / frameTimes.size());
+
+			if (options.output)
+			{
+				std::vector<unsigned char> pixels(static_cast<size_t>(options.width) * options.height * 3);
+				glPixelStorei(GL_PACK_ALIGNMENT, 1);
+				glNamedFramebufferReadBuffer(frameBuffer, GL_COLOR_ATTACHMENT0);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
+				glReadPixels(0, 0, options.width, options.height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+				if (!WritePPM(options.output, options.width, options.height, pixels))
+				{
+					SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] Error while writing %s", options.output);
+					result = 1;
+				}
+			}
+			if (options.profile) app.GetGPUProfiler().WriteCSV(options.profile);
+			if (options.trace) CPUTrace::WriteJSON(options.trace);
+		}
+		app.Clean();
+	} // The app has to be destroyed while the context is still current
+
+	glDeleteTextures(1, &colorTexture);
+	glDeleteTextures(1, &depthTexture);
+	glDeleteFramebuffers(1, &frameBuffer);
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+
+	return result;
+}
+
+#else
+
+int RunHeadless(int argc, char* args[])
+{
+	HeadlessOptions options;
+	if (!ParseOptions(argc, args, options)) return 1;
+
+	SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[Headless] This build has no EGL support, headless mode is not available");
+	return 1;
+}
+
+#endif
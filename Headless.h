@@ -0,0 +1,7 @@
+#pragma once
+
+// Runs CMyApp without a window or ImGui on an EGL surfaceless (or pbuffer) context, e.g. on Mesa llvmpipe.
+// --width <w> --height <h> --frames <n> --eye <x,y,z> --at <x,y,z> --output <file.ppm> --profile <file.csv> --trace <file.json>
+// --bench-mips <size>: instead of rendering, compare glGenerateMipmap with the CPU mip chains on textures up to size x size
+// --obj-streaming is taken as well, see main.cpp
+int RunHeadless(int argc, char* args[]);
@@ -2,14 +2,15 @@
 #include "ProgramBuilder.h"
 #include "Shadows.h"
 #include "Logs.h"
+#include "CPUTrace.h"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
 
-struct Light {
-	glm::vec4 color;
-	glm::vec4 positionDirection;
+// Inner and outer tessellation level of the point light volumes
+static constexpr int PointLightTessellation = 3;
 
-	Light(const LightInfo& lightInfo) : color(lightInfo.color, sqrt((lightInfo.color.r + lightInfo.color.g + lightInfo.color.b) / 0.05)), positionDirection(lightInfo.position) {}
-};
+Light::Light(const LightInfo& lightInfo) : color(lightInfo.color, sqrt((lightInfo.color.r + lightInfo.color.g + lightInfo.color.b) / 0.05)), positionDirection(lightInfo.position) {}
 
 LightInfo::LightInfo(const glm::vec3& color, const glm::vec4& position, const bool castShadow, const std::array<int, 2>& resolutionWH) :
 	color(color),
@@ -19,36 +20,165 @@ LightInfo::LightInfo(const glm::vec3& color, const glm::vec4& position, const bo
 	refreshFrequency(1.0f) {}
 
 LightBuffer::LightBuffer() {
-	glCreateBuffers(1, &m_Buffer);
+	reserve(64);
 }
 
 LightBuffer::~LightBuffer() {
-	if(m_Buffer) glDeleteBuffers(1, &m_Buffer);
+	deleteFences();
+	if (m_Buffer) {
+		glUnmapNamedBuffer(m_Buffer);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+}
+
+void LightBuffer::deleteFences() {
+	for (Region& region : m_Regions) {
+		if (region.fence) glDeleteSync(region.fence);
+		region.fence = nullptr;
+	}
+}
+
+void LightBuffer::reserve(size_t capacity) {
+	if (capacity <= m_Capacity) return;
+	// The old buffer may still be read, deleting it is deferred by GL until it isn't
+	deleteFences();
+	if (m_Buffer) {
+		glUnmapNamedBuffer(m_Buffer);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	GLint alignment = 1;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_Capacity = capacity;
+	m_RegionSize = static_cast<GLsizeiptr>(m_Capacity * sizeof(Light));
+	m_RegionSize = (m_RegionSize + alignment - 1) / alignment * alignment;
+
+	// Immutable storage can't be resized, so growing means a new buffer with the CPU copy written into every region
+	constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_Buffer);
+	glNamedBufferStorage(m_Buffer, RegionCount * m_RegionSize, nullptr, flags);
+	m_Mapped = static_cast<Light*>(glMapNamedBufferRange(m_Buffer, 0, RegionCount * m_RegionSize, flags));
+	for (size_t i = 0; i < RegionCount; ++i) {
+		Light* region = reinterpret_cast<Light*>(reinterpret_cast<uint8_t*>(m_Mapped) + i * m_RegionSize);
+		std::copy(m_Lights.begin(), m_Lights.end(), region);
+		m_Regions[i].dirtyFrom = SIZE_MAX;
+		m_Regions[i].dirtyTo = 0;
+	}
+}
+
+void LightBuffer::write(size_t index) {
+	for (Region& region : m_Regions) {
+		region.dirtyFrom = std::min(region.dirtyFrom, index);
+		region.dirtyTo = std::max(region.dirtyTo, index + 1);
+	}
 }
 
 void LightBuffer::Bind(GLuint base) const {
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, base, m_Buffer);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, base, m_Buffer, m_Region * m_RegionSize, m_RegionSize);
 }
 
-void LightBuffer::AddLight(const LightInfo& lightInfo) {
+void LightBuffer::Flush() {
+	Region& next = m_Regions[(m_Region + 1) % RegionCount];
+	if (next.dirtyFrom >= next.dirtyTo) return;
+
+	// The commands so far read the current region
+	Region& current = m_Regions[m_Region];
+	if (current.fence) glDeleteSync(current.fence);
+	current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_Region = (m_Region + 1) % RegionCount;
+	if (next.fence) {
+		CPU_TRACE_SCOPE("LightBuffer::Flush wait");
+		while (glClientWaitSync(next.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+		glDeleteSync(next.fence);
+		next.fence = nullptr;
+	}
+
+	const size_t to = std::min(next.dirtyTo, m_Lights.size());
+	Light* region = reinterpret_cast<Light*>(reinterpret_cast<uint8_t*>(m_Mapped) + m_Region * m_RegionSize);
+	if (next.dirtyFrom < to) std::copy(m_Lights.begin() + next.dirtyFrom, m_Lights.begin() + to, region + next.dirtyFrom);
+	next.dirtyFrom = SIZE_MAX;
+	next.dirtyTo = 0;
+}
+
+LightHandle LightBuffer::AddLight(const LightInfo& lightInfo) {
+	if (m_Lights.size() == m_Capacity) reserve(m_Capacity * 2);
+
+	uint32_t handle;
+	if (m_FreeHandles.empty()) {
+		handle = static_cast<uint32_t>(m_HandleToIndex.size());
+		m_HandleToIndex.push_back(0);
+	} else {
+		handle = m_FreeHandles.back();
+		m_FreeHandles.pop_back();
+	}
+	m_HandleToIndex[handle] = static_cast<uint32_t>(m_Lights.size());
+	m_IndexToHandle.push_back(handle);
+
 	m_LightInfos.push_back(lightInfo);
-	std::vector<Light> lightData;
-	lightData.reserve(m_LightInfos.size());
-	for (const LightInfo& lightInfo : m_LightInfos) lightData.emplace_back(lightInfo);
-	glNamedBufferData(m_Buffer, lightData.size() * sizeof(Light), lightData.data(), GL_STATIC_DRAW);
+	m_Lights.emplace_back(lightInfo);
+	write(m_Lights.size() - 1);
+	return { handle };
 }
 
 void LightBuffer::UpdateLight(size_t index) {
-	Light light = m_LightInfos[index];
-	glNamedBufferSubData(m_Buffer, index * sizeof(Light), sizeof(Light), &light);
+	m_Lights[index] = m_LightInfos[index];
+	write(index);
 }
 
 void LightBuffer::DeleteLight(size_t index) {
-	m_LightInfos.erase(m_LightInfos.begin() + index);
-	std::vector<Light> lightData;
-	lightData.reserve(m_LightInfos.size());
-	for (const LightInfo& lightInfo : m_LightInfos) lightData.emplace_back(lightInfo);
-	glNamedBufferData(m_Buffer, lightData.size() * sizeof(Light), lightData.data(), GL_STATIC_DRAW);
+	const size_t last = m_Lights.size() - 1;
+	m_FreeHandles.push_back(m_IndexToHandle[index]);
+
+	if (index != last) {
+		m_LightInfos[index] = m_LightInfos[last];
+		m_Lights[index] = m_Lights[last];
+		m_IndexToHandle[index] = m_IndexToHandle[last];
+		m_HandleToIndex[m_IndexToHandle[index]] = static_cast<uint32_t>(index);
+		write(index);
+	}
+
+	m_LightInfos.pop_back();
+	m_Lights.pop_back();
+	m_IndexToHandle.pop_back();
+}
+
+size_t LightBuffer::GetIndex(LightHandle handle) const {
+	return m_HandleToIndex[handle.id];
+}
+
+void LightBuffer::Benchmark() {
+	using Clock = std::chrono::steady_clock;
+	auto toNs = [](Clock::duration time, size_t count) { return std::chrono::duration<double, std::nano>(time).count() / count; };
+
+	for (size_t count : { 1000, 10000, 100000 }) {
+		LightBuffer buffer;
+		LightInfo info({ 1, 1, 1 }, { 0, 0, 0, 1 }, false, { 1024, 1024 });
+		std::vector<LightHandle> handles;
+		handles.reserve(count);
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < count; ++i) handles.push_back(buffer.AddLight(info));
+		buffer.Flush();
+		Clock::duration addTime = Clock::now() - start;
+
+		start = Clock::now();
+		for (size_t i = 0; i < count; ++i) {
+			size_t index = (i * 7919) % count;
+			buffer.GetInfos()[index].position.x += 1.0f;
+			buffer.UpdateLight(index);
+		}
+		buffer.Flush();
+		Clock::duration updateTime = Clock::now() - start;
+
+		start = Clock::now();
+		for (size_t i = 0; i < count; ++i) buffer.DeleteLight(buffer.GetIndex(handles[(i * 7919) % count]));
+		buffer.Flush();
+		Clock::duration removeTime = Clock::now() - start;
+
+		SDL_Log("[LightBuffer] %zu lights: add %.1f ns, update %.1f ns, remove %.1f ns per light",
+			count, toNs(addTime, count), toNs(updateTime, count), toNs(removeTime, count));
+	}
 }
 
 std::vector<LightInfo>& LightBuffer::GetInfos() {
@@ -63,16 +193,24 @@ GLsizei LightBuffer::GetSize() const {
 	return static_cast<GLsizei>(m_LightInfos.size());
 }
 
-Lights::Lights() {
+Lights::Lights() : m_DirectionalShadowedPrograms([this](ProgramBuilder& builder, uint32_t quality) {
+	builder
+		.ShaderStage(GL_VERTEX_SHADER, "Shaders/deferred_shadow_dir.vert")
+		.ShaderStage(GL_FRAGMENT_SHADER, "Shaders/deferred_shadow_dir.frag")
+		.Define("CASCADE_COUNT", ShadowCascades)
+		.Define("CASCADE_DISTANCES", getCascadeDistances())
+		.Define("PCF_RADIUS", static_cast<int>(quality));
+}) {
 	shadowCascadeLevels = { 1000.f / 50.0f, 1000.f / 25.0f, 1000.f / 10.0f, 1000.f / 2.0f };
 
-	for (GLuint& program : m_LightShaderIDs) program = glCreateProgram();
+	for (LightType type : { POINT_LIGHT, DIRECTIONAL_LIGHT, POINT_SHADOWED_LIGHT }) m_LightShaderIDs[type] = glCreateProgram();
 
 	ProgramBuilder{ m_LightShaderIDs[POINT_LIGHT] }
 		.ShaderStage(GL_VERTEX_SHADER, "Shaders/deferred_point2.vert")
 		.ShaderStage(GL_TESS_CONTROL_SHADER, "Shaders/deferred_point.tesc")
 		.ShaderStage(GL_TESS_EVALUATION_SHADER, "Shaders/deferred_point.tese")
 		.ShaderStage(GL_FRAGMENT_SHADER, "Shaders/deferred_point.frag")
+		.Define("TESS_LEVEL", PointLightTessellation)
 		.Link();
 
 	ProgramBuilder{ m_LightShaderIDs[DIRECTIONAL_LIGHT] }
@@ -85,12 +223,11 @@ Lights::Lights() {
 		.ShaderStage(GL_TESS_CONTROL_SHADER, "Shaders/deferred_shadow_point.tesc")
 		.ShaderStage(GL_TESS_EVALUATION_SHADER, "Shaders/deferred_shadow_point.tese")
 		.ShaderStage(GL_FRAGMENT_SHADER, "Shaders/deferred_shadow_point.frag")
+		.Define("TESS_LEVEL", PointLightTessellation)
 		.Link();
 
-	ProgramBuilder{ m_LightShaderIDs[DIRECTIONAL_SHADOWED_LIGHT] }
-		.ShaderStage(GL_VERTEX_SHADER, "Shaders/deferred_shadow_dir.vert")
-		.ShaderStage(GL_FRAGMENT_SHADER, "Shaders/deferred_shadow_dir.frag")
-		.Link();
+	// The other qualities are compiled when they are picked
+	m_DirectionalShadowedPrograms.Get(m_ShadowQuality);
 
 	m_PointShadowShaderID = glCreateProgram();
 	ProgramBuilder{ m_PointShadowShaderID }
@@ -103,7 +240,22 @@ Lights::Lights() {
 	ProgramBuilder{ m_DirectionalShadowShaderID }
 		.ShaderStage(GL_VERTEX_SHADER, "Shaders/shadow_point.vert")
 		.ShaderStage(GL_GEOMETRY_SHADER, "Shaders/shadow_dir.geom")
+		.Define("CASCADE_COUNT", ShadowCascades)
+		.Link();
+
+	m_TiledPointShaderID = glCreateProgram();
+	ProgramBuilder{ m_TiledPointShaderID }
+		.ShaderStage(GL_COMPUTE_SHADER, "Shaders/deferred_point_tiled.comp")
+		.Link();
+
+	m_ClusteredPointShaderID = glCreateProgram();
+	ProgramBuilder{ m_ClusteredPointShaderID }
+		.ShaderStage(GL_VERTEX_SHADER, "Shaders/SSAO.vert")
+		.ShaderStage(GL_FRAGMENT_SHADER, "Shaders/deferred_point_clustered.frag")
 		.Link();
+
+	glCreateBuffers(1, &m_ClusterCellBuffer);
+	glCreateBuffers(1, &m_ClusterIndexBuffer);
 }
 
 Lights::~Lights() {
@@ -115,6 +267,10 @@ Lights::~Lights() {
 	for (GLuint programID : m_LightShaderIDs) glDeleteProgram(programID);
 	glDeleteProgram(m_PointShadowShaderID);
 	glDeleteProgram(m_DirectionalShadowShaderID);
+	glDeleteProgram(m_TiledPointShaderID);
+	glDeleteProgram(m_ClusteredPointShaderID);
+	glDeleteBuffers(1, &m_ClusterCellBuffer);
+	glDeleteBuffers(1, &m_ClusterIndexBuffer);
 }
 
 void Lights::RenderLights(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer, const Camera& camera) const {
@@ -126,20 +282,31 @@ void Lights::RenderLights(GLuint diffuseBuffer, GLuint normalBuffer, GLuint dept
 	glBlendEquation(GL_FUNC_ADD);
 	glBlendFunc(GL_ONE, GL_ONE);
 
-	renderPointLights(diffuseBuffer, normalBuffer, depthBuffer, camera, POINT_LIGHT);
-	renderDirectionalLights(diffuseBuffer, normalBuffer, camera, DIRECTIONAL_LIGHT);
+	switch (m_PointLightMode)
+	{
+	case POINT_LIGHT_TILED:
+		renderPointLightsTiled(diffuseBuffer, normalBuffer, depthBuffer);
+		break;
+	case POINT_LIGHT_CLUSTERED:
+		renderPointLightsClustered(diffuseBuffer, normalBuffer, depthBuffer);
+		break;
+	default:
+		renderPointLights(diffuseBuffer, normalBuffer, depthBuffer, POINT_LIGHT);
+		break;
+	}
+	renderDirectionalLights(diffuseBuffer, normalBuffer, DIRECTIONAL_LIGHT);
 
 	glEnable(GL_STENCIL_TEST);
 	glStencilFunc(GL_EQUAL, 0, 0xFF);
 	glStencilMask(0x00);
 
-	renderPointLightsShadowed(diffuseBuffer, normalBuffer, depthBuffer, camera);
+	renderPointLightsShadowed(diffuseBuffer, normalBuffer, depthBuffer);
 	renderDirectionalLightsShadowed(diffuseBuffer, normalBuffer, depthBuffer, camera);
 
 	glStencilFunc(GL_EQUAL, 1, 0xFF);
 
-	renderPointLights(diffuseBuffer, normalBuffer, depthBuffer, camera, POINT_SHADOWED_LIGHT);
-	renderDirectionalLights(diffuseBuffer, normalBuffer, camera, DIRECTIONAL_SHADOWED_LIGHT);
+	renderPointLights(diffuseBuffer, normalBuffer, depthBuffer, POINT_SHADOWED_LIGHT);
+	renderDirectionalLights(diffuseBuffer, normalBuffer, DIRECTIONAL_SHADOWED_LIGHT);
 
 	glDisable(GL_STENCIL_TEST);
 	glDisable(GL_BLEND);
@@ -163,7 +330,11 @@ std::array<glm::mat4, 6> getTransform(const LightInfo& info, const PointLightSha
 	return transforms;
 }
 
+// Shadow maps are filtered and seen at an angle, they get away with coarser levels of detail than the camera
+static constexpr float ShadowLodThreshold = 2.0f;
+
 void Lights::UpdateShadowMaps(const std::vector<Entity>& entities, const Camera& camera) {
+	CPU_TRACE_SCOPE("Lights::UpdateShadowMaps");
 	int windowValues[4];
 	glGetIntegerv(GL_VIEWPORT, windowValues);
 	//Point Shadow
@@ -181,11 +352,20 @@ void Lights::UpdateShadowMaps(const std::vector<Entity>& entities, const Camera&
 		glUniform3fv(1, 1, glm::value_ptr(infos[i].position));
 		glUniform1f(2, pointShadows[i].GetRadius());
 
+		// Only the faces that are rendered this frame count for the culling
+		Meshlets::View cullView;
+		cullView.eye = glm::vec3(infos[i].position);
+		cullView.pixelsPerUnit = Meshlets::PixelsPerUnit(transforms[0], static_cast<float>(infos[i].shadowMapResolutionWH[1]));
+		cullView.lodThreshold = ShadowLodThreshold;
+		cullView.lodHysteresis = false;
+		for (size_t face = 0; face < update.size(); ++face) {
+			if (update[face]) cullView.frusta.push_back(Meshlets::ExtractFrustum(transforms[face]));
+		}
+
 		for (const auto& entity : entities) {
 			if (entity.castShadow) {
-				glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(entity.GetLocalModelMatrix()));
-				glBindVertexArray(entity.mesh->mesh.vaoID);
-				glDrawElements(GL_TRIANGLES, entity.mesh->mesh.count, GL_UNSIGNED_INT, 0);
+				glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(entity.GetDrawMatrix()));
+				entity.Draw(cullView);
 			}
 		}
 	}
@@ -194,10 +374,10 @@ void Lights::UpdateShadowMaps(const std::vector<Entity>& entities, const Camera&
 	glUseProgram(m_DirectionalShadowShaderID);
 	const std::vector<LightInfo>& dirInfos = m_LightBuffers[DIRECTIONAL_SHADOWED_LIGHT].GetInfos();
 	for (size_t i = 0; i < dirInfos.size(); ++i) {
-		DirLightShadow<5>::IntArray update;
+		DirLightShadow<ShadowCascades>::IntArray update;
 
 		std::vector<glm::mat4> _transforms = getLightSpaceMatrices(glm::normalize(dirInfos[i].direction), camera);
-		DirLightShadow<5>::Mat4Array transforms;
+		DirLightShadow<ShadowCascades>::Mat4Array transforms;
 		for (int i = 0; i < transforms.size(); ++i) {
 			transforms[i] = _transforms[i];
 		}
@@ -205,14 +385,28 @@ void Lights::UpdateShadowMaps(const std::vector<Entity>& entities, const Camera&
 
 		dirShadows[i].bind(dirInfos[i]);
 
-		glUniform1iv(6, 5, update.data());
-		glUniformMatrix4fv(1, 5, GL_FALSE, (GLfloat*)dirShadows[i].transforms.data());
+		glUniform1iv(1 + ShadowCascades, ShadowCascades, update.data());
+		glUniformMatrix4fv(1, ShadowCascades, GL_FALSE, (GLfloat*)dirShadows[i].transforms.data());
+
+		// The light space matrices look along the negated light direction
+		Meshlets::View cullView;
+		cullView.orthographic = true;
+		cullView.direction = -glm::normalize(glm::vec3(dirInfos[i].direction));
+		cullView.lodThreshold = ShadowLodThreshold;
+		cullView.lodHysteresis = false;
+		for (size_t cascade = 0; cascade < update.size(); ++cascade) {
+			if (!update[cascade]) continue;
+			cullView.frusta.push_back(Meshlets::ExtractFrustum(dirShadows[i].transforms[cascade]));
+			// The finest updated cascade decides
+			cullView.pixelsPerUnit = std::max(cullView.pixelsPerUnit,
+				Meshlets::PixelsPerUnit(dirShadows[i].transforms[cascade], static_cast<float>(dirInfos[i].shadowMapResolutionWH[1])));
+		}
+
 		for (const auto& entity : entities) {
 			if (entity.castShadow) {
-				glm::mat4 matrix = entity.GetLocalModelMatrix();
+				glm::mat4 matrix = entity.GetDrawMatrix();
 				glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(matrix));
-				glBindVertexArray(entity.mesh->mesh.vaoID);
-				glDrawElements(GL_TRIANGLES, entity.mesh->mesh.count, GL_UNSIGNED_INT, 0);
+				entity.Draw(cullView);
 			}
 		}
 	}
@@ -221,7 +415,24 @@ void Lights::UpdateShadowMaps(const std::vector<Entity>& entities, const Camera&
 	glViewport(windowValues[0], windowValues[1], windowValues[2], windowValues[3]);
 }
 
-void Lights::renderPointLights(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer, const Camera& camera, LightType type) const {
+void Lights::UpdateClusters(const Camera& camera) {
+	if (m_PointLightMode != POINT_LIGHT_CLUSTERED) return;
+	CPU_TRACE_SCOPE("Lights::UpdateClusters");
+
+	const std::vector<LightInfo>& infos = m_LightBuffers[POINT_LIGHT].GetInfos();
+	m_ClusterSpheres.clear();
+	for (const LightInfo& info : infos) m_ClusterSpheres.emplace_back(glm::vec3(info.position), Light(info).color.w);
+
+	m_Clusters.Build(camera, m_ClusterSpheres);
+
+	const std::vector<ClusterGrid::Cell>& cells = m_Clusters.GetCells();
+	const std::vector<uint32_t>& indices = m_Clusters.GetIndices();
+	glNamedBufferData(m_ClusterCellBuffer, cells.size() * sizeof(ClusterGrid::Cell), cells.data(), GL_STREAM_DRAW);
+	// An empty buffer can't be bound as an SSBO
+	glNamedBufferData(m_ClusterIndexBuffer, std::max<size_t>(indices.size(), 1) * sizeof(uint32_t), indices.empty() ? nullptr : indices.data(), GL_STREAM_DRAW);
+}
+
+void Lights::renderPointLights(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer, LightType type) const {
 	assert(type == POINT_LIGHT || type == POINT_SHADOWED_LIGHT);
 	m_LightBuffers[type].Bind(0);
 
@@ -234,10 +445,6 @@ void Lights::renderPointLights(GLuint diffuseBuffer, GLuint normalBuffer, GLuint
 	glBindTextureUnit(2, normalBuffer);
 	glBindTextureUnit(3, depthBuffer);
 
-	glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(camera.GetViewMatrix()));
-	glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(camera.GetProj()));
-	glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(glm::inverse(camera.GetProj())));
-
 	glPatchParameteri(GL_PATCH_VERTICES, 1);
 	glDrawArraysInstanced(GL_PATCHES, 0, m_LightBuffers[type].GetSize(), 1);
 
@@ -245,7 +452,45 @@ void Lights::renderPointLights(GLuint diffuseBuffer, GLuint normalBuffer, GLuint
 	glDepthFunc(GL_LESS);
 }
 
-void Lights::renderDirectionalLights(GLuint diffuseBuffer, GLuint normalBuffer, const Camera& camera, LightType type) const {
+// Shades every pixel once with the unshadowed point lights overlapping its tile, instead of a blended volume per light
+void Lights::renderPointLightsTiled(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer) const {
+	constexpr GLuint tileSize = 16; // TILE_SIZE in deferred_point_tiled.comp
+	if (m_LightBuffers[POINT_LIGHT].GetSize() == 0) return;
+	m_LightBuffers[POINT_LIGHT].Bind(0);
+
+	glUseProgram(m_TiledPointShaderID);
+
+	glBindTextureUnit(1, diffuseBuffer);
+	glBindTextureUnit(2, normalBuffer);
+	glBindTextureUnit(3, depthBuffer);
+	glBindImageTexture(0, m_TextureID, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	glUniform1ui(1, m_LightBuffers[POINT_LIGHT].GetSize());
+
+	glDispatchCompute((m_Width + tileSize - 1) / tileSize, (m_Height + tileSize - 1) / tileSize, 1);
+	// The following passes blend into the same texture
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+// One full screen pass, every pixel only loops over the lights binned into its froxel by UpdateClusters
+void Lights::renderPointLightsClustered(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer) const {
+	if (m_LightBuffers[POINT_LIGHT].GetSize() == 0) return;
+	m_LightBuffers[POINT_LIGHT].Bind(0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_ClusterCellBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_ClusterIndexBuffer);
+
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(m_ClusteredPointShaderID);
+
+	glBindTextureUnit(1, diffuseBuffer);
+	glBindTextureUnit(2, normalBuffer);
+	glBindTextureUnit(3, depthBuffer);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void Lights::renderDirectionalLights(GLuint diffuseBuffer, GLuint normalBuffer, LightType type) const {
 	assert(type == DIRECTIONAL_LIGHT || type == DIRECTIONAL_SHADOWED_LIGHT);
 	m_LightBuffers[type].Bind(0);
 	glDisable(GL_DEPTH_TEST);
@@ -253,14 +498,12 @@ void Lights::renderDirectionalLights(GLuint diffuseBuffer, GLuint normalBuffer,
 	glUseProgram(program);
 	glBindTextureUnit(1, diffuseBuffer);
 	glBindTextureUnit(2, normalBuffer);
-	glm::mat4 matrix = glm::inverse(camera.GetViewMatrix());
-	glUniformMatrix4fv(0, 1, GL_TRUE, glm::value_ptr(matrix));
 
 	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_LightBuffers[type].GetSize());
 	glEnable(GL_DEPTH_TEST);
 }
 
-void Lights::renderPointLightsShadowed(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer, const Camera& camera) const {
+void Lights::renderPointLightsShadowed(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer) const {
 	glDepthFunc(GL_GREATER);
 	glDepthMask(GL_FALSE);
 
@@ -270,15 +513,6 @@ void Lights::renderPointLightsShadowed(GLuint diffuseBuffer, GLuint normalBuffer
 	glBindTextureUnit(2, normalBuffer);
 	glBindTextureUnit(3, depthBuffer);
 
-	glm::mat4 matrix = glm::inverse(camera.GetProj());
-	glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(matrix));
-	matrix = camera.GetViewMatrix();
-	glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(matrix));
-	matrix = camera.GetProj();
-	glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(matrix));
-	matrix = glm::inverse(camera.GetViewMatrix());
-	glUniformMatrix4fv(5, 1, GL_FALSE, glm::value_ptr(matrix));
-
 	const std::vector<LightInfo>& infos = m_LightBuffers[POINT_SHADOWED_LIGHT].GetInfos();
 	for (size_t i = 0; i < infos.size(); ++i) {
 		glBindTextureUnit(0, pointShadows[i].GetTexture());
@@ -295,23 +529,16 @@ void Lights::renderPointLightsShadowed(GLuint diffuseBuffer, GLuint normalBuffer
 void Lights::renderDirectionalLightsShadowed(GLuint diffuseBuffer, GLuint normalBuffer, GLuint depthBuffer, const Camera& camera) const {
 	glDisable(GL_DEPTH_TEST);
 
-	GLuint program = m_LightShaderIDs[DIRECTIONAL_SHADOWED_LIGHT];
+	GLuint program = m_DirectionalShadowedPrograms.Get(m_ShadowQuality);
 	glUseProgram(program);
 	glBindTextureUnit(0, diffuseBuffer);
 	glBindTextureUnit(1, normalBuffer);
 	glBindTextureUnit(2, depthBuffer);
 
-	glm::mat4 matrix = camera.GetViewMatrix();
-	glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(matrix));
-	matrix = glm::inverse(camera.GetProj());
-	glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(matrix));
-	matrix = glm::inverse(camera.GetViewMatrix());
-	glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(matrix));
-
 	const std::vector<LightInfo>& infos = m_LightBuffers[DIRECTIONAL_SHADOWED_LIGHT].GetInfos();
 	for (size_t i = 0; i < infos.size(); ++i) {
 		std::vector<glm::mat4> transforms = getLightSpaceMatrices(glm::normalize(infos[i].direction), camera);
-		glUniformMatrix4fv(5, 5, GL_FALSE, (float*)transforms.data());
+		glUniformMatrix4fv(5, ShadowCascades, GL_FALSE, (float*)transforms.data());
 		glBindTextureUnit(3, dirShadows[i].depthTexture);
 		glUniform3fv(3, 1, glm::value_ptr(infos[i].color));
 		glm::vec3 direction = glm::normalize(infos[i].direction);
@@ -328,6 +555,9 @@ void Lights::CreateFrameBuffer(GLint width, GLint height, GLuint depthTexture) {
 		glDeleteFramebuffers(1, &m_FrameBufferID);
 	}
 
+	m_Width = width;
+	m_Height = height;
+
 	glCreateFramebuffers(1, &m_FrameBufferID);
 
 	glCreateTextures(GL_TEXTURE_2D, 1, &m_TextureID);
@@ -351,8 +581,20 @@ GLuint Lights::GetLightTexture() const {
 	return m_TextureID;
 }
 
-void Lights::AddLight(LightType type, const LightInfo& info) {
-	m_LightBuffers[type].AddLight(info);
+int& Lights::GetPointLightMode() {
+	return m_PointLightMode;
+}
+
+int& Lights::GetShadowQuality() {
+	return m_ShadowQuality;
+}
+
+void Lights::FlushLights() {
+	for (LightBuffer& buffer : m_LightBuffers) buffer.Flush();
+}
+
+LightHandle Lights::AddLight(LightType type, const LightInfo& info) {
+	LightHandle handle = m_LightBuffers[type].AddLight(info);
 	switch (type)
 	{
 	case POINT_SHADOWED_LIGHT:
@@ -364,6 +606,7 @@ void Lights::AddLight(LightType type, const LightInfo& info) {
 	default:
 		break;
 	}
+	return handle;
 }
 
 void Lights::UpdateLight(LightType type, size_t index) {
@@ -383,23 +626,30 @@ void Lights::UpdateLight(LightType type, size_t index) {
 	}
 }
 
+// The shadow maps follow the swap-remove of the light buffer
 void Lights::DeleteLight(LightType type, size_t index) {
 	m_LightBuffers[type].DeleteLight(index);
 	switch (type)
 	{
 	case POINT_SHADOWED_LIGHT:
 		pointShadows[index].Clean();
-		pointShadows.erase(pointShadows.begin() + index);
+		pointShadows[index] = pointShadows.back();
+		pointShadows.pop_back();
 		break;
 	case DIRECTIONAL_SHADOWED_LIGHT:
 		dirShadows[index].Clean();
-		dirShadows.erase(dirShadows.begin() + index);
+		dirShadows[index] = dirShadows.back();
+		dirShadows.pop_back();
 		break;
 	default:
 		break;
 	}
 }
 
+void Lights::DeleteLight(LightType type, LightHandle handle) {
+	DeleteLight(type, m_LightBuffers[type].GetIndex(handle));
+}
+
 void Lights::ChangeShadowed(LightType type, size_t index) {
 	LightInfo current = m_LightBuffers[type].GetInfos()[index];
 	DeleteLight(type, index);
@@ -496,6 +746,7 @@ glm::mat4 Lights::getLightSpaceMatrix(const float nearPlane, const float farPlan
 }
 
 std::vector<glm::mat4> Lights::getLightSpaceMatrices(const glm::vec3& lightDir, const Camera& camera) const {
+	CPU_TRACE_SCOPE("Lights::getLightSpaceMatrices");
 	std::vector<glm::mat4> ret;
 	for (size_t i = 0; i < shadowCascadeLevels.size() + 1; ++i)
 	{
@@ -513,4 +764,13 @@ std::vector<glm::mat4> Lights::getLightSpaceMatrices(const glm::vec3& lightDir,
 		}
 	}
 	return ret;
+}
+
+std::string Lights::getCascadeDistances() const {
+	std::string distances = "float[](";
+	for (size_t i = 0; i < shadowCascadeLevels.size(); ++i) {
+		if (i > 0) distances += ", ";
+		distances += std::to_string(shadowCascadeLevels[i]);
+	}
+	return distances + ")";
 }
\ No newline at end of file
@@ -2,9 +2,13 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <array>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "Camera.h"
 #include "Entity.h"
+#include "Clusters.h"
+#include "ProgramPermutations.h"
 
 template<int>
 class DirLightShadow;
@@ -18,6 +22,19 @@ enum LightType {
 	DIRECTIONAL_SHADOWED_LIGHT = 3
 };
 
+// The PCF radius of the directional shadows, in texels
+enum ShadowQuality {
+	SHADOW_HARD = 0,
+	SHADOW_PCF_3X3 = 1,
+	SHADOW_PCF_5X5 = 2
+};
+
+enum PointLightMode {
+	POINT_LIGHT_VOLUME = 0,
+	POINT_LIGHT_TILED = 1,
+	POINT_LIGHT_CLUSTERED = 2
+};
+
 struct LightInfo {
 	glm::vec3 color = glm::vec3(0, 0, 0);
 	union {
@@ -32,18 +49,66 @@ struct LightInfo {
 	LightInfo() = default;
 };
 
+// GPU side layout of a light in the SSBOs
+struct Light {
+	glm::vec4 color;
+	glm::vec4 positionDirection;
+
+	Light(const LightInfo&);
+	Light() = default;
+};
+
+// Stays valid until the light is deleted, unlike the index which changes on swap-remove
+struct LightHandle {
+	uint32_t id = UINT32_MAX;
+};
+
 class LightBuffer {
 	std::vector<LightInfo> m_LightInfos;
+	std::vector<Light> m_Lights; // CPU copy, used when the buffer has to grow
+	std::vector<uint32_t> m_IndexToHandle;
+	std::vector<uint32_t> m_HandleToIndex;
+	std::vector<uint32_t> m_FreeHandles;
+
+	// The GPU may still read the region of the last frames, so the buffer holds RegionCount copies of the lights
+	// and Flush writes the next one after the fence of its last frame has signaled
+	static constexpr size_t RegionCount = 3;
+	struct Region {
+		size_t dirtyFrom = SIZE_MAX; // The lights edited since the region was last written
+		size_t dirtyTo = 0;
+		GLsync fence = nullptr;
+	};
+
 	GLuint m_Buffer = 0;
+	Light* m_Mapped = nullptr;
+	size_t m_Capacity = 0;
+	GLsizeiptr m_RegionSize = 0; // In bytes, aligned for glBindBufferRange
+	std::array<Region, RegionCount> m_Regions;
+	size_t m_Region = 0;
+
+	void reserve(size_t);
+	void write(size_t);
+	void deleteFences();
 public:
 	LightBuffer();
 	~LightBuffer();
+	LightBuffer(const LightBuffer&) = delete;
+	LightBuffer& operator=(const LightBuffer&) = delete;
 
+	// The region of the current frame
 	void Bind(GLuint) const;
-	// Doesn't happen often, so the implementation can be less then ideal
-	void AddLight(const LightInfo&);
+	// Writes the edits since the last call into the next region, once per frame before the buffer is used.
+	// Waits if the GPU still reads that region
+	void Flush();
+
+	LightHandle AddLight(const LightInfo&);
 	void UpdateLight(size_t);
+	// Swap-remove, the last light takes the place of the deleted one
 	void DeleteLight(size_t);
+	size_t GetIndex(LightHandle) const;
+
+	// Logs add/update/remove throughput at 1k, 10k and 100k lights
+	static void Benchmark();
 
 	std::vector<LightInfo>& GetInfos();
 	const std::vector<LightInfo>& GetInfos() const;
@@ -51,41 +116,65 @@ public:
 };
 
 class Lights {
+	static constexpr int ShadowCascades = 5;
+
 	GLuint m_FrameBufferID = 0;
 	GLuint m_TextureID = 0;
+	GLint m_Width = 0;
+	GLint m_Height = 0;
 
-	std::array<GLuint, 4> m_LightShaderIDs = {};
+	std::array<GLuint, 4> m_LightShaderIDs = {}; // But DIRECTIONAL_SHADOWED_LIGHT, that one has a variant per ShadowQuality
+	mutable ProgramPermutations m_DirectionalShadowedPrograms;
+	int m_ShadowQuality = SHADOW_PCF_3X3;
 	GLuint m_PointShadowShaderID = 0;
 	GLuint m_DirectionalShadowShaderID = 0;
+	GLuint m_TiledPointShaderID = 0;
+	GLuint m_ClusteredPointShaderID = 0;
+	int m_PointLightMode = POINT_LIGHT_VOLUME;
+
+	ClusterGrid m_Clusters;
+	std::vector<glm::vec4> m_ClusterSpheres;
+	GLuint m_ClusterCellBuffer = 0;
+	GLuint m_ClusterIndexBuffer = 0;
 
 	std::array<LightBuffer, 4> m_LightBuffers;
-	std::vector<DirLightShadow<5>> dirShadows;
+	std::vector<DirLightShadow<ShadowCascades>> dirShadows;
 	std::vector<PointLightShadow> pointShadows;
 
-	std::array<float, 4> shadowCascadeLevels;
+	std::array<float, ShadowCascades - 1> shadowCascadeLevels;
 
-	void renderPointLights(GLuint, GLuint, GLuint, const Camera&, LightType) const;
-	void renderDirectionalLights(GLuint, GLuint, const Camera&, LightType) const;
-	void renderPointLightsShadowed(GLuint, GLuint, GLuint, const Camera&) const;
+	void renderPointLights(GLuint, GLuint, GLuint, LightType) const;
+	void renderPointLightsTiled(GLuint, GLuint, GLuint) const;
+	void renderPointLightsClustered(GLuint, GLuint, GLuint) const;
+	void renderDirectionalLights(GLuint, GLuint, LightType) const;
+	void renderPointLightsShadowed(GLuint, GLuint, GLuint) const;
 	void renderDirectionalLightsShadowed(GLuint, GLuint, GLuint, const Camera&) const;
 	
 	std::vector<glm::vec4> getFrustumCornersWorldSpace(const glm::mat4&) const;
 	glm::mat4 getLightSpaceMatrix(const float, const float, const glm::vec3&, const Camera&) const;
 	std::vector<glm::mat4> getLightSpaceMatrices(const glm::vec3&, const Camera&) const;
+	// The far planes of the cascades as a GLSL array, for the shader defines
+	std::string getCascadeDistances() const;
 public:
 	Lights();
 	~Lights();
 
+	// The camera matrices come from the FrameConstants, the camera is for the shadow cascades
 	void RenderLights(GLuint, GLuint, GLuint, const Camera&) const;
 	void UpdateShadowMaps(const std::vector<Entity>&, const Camera&);
+	void UpdateClusters(const Camera&);
 
 	void CreateFrameBuffer(GLint, GLint, GLuint);
 	GLuint GetLightTexture() const;
+	int& GetPointLightMode();
+	int& GetShadowQuality();
 	std::vector<LightInfo>& GetInfo(LightType);
 
-	void AddLight(LightType, const LightInfo& = {});
+	void FlushLights();
+	LightHandle AddLight(LightType, const LightInfo& = {});
 	void UpdateLight(LightType, size_t);
 	void DeleteLight(LightType, size_t);
+	void DeleteLight(LightType, LightHandle);
 
 	void ChangeShadowed(LightType, size_t);
 };
\ No newline at end of file
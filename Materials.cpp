@@ -0,0 +1,108 @@
+#include "Materials.h"
+#include <SDL2/SDL_log.h>
+#include <algorithm>
+
+// Gray, like the texel of the textures that are still loading
+static constexpr uint32_t PlaceholderTexel = 0xFF808080;
+// Layers of a new array, it doubles when it is full
+static constexpr GLsizei InitialLayers = 4;
+
+Materials::~Materials() {
+	Clean();
+}
+
+void Materials::Init() {
+	TextureArray placeholder;
+	placeholder.width = placeholder.height = placeholder.levels = 1;
+	placeholder.layers = 1;
+	grow(placeholder, 1);
+	glTextureSubImage3D(placeholder.texture, 0, 0, 0, 0, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &PlaceholderTexel);
+	m_Arrays.push_back(placeholder);
+}
+
+void Materials::Clean() {
+	for (TextureArray& array : m_Arrays) glDeleteTextures(1, &array.texture);
+	m_Arrays.clear();
+	m_Materials.clear();
+	if (m_Buffer) glDeleteBuffers(1, &m_Buffer);
+	m_Buffer = 0;
+	m_BufferCapacity = 0;
+}
+
+uint32_t Materials::Create() {
+	m_Materials.emplace_back();
+	const uint32_t material = static_cast<uint32_t>(m_Materials.size() - 1);
+	write(material);
+	return material;
+}
+
+MaterialLayer Materials::Allocate(uint32_t material, GLsizei width, GLsizei height, GLsizei levels, GLenum format) {
+	auto found = std::find_if(m_Arrays.begin() + 1, m_Arrays.end(), [&](const TextureArray& array) {
+		return array.width == width && array.height == height && array.levels == levels && array.format == format;
+	});
+	if (found == m_Arrays.end()) {
+		if (m_Arrays.size() == MaxArrays) {
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR, SDL_LOG_PRIORITY_ERROR, "[Materials] No texture array left for %dx%d textures, the material keeps its placeholder", width, height);
+			return {};
+		}
+		TextureArray array;
+		array.width = width;
+		array.height = height;
+		array.levels = levels;
+		array.format = format;
+		m_Arrays.push_back(array);
+		found = m_Arrays.end() - 1;
+	}
+
+	TextureArray& array = *found;
+	if (array.layers == array.capacity) grow(array, std::max(InitialLayers, array.capacity * 2));
+
+	m_Materials[material] = { static_cast<uint32_t>(found - m_Arrays.begin()), static_cast<uint32_t>(array.layers) };
+	write(material);
+	return { array.texture, array.layers++ };
+}
+
+void Materials::grow(TextureArray& array, GLsizei capacity) {
+	GLuint texture;
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+	glTextureStorage3D(texture, array.levels, array.format, array.width, array.height, capacity);
+	glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, array.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// Immutable storage can't be resized, the layers so far are copied on the GPU
+	if (array.texture) {
+		for (GLint level = 0; level < array.levels; ++level) {
+			glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+				std::max(1, array.width >> level), std::max(1, array.height >> level), array.layers);
+		}
+		glDeleteTextures(1, &array.texture);
+	}
+	array.texture = texture;
+	array.capacity = capacity;
+}
+
+void Materials::write(uint32_t material) {
+	if (m_Materials.size() > m_BufferCapacity) {
+		if (m_Buffer) glDeleteBuffers(1, &m_Buffer);
+		m_BufferCapacity = std::max<size_t>(64, m_BufferCapacity * 2);
+		glCreateBuffers(1, &m_Buffer);
+		glNamedBufferStorage(m_Buffer, m_BufferCapacity * sizeof(GPUMaterial), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glNamedBufferSubData(m_Buffer, 0, m_Materials.size() * sizeof(GPUMaterial), m_Materials.data());
+		return;
+	}
+	glNamedBufferSubData(m_Buffer, material * sizeof(GPUMaterial), sizeof(GPUMaterial), &m_Materials[material]);
+}
+
+void Materials::Bind() const {
+	// The units without an array get the placeholder, every element of the sampler array stays complete
+	GLuint textures[MaxArrays];
+	for (GLuint i = 0; i < MaxArrays; ++i) textures[i] = m_Arrays[i < m_Arrays.size() ? i : 0].texture;
+	glBindTextures(0, MaxArrays, textures);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, StorageBinding, m_Buffer);
+}
+
+void Materials::SetIndex(uint32_t material) {
+	glUniform1ui(IndexLocation, material);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where the texture of a material ended up: a layer of one of the arrays
+struct MaterialLayer {
+	GLuint texture = 0;
+	GLint layer = 0;
+};
+
+// The textures of the materials live in GL_TEXTURE_2D_ARRAYs, one array per size, format and level count,
+// and the material index of an entity selects the array and the layer through an SSBO. A pass binds every array
+// and the buffer once, a draw only sets the index, so the draw order doesn't have to follow the textures.
+// Materials without a texture (yet) sample the placeholder array.
+class Materials {
+public:
+	// The sampler array of the shaders, the texture units from 0 and the binding of the SSBO
+	static constexpr GLuint MaxArrays = 8;
+	static constexpr GLuint StorageBinding = 3;
+	// Of the uint uniform with the material index
+	static constexpr GLint IndexLocation = 16;
+
+	Materials() = default;
+	~Materials();
+	Materials(const Materials&) = delete;
+	Materials& operator=(const Materials&) = delete;
+
+	void Init();
+	void Clean();
+
+	// A new material drawn with the placeholder until a texture is allocated for it
+	uint32_t Create();
+	// A layer for the texture of the material in the array of its size and format, the array grows if it is full.
+	// The caller uploads every level into the layer. A texture of 0 if there is no array left for a new size
+	MaterialLayer Allocate(uint32_t material, GLsizei width, GLsizei height, GLsizei levels, GLenum format);
+
+	// The arrays to the texture units 0..MaxArrays-1 and the buffer. Before the passes that sample the materials
+	void Bind() const;
+	static void SetIndex(uint32_t material);
+
+private:
+	struct TextureArray {
+		GLuint texture = 0;
+		GLsizei width = 0;
+		GLsizei height = 0;
+		GLsizei levels = 0;
+		GLenum format = GL_RGBA8;
+		GLsizei layers = 0;
+		GLsizei capacity = 0;
+	};
+
+	// GPU side layout of a material in the SSBO
+	struct GPUMaterial {
+		uint32_t array = 0;
+		uint32_t layer = 0;
+	};
+
+	std::vector<TextureArray> m_Arrays; // The first one is the placeholder
+	std::vector<GPUMaterial> m_Materials; // CPU copy, used when the buffer has to grow
+	GLuint m_Buffer = 0;
+	size_t m_BufferCapacity = 0;
+
+	void grow(TextureArray&, GLsizei capacity);
+	void write(uint32_t material);
+};
@@ -1,8 +1,16 @@
 #pragma once
 #include <GLUtils.hpp>
 #include <GL/glew.h>
+#include <Meshlets.h>
+#include <MeshSimplifier.h>
+#include <vector>
 
 struct Mesh {
 	OGLObject mesh;
-	glm::vec3 center;
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+	Meshlets::MeshletSet meshlets; // Empty if the mesh is drawn in one piece
+	std::vector<MeshLod> lods; // Finest first, mesh.count is the full level. Empty if there is only that
+	glm::mat4 dequantize = glm::mat4(1.0f); // Maps the stored vertex positions to the mesh's own space
+	const Mesh* placeholder = nullptr; // Drawn instead while the mesh is still loading
 };
\ No newline at end of file
@@ -3,11 +3,20 @@
 #include "ParametricSurfaceMesh.hpp"
 #include "ProgramBuilder.h"
 #include "ObjParser.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlets.h"
+#include "VertexQuantization.h"
 #include "Logs.h"
+#include "CPUTrace.h"
+
+#include <glm/gtc/constants.hpp>
 
 #include <imgui.h>
 #include <iostream>
 #include <array>
+#include <cmath>
 
 class BezierSurface {
 	const std::array<glm::vec3, 16> controllPoints = {
@@ -86,6 +95,24 @@ public:
 	}
 };
 
+// Low poly sphere for the placeholder mesh
+class UnitSphere {
+public:
+	glm::vec3 GetPos(float u, float v) const {
+		float theta = u * glm::two_pi<float>();
+		float phi = v * glm::pi<float>();
+		return { std::sin(phi) * std::cos(theta), std::cos(phi), -std::sin(phi) * std::sin(theta) };
+	}
+
+	glm::vec3 GetNorm(float u, float v) const {
+		return GetPos(u, v);
+	}
+
+	glm::vec2 GetTex(float u, float v) const {
+		return { u, v };
+	}
+};
+
 CMyApp::CMyApp()
 {
 }
@@ -109,28 +136,28 @@ void CMyApp::SetupDebugCallback()
 
 void CMyApp::InitEntities() {
 	BezierSurface surface;
-	m_entities.emplace_back(&m_surface, m_grassTextureID, glm::vec3(0.f), glm::vec3(0.f), glm::vec3(1.f)).castShadow = false;
+	m_entities.emplace_back(&m_surface, m_grassMaterial, glm::vec3(0.f), glm::vec3(0.f), glm::vec3(1.f)).castShadow = false;
 
 	for (int i = -1; i <= 1; ++i)
 		for (int j = -1; j <= 1; ++j)
 		{
 			if ((i + j) % 2 == 0) {
-				m_entities.emplace_back(&m_suzanne, m_metalTextureID, glm::vec3(50 + 4 * i, 4 * (j + 1) + surface.getHeight(50, -80) + 5.f, -80), glm::vec3(0.f), glm::vec3(1.f));
+				m_entities.emplace_back(&m_suzanne, m_metalMaterial, glm::vec3(50 + 4 * i, 4 * (j + 1) + surface.getHeight(50, -80) + 5.f, -80), glm::vec3(0.f), glm::vec3(1.f));
 			} else {
-				m_entities.emplace_back(&m_sphere, m_grassTextureID, glm::vec3(50 + 4 * i, 4 * (j + 1) + surface.getHeight(50, -80) + 5.f, -80), glm::vec3(0.f), glm::vec3(1.f));
+				m_entities.emplace_back(&m_sphere, m_grassMaterial, glm::vec3(50 + 4 * i, 4 * (j + 1) + surface.getHeight(50, -80) + 5.f, -80), glm::vec3(0.f), glm::vec3(1.f));
 			}
 		}
 
 	const float x[5] = { -180.f, -80.f, -150.f, -30.f, -164.f };
 	const float z[5] = { -180.f, -30.f, -90.f, -100.f, -54.f };
 	for (int i = 0; i < 5; ++i)
-		m_entities.emplace_back(&m_tree, m_treeTextureID, glm::vec3(x[i], surface.getHeight(x[i], z[i]), z[i]) - 0.2f, glm::vec3(0, x[i], 0), glm::vec3(1));
+		m_entities.emplace_back(&m_tree, m_treeMaterial, glm::vec3(x[i], surface.getHeight(x[i], z[i]), z[i]) - 0.2f, glm::vec3(0, x[i], 0), glm::vec3(1));
 
-	m_entities.emplace_back(&m_cube, m_metalTextureID, glm::vec3(50, surface.getHeight(50, -80) + 1.f, -80), glm::vec3(0.f), glm::vec3(20, 2, 20));
+	m_entities.emplace_back(&m_cube, m_metalMaterial, glm::vec3(50, surface.getHeight(50, -80) + 1.f, -80), glm::vec3(0.f), glm::vec3(20, 2, 20));
 
 
-	m_entities.emplace_back(&m_cube, m_metalTextureID, glm::vec3(0, surface.getHeight(0, 10.0f) + 6.f, 0), glm::vec3(0), glm::vec3(3));
-	m_entities.emplace_back(&m_cube, m_metalTextureID, glm::vec3(0, surface.getHeight(0, 12.5f) + 6.f, 12.5f), glm::vec3(0), glm::vec3(1));
+	m_entities.emplace_back(&m_cube, m_metalMaterial, glm::vec3(0, surface.getHeight(0, 10.0f) + 6.f, 0), glm::vec3(0), glm::vec3(3));
+	m_entities.emplace_back(&m_cube, m_metalMaterial, glm::vec3(0, surface.getHeight(0, 12.5f) + 6.f, 12.5f), glm::vec3(0), glm::vec3(1));
 
 	m_entities[m_entities.size() - 1].SetGenerateReflection(true);
 	m_entities[m_entities.size() - 2].SetGenerateReflection(true);
@@ -197,41 +224,150 @@ void CMyApp::CleanSkyboxShaders()
 	glDeleteProgram(m_programSkyboxID);
 }
 
-void getBoundingSphere(const MeshObject<Vertex>& meshData, Mesh& mesh) {
-	glm::vec3 center = glm::vec3(0, 0, 0);
-	for (const Vertex& vertex : meshData.vertexArray) {
-		center += vertex.position;
+// Reorder the meshes for the post-transform cache, overdraw and vertex fetch. Every pass benefits, the shadow passes the most
+static constexpr bool OptimizeMeshes = true;
+
+// Converts the parser output to the scene vertex format, the bounds are the ones of the original mesh
+static MeshObject<SceneVertex> ToSceneMesh(MeshObject<Vertex>&& meshCPU, const MeshCache::Bounds& bounds)
+{
+#if QUANTIZED_VERTEX
+	return VertexQuantization::QuantizeMesh(meshCPU, bounds.min, bounds.max);
+#else
+	return std::move(meshCPU);
+#endif
+}
+
+static void SetBounds(Mesh& mesh, const MeshCache::Bounds& bounds)
+{
+	mesh.center = bounds.center;
+	mesh.radius = bounds.radius;
+#if QUANTIZED_VERTEX
+	mesh.dequantize = VertexQuantization::DequantizeMatrix(bounds.min, bounds.max);
+#endif
+}
+
+// Split the meshes into meshlets that are culled one by one against the view and shadow frusta
+static constexpr bool UseMeshlets = true;
+// Simplified levels of detail, picked by their projected error in each view
+static constexpr bool UseLods = true;
+
+// Appends the coarser levels of detail to the index array, empty if they are disabled
+static std::vector<MeshLod> BuildLods(MeshObject<Vertex>& meshCPU)
+{
+	if (!UseLods) return {};
+
+	std::vector<glm::vec3> positions(meshCPU.vertexArray.size());
+	for (size_t i = 0; i < positions.size(); ++i) positions[i] = meshCPU.vertexArray[i].position;
+	return MeshSimplifier::BuildLodChain(positions, meshCPU.indexArray);
+}
+
+// Packs the buffers for the upload and builds the meshlets, on a loader worker. The bounds are the ones of the original mesh.
+// The index array holds every level of detail, the meshlets are only built for the full one, unless cached ones fit the buffer
+static AssetLoader::PreparedMesh PrepareSceneMesh(const SceneVertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, const MeshCache::Bounds& bounds, std::vector<MeshLod> lods,
+	Meshlets::MeshletSet cachedMeshlets = {})
+{
+	AssetLoader::PreparedMesh prepared;
+	Mesh& mesh = prepared.mesh;
+	SetBounds(mesh, bounds);
+
+	const uint8_t* vertexBytes = reinterpret_cast<const uint8_t*>(vertices);
+	prepared.vertexSize = sizeof(SceneVertex);
+	prepared.vertexData.assign(vertexBytes, vertexBytes + vertexCount * sizeof(SceneVertex));
+
+	std::vector<GLushort> indices16 = PackIndices(mesh.mesh, indices, indexCount, vertexCount);
+	const uint8_t* indexBytes = indices16.empty() ? reinterpret_cast<const uint8_t*>(indices) : reinterpret_cast<const uint8_t*>(indices16.data());
+	prepared.indexData.assign(indexBytes, indexBytes + indexCount * IndexSize(mesh.mesh));
+
+	mesh.lods = std::move(lods);
+	if (!mesh.lods.empty()) mesh.mesh.count = static_cast<GLsizei>(mesh.lods[0].indexCount);
+	if (!UseMeshlets) return prepared;
+	if (cachedMeshlets.size() != 0 && Meshlets::Matches(cachedMeshlets, mesh.mesh.count, mesh.mesh))
+	{
+		mesh.meshlets = std::move(cachedMeshlets);
+		return prepared;
 	}
-	mesh.center = center / static_cast<float>(meshData.vertexArray.size());
+
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+#if QUANTIZED_VERTEX
+		glm::vec3 stored = glm::vec3(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]) / 65535.0f;
+		positions[i] = glm::vec3(mesh.dequantize * glm::vec4(stored, 1.0f));
+#else
+		positions[i] = vertices[i].position;
+#endif
+	}
+	mesh.meshlets = Meshlets::Build(positions, indices, mesh.mesh.count, mesh.mesh);
+	return prepared;
+}
+
+// Optimizes the mesh, builds its levels of detail and converts it to the scene vertex format
+static AssetLoader::PreparedMesh PrepareGeneratedMesh(MeshObject<Vertex>&& meshCPU, const char* name)
+{
+	if (OptimizeMeshes) MeshOptimizer::Optimize(meshCPU, name);
+	MeshCache::Bounds bounds = MeshCache::ComputeBounds(meshCPU);
+	std::vector<MeshLod> lods = BuildLods(meshCPU);
+	MeshObject<SceneVertex> sceneMesh = ToSceneMesh(std::move(meshCPU), bounds);
+	return PrepareSceneMesh(sceneMesh.vertexArray.data(), sceneMesh.vertexArray.size(), sceneMesh.indexArray.data(), sceneMesh.indexArray.size(), bounds, std::move(lods));
+}
+
+// Uses the binary cache next to the OBJ when it is up to date, otherwise parses and (re)writes it
+static AssetLoader::PreparedMesh PrepareObjMesh(const std::filesystem::path& fileName)
+{
+	const uint32_t cacheFlags = (OptimizeMeshes ? MeshCache::Optimized : 0) | (QUANTIZED_VERTEX ? MeshCache::Quantized : 0) | (UseLods ? MeshCache::Lods : 0)
+		| (UseMeshlets ? MeshCache::Meshlets : 0);
+
+	MeshCache::View cached;
+	if (MeshCache::Load(fileName, cached, sizeof(SceneVertex), cacheFlags))
+	{
+		std::vector<MeshLod> lods(cached.header->lods, cached.header->lods + cached.header->lodCount);
+		return PrepareSceneMesh(static_cast<const SceneVertex*>(cached.vertices), cached.header->vertexCount, cached.indices, cached.header->indexCount, cached.header->bounds, std::move(lods),
+			MeshCache::LoadMeshlets(cached));
+	}
+
+	MeshObject<Vertex> meshCPU = ObjParser::parse(fileName, 0);
+	if (OptimizeMeshes) MeshOptimizer::Optimize(meshCPU, fileName.string().c_str());
+	MeshCache::Bounds bounds = MeshCache::ComputeBounds(meshCPU);
+	std::vector<MeshLod> lods = BuildLods(meshCPU);
+	MeshObject<SceneVertex> sceneMesh = ToSceneMesh(std::move(meshCPU), bounds);
+
+	// Stored after the preparation, so that the meshlets go into the cache too
+	AssetLoader::PreparedMesh prepared = PrepareSceneMesh(sceneMesh.vertexArray.data(), sceneMesh.vertexArray.size(), sceneMesh.indexArray.data(), sceneMesh.indexArray.size(), bounds, lods);
+	if (!MeshCache::Store(fileName, sceneMesh, bounds, lods, prepared.mesh.meshlets, cacheFlags))
+		SDL_LogMessage(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_WARN, "[MeshCache] Could not write the cache of %s", fileName.string().c_str());
+	return prepared;
 }
 
 void CMyApp::InitGeometry()
 {
-	const std::initializer_list<VertexAttributeDescriptor> vertexAttribList =
+#if QUANTIZED_VERTEX
+	const std::vector<VertexAttributeDescriptor> vertexAttribList =
+	{
+		{ 0, offsetof(VertexQuantized, position), 3, GL_UNSIGNED_SHORT, GL_TRUE },
+		{ 1, offsetof(VertexQuantized, normal),   2, GL_SHORT,          GL_TRUE },
+		{ 2, offsetof(VertexQuantized, texcoord), 2, GL_HALF_FLOAT },
+	};
+#else
+	const std::vector<VertexAttributeDescriptor> vertexAttribList =
 	{
 		{ 0, offsetof(Vertex, position), 3, GL_FLOAT },
 		{ 1, offsetof(Vertex, normal),   3, GL_FLOAT },
 		{ 2, offsetof(Vertex, texcoord), 2, GL_FLOAT },
 	};
+#endif
 
-	MeshObject<Vertex> suzanneMeshCPU = ObjParser::parse("Assets/Suzanne.obj");
-	m_suzanne.mesh = CreateGLObjectFromMesh(suzanneMeshCPU, vertexAttribList);
-	getBoundingSphere(suzanneMeshCPU, m_suzanne);
-
-	MeshObject<Vertex> sphereMeshCPU = ObjParser::parse("Assets/sphere.obj");
-	m_sphere.mesh = CreateGLObjectFromMesh(sphereMeshCPU, vertexAttribList);
-	getBoundingSphere(sphereMeshCPU, m_sphere);
+	// Drawn while the meshes are loading, small enough to build right here
+	AssetLoader::CreateMesh(PrepareGeneratedMesh(GetParamSurfMesh(UnitSphere{}, 16, 8), "Placeholder"), m_placeholder, vertexAttribList);
 
-	MeshObject<Vertex> cubeMeshCPU = ObjParser::parse("Assets/cube.obj");
-	m_cube.mesh = CreateGLObjectFromMesh(cubeMeshCPU, vertexAttribList);
-	getBoundingSphere(cubeMeshCPU, m_cube);
+	// The ground is needed for the first frame
+	m_assetLoader.LoadMesh(m_surface, &m_placeholder, "Bezier surface",
+		[]() { return PrepareGeneratedMesh(GetParamSurfMesh(BezierSurface{}, 100, 100), "Bezier surface"); }, vertexAttribList, true);
 
-	MeshObject<Vertex> treeMeshCPU = ObjParser::parse("Assets/tree2.obj");
-	m_tree.mesh = CreateGLObjectFromMesh(treeMeshCPU, vertexAttribList);
-	getBoundingSphere(treeMeshCPU, m_tree);
-
-	MeshObject<Vertex> surfaceMeshCPU = GetParamSurfMesh(BezierSurface{}, 100, 100);
-	m_surface.mesh = CreateGLObjectFromMesh(surfaceMeshCPU, vertexAttribList);
+	for (auto [mesh, fileName] : { std::pair<Mesh*, const char*>{ &m_suzanne, "Assets/Suzanne.obj" }, { &m_sphere, "Assets/sphere.obj" },
+		{ &m_cube, "Assets/cube.obj" }, { &m_tree, "Assets/tree2.obj" } })
+	{
+		m_assetLoader.LoadMesh(*mesh, &m_placeholder, fileName, [fileName = std::filesystem::path(fileName)]() { return PrepareObjMesh(fileName); }, vertexAttribList);
+	}
 
 	InitSkyboxGeometry();
 }
@@ -243,6 +379,7 @@ void CMyApp::CleanGeometry()
 	CleanOGLObject(m_cube.mesh);
 	CleanOGLObject(m_tree.mesh);
 	CleanOGLObject(m_surface.mesh);
+	CleanOGLObject(m_placeholder.mesh);
 	CleanSkyboxGeometry();
 }
 
@@ -295,15 +432,19 @@ void CMyApp::CleanSkyboxGeometry()
 	CleanOGLObject(m_skybox);
 }
 
+// Block compress the textures (BC1/BC3 with the mip chain, cached next to the images): a quarter or an eighth of the memory and the sampling bandwidth
+static constexpr bool CompressTextures = true;
+
 void CMyApp::InitTextures()
 {
 	std::vector<const char*> paths = {"Assets/metal.png", "Assets/grass.png", "Assets/tree.bmp"};
-	std::vector<GLuint*> locations = { &m_metalTextureID, &m_grassTextureID, &m_treeTextureID };
+	std::vector<uint32_t*> materials = { &m_metalMaterial, &m_grassMaterial, &m_treeMaterial };
 
+	m_materials.Init();
 	for (size_t i = 0; i < paths.size(); ++i) {
-		glGenTextures(1, locations[i]);
-		TextureFromFile(*locations[i], paths[i]);
-		SetupTextureSampling(GL_TEXTURE_2D, *locations[i]);
+		*materials[i] = m_materials.Create();
+		// The ground's texture is needed for the first frame
+		m_assetLoader.LoadMaterialTexture(m_materials, *materials[i], paths[i], materials[i] == &m_grassMaterial, CompressTextures);
 	}
 
 	InitSkyboxTextures();
@@ -311,8 +452,7 @@ void CMyApp::InitTextures()
 
 void CMyApp::CleanTextures()
 {
-	std::vector<GLuint*> locations = { &m_metalTextureID, &m_grassTextureID, &m_treeTextureID };
-	for (GLuint* currentTexture : locations) glDeleteTextures(1, currentTexture);
+	m_materials.Clean();
 	CleanSkyboxTextures();
 }
 
@@ -320,13 +460,9 @@ void CMyApp::InitSkyboxTextures()
 {
 	glGenTextures(1, &m_skyboxTextureID);
 
-	std::array<std::filesystem::path, 6> paths{ "Assets/xpos.png", "Assets/xneg.png", "Assets/ypos.png", "Assets/yneg.png", "Assets/zpos.png", "Assets/zneg.png" };
-	for (Uint32 i = 0; i < paths.size(); ++i)
-	{
-		TextureFromFile(m_skyboxTextureID, paths[i], GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
-	}
-
-	SetupTextureSampling(GL_TEXTURE_CUBE_MAP, m_skyboxTextureID, false);
+	// The faces and their mip chains are built in parallel on the loader's workers
+	m_assetLoader.LoadTexture(m_skyboxTextureID, GL_TEXTURE_CUBE_MAP,
+		{ "Assets/xpos.png", "Assets/xneg.png", "Assets/ypos.png", "Assets/yneg.png", "Assets/zpos.png", "Assets/zneg.png" }, true, false, CompressTextures);
 
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 }
@@ -338,6 +474,7 @@ void CMyApp::CleanSkyboxTextures()
 
 bool CMyApp::Init()
 {
+	CPU_TRACE_SCOPE("CMyApp::Init");
 	SetupDebugCallback();
 
 	glClearColor(0.125f, 0.25f, 0.5f, 0.0f);
@@ -346,6 +483,8 @@ bool CMyApp::Init()
 	InitGeometry();
 	InitTextures();
 	InitEntities();
+	// The rest streams in over the next frames
+	m_assetLoader.WaitForCritical();
 
 	//
 	// Other
@@ -367,6 +506,8 @@ bool CMyApp::Init()
 
 void CMyApp::Clean()
 {
+	m_assetLoader.Clean();
+	ProgramBuilder::WaitForAll();
 	CleanShaders();
 	CleanGeometry();
 	CleanTextures();
@@ -374,9 +515,17 @@ void CMyApp::Clean()
 
 void CMyApp::Update(const SUpdateInfo& updateInfo)
 {
+	CPU_TRACE_SCOPE("CMyApp::Update");
+	m_assetLoader.Update();
 	m_cameraManipulator.Update(updateInfo.DeltaTimeInSec);
 }
 
+void CMyApp::WaitForAssets()
+{
+	ProgramBuilder::WaitForAll();
+	m_assetLoader.WaitForAll();
+}
+
 void CMyApp::DrawAxes()
 {
 	// We always want to see it, regardless of whether there is an object in front of it
@@ -406,8 +555,7 @@ void CMyApp::DrawSkybox()
 
 	glDepthFunc(GL_LEQUAL);
 
-	glBindVertexArray(m_skybox.vaoID);
-	glDrawElements(GL_TRIANGLES, m_skybox.count, GL_UNSIGNED_INT, nullptr);
+	DrawOGLObject(m_skybox);
 
 	glDepthFunc(prevDepthFnc);
 
@@ -417,28 +565,61 @@ void CMyApp::DrawSkybox()
 
 void CMyApp::Render()
 {
+	CPU_TRACE_SCOPE("CMyApp::Render");
+	// The shaders of the startup batch are still compiling, only the background until then
+	if (!ProgramBuilder::Poll()) {
+		glBindFramebuffer(GL_FRAMEBUFFER, m_outputFrameBuffer);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		return;
+	}
+
+	m_gpuProfiler.BeginFrame();
+
 	GLint windowValues[4];
 	glGetIntegerv(GL_VIEWPORT, windowValues);
-	for (Entity& entity : m_entities) entity.Update(m_entities);
+	// The camera matrices of every pass below, the environment maps have their own
+	m_frameConstants.Update(m_camera, glm::ivec4(windowValues[0], windowValues[1], windowValues[2], windowValues[3]));
+	{
+		GPUProfiler::Scope scope(m_gpuProfiler, "Environment maps");
+		m_materials.Bind();
+		for (Entity& entity : m_entities) entity.Update(m_entities);
+	}
 	glViewport(windowValues[0], windowValues[1], windowValues[2], windowValues[3]);
 
 	// Lights
-	m_lights.UpdateShadowMaps(m_entities, m_camera);
+	m_lights.FlushLights();
+	{
+		GPUProfiler::Scope scope(m_gpuProfiler, "Shadow maps");
+		m_lights.UpdateShadowMaps(m_entities, m_camera);
+	}
+	m_lights.UpdateClusters(m_camera);
 	glUseProgram(0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFrameBuffer);
-	glStencilMask(0xFF);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-	DrawScene(m_camera.GetProj(), m_camera.GetViewMatrix(), true);
-	DrawScene(m_camera.GetProj(), m_camera.GetViewMatrix(), false);
+	{
+		GPUProfiler::Scope scope(m_gpuProfiler, "G-buffer");
+		glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFrameBuffer);
+		glStencilMask(0xFF);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		// Every texture of the scene in a single binding
+		m_materials.Bind();
+		DrawScene(true);
+		DrawScene(false);
+	}
 
-	m_lights.RenderLights(m_diffuseTextureID, m_normalTextureID, m_depthTextureID, m_camera);
+	{
+		GPUProfiler::Scope scope(m_gpuProfiler, "Lighting");
+		m_lights.RenderLights(m_diffuseTextureID, m_normalTextureID, m_depthTextureID, m_camera);
+	}
 
 	// SSAO
-	m_SSAO.RenderSSAO(m_normalTextureID, m_depthTextureID, m_camera);
+	{
+		GPUProfiler::Scope scope(m_gpuProfiler, "SSAO");
+		m_SSAO.RenderSSAO(m_normalTextureID, m_depthTextureID);
+	}
 	
 	// Draw
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GPUProfiler::Scope scope(m_gpuProfiler, "Composite");
+	glBindFramebuffer(GL_FRAMEBUFFER, m_outputFrameBuffer);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	DrawSkybox();
 
@@ -456,6 +637,7 @@ void CMyApp::Render()
 
 void CMyApp::RenderGUI()
 {
+	CPU_TRACE_SCOPE("CMyApp::RenderGUI");
 	// ImGui::ShowDemoWindow();
 
 	ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Once);
@@ -472,6 +654,7 @@ void CMyApp::RenderGUI()
 				ImGui::Image((ImTextureID)m_diffuseTextureID, ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
 				ImGui::Image((ImTextureID)m_normalTextureID, ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
 				ImGui::Image((ImTextureID)m_SSAO.GetSSAO(), ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
+				ImGui::Combo("SSAO quality", &m_SSAO.GetQuality(), "Low (16 samples)\0Medium (32 samples)\0High (64 samples)\0");
 				ImGui::EndTabItem();
 			}
 			if (ImGui::BeginTabItem("Objects"))
@@ -482,6 +665,7 @@ void CMyApp::RenderGUI()
 			if (ImGui::BeginTabItem("Lights"))
 			{
 				if (ImGui::CollapsingHeader("Point Light")) {
+					ImGui::Combo("Shading", &m_lights.GetPointLightMode(), "Light volumes\0Tiled compute\0Clustered\0");
 					if (ImGui::Button("New point light")) {
 						m_lights.AddLight(POINT_LIGHT, { {10,10,10}, { m_camera.GetEye(), 1 }, false, { 1024,1024 }
 					});
@@ -491,12 +675,22 @@ void CMyApp::RenderGUI()
 				}
 
 				if (ImGui::CollapsingHeader("Directional Light")) {
+					ImGui::Combo("Shadow filtering", &m_lights.GetShadowQuality(), "Hard\0PCF 3x3\0PCF 5x5\0");
 					if (ImGui::Button("New directional light")) {
 						m_lights.AddLight(DIRECTIONAL_LIGHT);
 					}
 					RenderLightGUI(DIRECTIONAL_LIGHT);
 					RenderLightGUI(DIRECTIONAL_SHADOWED_LIGHT);
 				}
+
+				if (ImGui::Button("Benchmark light buffer")) {
+					LightBuffer::Benchmark();
+				}
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Profiler"))
+			{
+				RenderProfilerGUI();
 				ImGui::EndTabItem();
 			}
 			ImGui::EndTabBar();
@@ -581,6 +775,35 @@ void CMyApp::RenderLightGUI(LightType type) {
 	if (shadowChange)m_lights.ChangeShadowed(type, index);
 }
 
+void CMyApp::RenderProfilerGUI() {
+	std::vector<GPUProfiler::Stats> stats = m_gpuProfiler.GetStats();
+	float total = 0.0f;
+
+	if (ImGui::BeginTable("GPU passes", 5)) {
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("Avg ms");
+		ImGui::TableSetupColumn("p50");
+		ImGui::TableSetupColumn("p95");
+		ImGui::TableSetupColumn("p99");
+		ImGui::TableHeadersRow();
+		for (const GPUProfiler::Stats& pass : stats) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(pass.name.c_str());
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", pass.average);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", pass.p50);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", pass.p95);
+			ImGui::TableNextColumn(); ImGui::Text("%.3f", pass.p99);
+			total += pass.average;
+		}
+		ImGui::EndTable();
+	}
+	ImGui::Text("Total: %.3f ms", total);
+
+	if (ImGui::Button("Export CSV")) {
+		m_gpuProfiler.WriteCSV("gpu_profile.csv");
+	}
+}
+
 GLint CMyApp::ul(const char* uniformName) noexcept
 {
 	GLuint programID = 0;
@@ -616,6 +839,10 @@ void CMyApp::KeyboardDown(const SDL_KeyboardEvent& key)
 			// https://registry.khronos.org/OpenGL-Refpages/gl4/html/glPolygonMode.xhtml
 			glPolygonMode(GL_FRONT_AND_BACK, polygonMode); // Set the new polygon mode
 		}
+		if (key.keysym.sym == SDLK_F9) // F9
+		{
+			CPUTrace::WriteJSON("cpu_trace.json");
+		}
 	}
 	m_cameraManipulator.KeyboardDown(key);
 }
@@ -657,6 +884,22 @@ void CMyApp::Resize(int _w, int _h)
 	CreateFramebuffer(_w, _h);
 }
 
+void CMyApp::SetCamera(const glm::vec3& eye, const glm::vec3& at)
+{
+	m_camera.SetView(eye, at, glm::vec3(0, 1, 0));
+	m_cameraManipulator.SetCamera(&m_camera); // Resync, Update would move the camera back otherwise
+}
+
+void CMyApp::SetOutputFramebuffer(GLuint frameBuffer)
+{
+	m_outputFrameBuffer = frameBuffer;
+}
+
+const GPUProfiler& CMyApp::GetGPUProfiler() const
+{
+	return m_gpuProfiler;
+}
+
 // Other SDL events
 // https://wiki.libsdl.org/SDL2/SDL_Event
 
@@ -664,9 +907,10 @@ void CMyApp::OtherEvent(const SDL_Event& ev)
 {
 }
 
-void CMyApp::DrawScene(const glm::mat4& proj, const glm::mat4& view, bool receiveShadow) const {
-	glm::mat4 viewProj = proj * view;
+void CMyApp::DrawScene(bool receiveShadow) const {
+	const FrameData& frame = m_frameConstants.Get();
 	glm::mat4 world;
+	const Meshlets::View cullView = Meshlets::PerspectiveView(frame.viewProj, glm::vec3(frame.invView[3]), frame.viewport.w);
 
 	if (!receiveShadow) {
 		glEnable(GL_STENCIL_TEST);
@@ -678,8 +922,8 @@ void CMyApp::DrawScene(const glm::mat4& proj, const glm::mat4& view, bool receiv
 	glUseProgram(m_programNonReflectiveID);
 	for (const Entity& entity : m_entities) {
 		if (entity.receiveShadow == receiveShadow && !entity.GetGenerateReflection()) {
-			entity.SetTexture(m_programNonReflectiveID);
-			world = entity.GetLocalModelMatrix();
+			entity.SetMaterial();
+			world = entity.GetDrawMatrix();
 
 			/*glm::mat4 matrix = viewProj * world;
 			glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(matrix));
@@ -687,43 +931,31 @@ void CMyApp::DrawScene(const glm::mat4& proj, const glm::mat4& view, bool receiv
 			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(matrix));
 			matrix = glm::transpose(glm::inverse(view * world));
 			glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(matrix));*/
+			// The view and projection are applied in the shader, from the FrameConstants
 			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(world))));
-			glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(viewProj * world));
-			glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(view * world))));
+			glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(world));
 
-			glBindVertexArray(entity.mesh->mesh.vaoID);
-			glDrawElements(GL_TRIANGLES, entity.mesh->mesh.count, GL_UNSIGNED_INT, 0);
+			entity.Draw(cullView);
 		}
 	}
 	
 	glUseProgram(m_programReflectiveID);
 	for (const Entity& entity : m_entities) {
 		if (entity.receiveShadow == receiveShadow && entity.GetGenerateReflection()) {
-			glBindTextureUnit(1, entity.environmentMap->getTexture());
-			entity.SetTexture(m_programReflectiveID);
-			world = entity.GetLocalModelMatrix();
-
-			glm::mat4 matrix = m_camera.GetViewMatrix() * world;
-			glUniformMatrix4fv(3, 1, GL_FALSE, glm::value_ptr(matrix));
-			matrix = glm::inverse(m_camera.GetViewMatrix());
-			glUniformMatrix4fv(4, 1, GL_FALSE, glm::value_ptr(matrix));
-			matrix = viewProj * world;
-			glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(matrix));
-			matrix = glm::transpose(glm::inverse(world));
-			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(matrix));
-			matrix = glm::transpose(glm::inverse(m_camera.GetViewMatrix() * world));
-			glUniformMatrix4fv(2, 1, GL_FALSE, glm::value_ptr(matrix));
+			glBindTextureUnit(Materials::MaxArrays, entity.environmentMap->getTexture());
+			entity.SetMaterial();
+			world = entity.GetDrawMatrix();
 
-			glBindVertexArray(entity.mesh->mesh.vaoID);
-			glDrawElements(GL_TRIANGLES, entity.mesh->mesh.count, GL_UNSIGNED_INT, 0);
+			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(glm::transpose(glm::inverse(world))));
+			glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(world));
+
+			entity.Draw(cullView);
 		}
 	}
 
 	if (!receiveShadow) {
 		glDisable(GL_STENCIL_TEST);
 	}
-
-	Entity::Reset();
 }
 
 void CMyApp::CreateFramebuffer(GLint width, GLint height) {
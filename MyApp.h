@@ -18,9 +18,13 @@
 #include "Camera.h"
 #include "CameraManipulator.h"
 #include "GLUtils.hpp"
+#include "GPUProfiler.h"
 
+#include "AssetLoader.h"
 #include "Entity.h"
+#include "FrameConstants.h"
 #include "Lights.h"
+#include "Materials.h"
 #include "SSAO.h"
 
 struct SUpdateInfo
@@ -51,13 +55,23 @@ public:
 	void Resize(int, int);
 
 	void OtherEvent(const SDL_Event&);
+
+	void SetCamera(const glm::vec3&, const glm::vec3&);
+	// The final image goes here instead of the default framebuffer (headless mode has none)
+	void SetOutputFramebuffer(GLuint);
+	const GPUProfiler& GetGPUProfiler() const;
+	// Blocks until every mesh and texture has finished loading
+	void WaitForAssets();
 protected:
 	void SetupDebugCallback();
 	void RenderEntityGUI();
 	void RenderLightGUI(LightType);
+	void RenderProfilerGUI();
 
+	FrameConstants m_frameConstants;
 	Lights m_lights;
 	SSAO m_SSAO;
+	GPUProfiler m_gpuProfiler;
 
 	//
 	// Variables
@@ -97,8 +111,11 @@ protected:
 	void InitSkyboxShaders();
 	void CleanSkyboxShaders();
 
+	AssetLoader m_assetLoader;
+
 	// Geometry variables
 	OGLObject m_skybox = {};
+	Mesh m_placeholder = {};
 	Mesh m_suzanne = {};
 	Mesh m_sphere = {};
 	Mesh m_cube = {};
@@ -113,9 +130,10 @@ protected:
 
 	// Texture variables
 	GLuint m_skyboxTextureID = 0;
-	GLuint m_metalTextureID = 0;
-	GLuint m_grassTextureID = 0;
-	GLuint m_treeTextureID = 0;
+	Materials m_materials;
+	uint32_t m_metalMaterial = 0;
+	uint32_t m_grassMaterial = 0;
+	uint32_t m_treeMaterial = 0;
 
 	// Texture initialization and termination
 	void InitTextures();
@@ -124,6 +142,7 @@ protected:
 	void CleanSkyboxTextures();
 
 	// Framebuffer variables
+	GLuint m_outputFrameBuffer = 0;
 	GLuint m_sceneFrameBuffer = 0;
 	GLuint m_diffuseTextureID = 0;
 	GLuint m_normalTextureID = 0; // view
@@ -132,5 +151,5 @@ protected:
 	// Framebuffer initialization and termination
 	void CreateFramebuffer(GLint, GLint);
 
-	void DrawScene(const glm::mat4&, const glm::mat4&, bool) const;
+	void DrawScene(bool) const;
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "SSAO.h"
 #include "ProgramBuilder.h"
 #include "Logs.h"
+#include <array>
 #include <random>
 #include <glm/gtc/type_ptr.hpp>
 
@@ -8,18 +9,14 @@ inline float lerp(float a, float b, float f) {
     return a + f * (b - a);
 }
 
-SSAO::SSAO() : m_ProgramID(glCreateProgram()) {
-    
-    ProgramBuilder{ m_ProgramID }
-        .ShaderStage(GL_VERTEX_SHADER, "Shaders/SSAO.vert")
-        .ShaderStage(GL_FRAGMENT_SHADER, "Shaders/SSAO.frag")
-        .Link();
+static constexpr std::array<int, 3> KernelSizes = { 16, 32, 64 };
 
+static std::vector<glm::vec3> generateKernel(int size) {
     std::uniform_real_distribution<float> random_m1_p1(-1.0, 1.0);
     std::uniform_real_distribution<float> random_p0_p1(0.0, 1.0);
     std::default_random_engine generator;
-    std::vector<glm::vec3> ssaoKernel;
-    for (unsigned int i = 0; i < 64; ++i)
+    std::vector<glm::vec3> kernel;
+    for (int i = 0; i < size; ++i)
     {
         glm::vec3 sample(
             random_m1_p1(generator),
@@ -29,16 +26,26 @@ SSAO::SSAO() : m_ProgramID(glCreateProgram()) {
         sample = glm::normalize(sample);
         sample *= random_p0_p1(generator);
 
-        float scale = (float)i / 64.0f;
+        float scale = (float)i / (float)size;
         scale = lerp(0.1f, 1.0f, scale * scale);
         sample *= scale;
-        ssaoKernel.push_back(sample);
+        kernel.push_back(sample);
     }
+    return kernel;
+}
+
+SSAO::SSAO() : m_Programs([](ProgramBuilder& builder, uint32_t quality) {
+        builder
+            .ShaderStage(GL_VERTEX_SHADER, "Shaders/SSAO.vert")
+            .ShaderStage(GL_FRAGMENT_SHADER, "Shaders/SSAO.frag")
+            .Define("KERNEL_SIZE", KernelSizes[quality]);
+    }) {
 
-    glUseProgram(m_ProgramID);
-    glUniform3fv(3, 64, (const GLfloat*)ssaoKernel.data());
-    glUseProgram(0);
+    // The other qualities are compiled when they are picked
+    m_Programs.Get(m_Quality);
 
+    std::uniform_real_distribution<float> random_m1_p1(-1.0, 1.0);
+    std::default_random_engine generator;
     std::vector<glm::vec3> ssaoNoise;
     for (unsigned int i = 0; i < 16; i++)
     {
@@ -70,16 +77,18 @@ SSAO::~SSAO() {
     glDeleteTextures(1, &m_NoiseTexture);
 }
 
-void SSAO::RenderSSAO(const GLuint normalBuffer, const GLuint depthBuffer, const Camera& camera) {
+void SSAO::RenderSSAO(const GLuint normalBuffer, const GLuint depthBuffer) {
     glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
-    glUseProgram(m_ProgramID);
+    glUseProgram(m_Programs.Get(m_Quality));
+    if (!(m_KernelUploaded & (1u << m_Quality))) {
+        std::vector<glm::vec3> kernel = generateKernel(KernelSizes[m_Quality]);
+        glUniform3fv(3, KernelSizes[m_Quality], (const GLfloat*)kernel.data());
+        m_KernelUploaded |= 1u << m_Quality;
+    }
+    glUniform2fv(2, 1, glm::value_ptr(m_NoiseScale));
     glBindTextureUnit(0, normalBuffer);
     glBindTextureUnit(1, depthBuffer);
     glBindTextureUnit(2, m_NoiseTexture);
-    glm::mat4 matrix = camera.GetProj();
-    glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(matrix));
-    matrix = glm::inverse(matrix);
-    glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(matrix));
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
@@ -103,11 +112,13 @@ void SSAO::CreateFrameBuffer(GLint width, GLint height) {
     CheckGlError("Error creating color attachment 0");
     CheckFramebufferError(m_Framebuffer);
 
-    glUseProgram(m_ProgramID);
-    glUniform2f(2, width / 4.0f, height / 4.0f);
-    glUseProgram(0);
+    m_NoiseScale = glm::vec2(width / 4.0f, height / 4.0f);
 }
 
 GLuint SSAO::GetSSAO() {
     return m_Texture;
+}
+
+int& SSAO::GetQuality() {
+    return m_Quality;
 }
\ No newline at end of file
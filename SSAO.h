@@ -1,20 +1,35 @@
 #pragma once
 #include <GL/glew.h>
+#include <cstdint>
+#include <vector>
 #include "Camera.h"
+#include "ProgramPermutations.h"
+
+// Samples of the kernel: 16, 32 and 64
+enum SSAOQuality {
+	SSAO_LOW = 0,
+	SSAO_MEDIUM = 1,
+	SSAO_HIGH = 2
+};
 
 class SSAO {
 	GLuint m_Framebuffer = 0;
 	GLuint m_Texture = 0;
 	GLuint m_NoiseTexture = 0;
 
-	GLuint m_ProgramID = 0;;
+	ProgramPermutations m_Programs; // One per SSAOQuality, the kernel size is a compile time constant
+	int m_Quality = SSAO_HIGH;
+	uint32_t m_KernelUploaded = 0; // Bit per quality, a program gets its kernel on its first use, it may still be compiling before
+	glm::vec2 m_NoiseScale = glm::vec2(1);
 
 public:
 	SSAO();
 	~SSAO();
 
-	void RenderSSAO(GLuint, GLuint, const Camera&);
+	// The projection comes from the FrameConstants
+	void RenderSSAO(GLuint, GLuint);
 	void CreateFrameBuffer(GLint, GLint);
 	GLuint GetSSAO();
+	int& GetQuality();
 
 };
\ No newline at end of file
@@ -8,17 +8,20 @@ layout(binding = 1) uniform sampler2D depthTexture;
 layout(binding = 2) uniform sampler2D noiseTexture;
 
 const float radius = 0.5;
-const int kernelSize = 64;
+// Set by SSAO per quality
+#ifndef KERNEL_SIZE
+#define KERNEL_SIZE 64
+#endif
+const int kernelSize = KERNEL_SIZE;
 const float bias = 0.025;
 
-layout(location = 0) uniform mat4 P;
-layout(location = 1) uniform mat4 PI;
+#include "frame.glsl"
 layout(location = 2) uniform vec2 noiseScale = vec2(1080.0/4.0, 760.0/4.0);
 layout(location = 3) uniform vec3 samples[kernelSize];
 
 vec4 getPosView(vec2 coord){
     float depth = texture(depthTexture, coord).x;
-    vec4 fragPos = PI * vec4(vec3(coord, depth) * 2. - 1., 1.);
+    vec4 fragPos = frame.invProj * vec4(vec3(coord, depth) * 2. - 1., 1.);
     return fragPos /= fragPos.w;
 }
 
@@ -30,7 +33,7 @@ void main(){
         return;
     }
     ///
-    vec4 fragPos = PI * vec4(vec3(vs_out_tex, depth) * 2. - 1., 1.);
+    vec4 fragPos = frame.invProj * vec4(vec3(vs_out_tex, depth) * 2. - 1., 1.);
     fragPos /= fragPos.w;
 
     vec3 normal = texture(normalTexture, vs_out_tex).xyz;
@@ -47,12 +50,12 @@ void main(){
         samplePos = fragPos.xyz + samplePos * radius; 
 
         vec4 offset = vec4(samplePos, 1.0);
-        offset      = P * offset;
+        offset      = frame.proj * offset;
         offset.xyz /= offset.w;
         offset.xyz  = offset.xyz * 0.5 + 0.5;
 
         float depth = texture(depthTexture, offset.xy).x;
-        vec4 offsetPos = PI * vec4(vec3(offset.xy, depth) * 2. - 1., 1.);
+        vec4 offsetPos = frame.invProj * vec4(vec3(offset.xy, depth) * 2. - 1., 1.);
         offsetPos /= offsetPos.w;
 
         float rangeCheck = smoothstep(0.0, 1.0, radius / abs(fragPos.z - offsetPos.z));
@@ -30,12 +30,12 @@ restrict layout(std430, binding = 0) buffer positionBuffer
 	Light lights[];
 };
 
-layout(location = 0) uniform mat4 VIT;
+#include "frame.glsl"
 
 void main()
 {
 	color_out = lights[gl_InstanceID].color.xyz;
-	direction_out = normalize((VIT * lights[gl_InstanceID].direction).xyz);
+	direction_out = normalize((transpose(frame.invView) * lights[gl_InstanceID].direction).xyz);
 
 	gl_Position = positions[gl_VertexID];
 	vs_out_tex	= texCoords[gl_VertexID];
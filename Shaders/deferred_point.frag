@@ -10,12 +10,12 @@ layout(binding = 1) uniform sampler2D diffuseTexture;
 layout(binding = 2) uniform sampler2D normalTexture;
 layout(binding = 3) uniform sampler2D depthTexture;
 
-layout(location = 2) uniform mat4 PI;
+#include "frame.glsl"
 
 void main()
 {
 	float d = texture(depthTexture, texCoord).x;
-	vec4 pos = PI * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
+	vec4 pos = frame.invProj * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
 	pos.xyz /= pos.w;
 
 	vec3 light = position_r.xyz - pos.xyz;
@@ -13,7 +13,7 @@ restrict layout(std430, binding = 0) buffer positionBuffer
 	Light lights[];
 };
 
-layout(location = 0) uniform mat4 view;
+#include "frame.glsl"
 
 void main()
 {
@@ -22,6 +22,6 @@ void main()
 
 
 	color_out = lights[gl_VertexID].color.rgb;
-	vec4 pView = view * lights[gl_VertexID].position;
+	vec4 pView = frame.view * lights[gl_VertexID].position;
 	position_r_out = vec4(pView.xyz, lights[gl_VertexID].color.w);
 }
\ No newline at end of file
@@ -0,0 +1,69 @@
+#version 460
+
+// Has to match ClusterGrid in Clusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+struct Light{
+	vec4 color;
+	vec4 position;
+};
+
+struct Cell{
+	uint offset;
+	uint count;
+};
+
+layout(location = 0) in vec2 texCoord;
+
+layout(location = 0) out vec4 fs_out_col;
+
+restrict readonly layout(std430, binding = 0) buffer positionBuffer
+{
+	Light lights[];
+};
+
+restrict readonly layout(std430, binding = 1) buffer cellBuffer
+{
+	Cell cells[];
+};
+
+restrict readonly layout(std430, binding = 2) buffer indexBuffer
+{
+	uint lightIndices[];
+};
+
+layout(binding = 1) uniform sampler2D diffuseTexture;
+layout(binding = 2) uniform sampler2D normalTexture;
+layout(binding = 3) uniform sampler2D depthTexture;
+
+#include "frame.glsl"
+
+void main()
+{
+	float d = texture(depthTexture, texCoord).x;
+	if (d >= 1.0) discard;
+
+	vec4 pos = frame.invProj * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
+	pos.xyz /= pos.w;
+
+	uint slice = uint(clamp(log(-pos.z / frame.zNearFar.x) / log(frame.zNearFar.y / frame.zNearFar.x) * CLUSTER_Z, 0.0, CLUSTER_Z - 1.0));
+	uvec2 tile = min(uvec2(texCoord * vec2(CLUSTER_X, CLUSTER_Y)), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	Cell cell = cells[tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y];
+
+	vec4 Kd = texture( diffuseTexture, texCoord );
+	vec3 n = texture( normalTexture, texCoord ).rgb;
+
+	vec4 result = vec4(0);
+	for (uint i = 0; i < cell.count; ++i) {
+		Light currentLight = lights[lightIndices[cell.offset + i]];
+		vec3 light = (frame.view * currentLight.position).xyz - pos.xyz;
+		float dist2 = dot(light, light);
+		if (dist2 > currentLight.color.w * currentLight.color.w) continue;
+
+		vec3 lightDir = light * inversesqrt(dist2);
+		result += vec4(currentLight.color.rgb, 1) * (Kd * clamp(dot(n, lightDir), 0, 1)) / dist2;
+	}
+	fs_out_col = result;
+}
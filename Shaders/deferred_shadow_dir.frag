@@ -9,32 +9,33 @@ layout(binding = 1) uniform sampler2D normalTexture;
 layout(binding = 2) uniform sampler2D depthTexture;
 layout(binding = 3) uniform sampler2DArray shadowTexture;
 
-const float cascadePlaneDistances[5] = {1000.f / 50.0f, 1000.f / 25.0f, 1000.f / 10.0f, 1000.f / 2.0f, 1000.0f};
+// CASCADE_COUNT, CASCADE_DISTANCES (the far planes of every cascade but the last) and PCF_RADIUS are set by Lights
+#ifndef PCF_RADIUS
+#define PCF_RADIUS 1
+#endif
+const float cascadePlaneDistances[CASCADE_COUNT - 1] = CASCADE_DISTANCES;
 
-layout(location = 0) uniform mat4 PI;
-layout(location = 1) uniform mat4 VI;
-layout(location = 2) uniform mat4 V;
+#include "frame.glsl"
 layout(location = 3) uniform vec3 color;
 layout(location = 4) uniform vec3 direction;
-layout(location = 5) uniform mat4 lightSpaceMatrices[5];
+layout(location = 5) uniform mat4 lightSpaceMatrices[CASCADE_COUNT];
 
 float calculate_shadow(){
 	float d = texture(depthTexture, texCoord).x;
-	vec4 fragPosView = PI * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
+	vec4 fragPosView = frame.invProj * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
 	fragPosView /= fragPosView.w;
 
 	float depthLenght = -fragPosView.z;
 
-	int layer = -1;
-	for(int i = 0; i < 5; ++i){
+	int layer = CASCADE_COUNT - 1;
+	for(int i = 0; i < CASCADE_COUNT - 1; ++i){
 		if(depthLenght < cascadePlaneDistances[i]){
 			layer = i;
 			break;
 		}
 	}
-	if (layer == -1) layer = 5;
 
-	vec4 fragPosWorld = VI * fragPosView;
+	vec4 fragPosWorld = frame.invView * fragPosView;
 
 	vec4 fragPosLight = lightSpaceMatrices[layer] * fragPosWorld;
 	fragPosLight /= fragPosLight.w;
@@ -46,9 +47,9 @@ float calculate_shadow(){
 	float bias = 0.001f;
 	float shadow = 0.0f;
 	vec2 texelSize = 1.0 / vec2(textureSize(shadowTexture, 0));
-	for(int x = -1; x <= 1; ++x)
+	for(int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
 	{
-	    for(int y = -1; y <= 1; ++y)
+	    for(int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
 	    {
 	        float pcfDepth = texture(
 	                    shadowTexture,
@@ -58,27 +59,26 @@ float calculate_shadow(){
 	        shadow += fragPosLight.z - bias < pcfDepth ? 1.0 : 0.0;
 	    }    
 	}
-	shadow /= 9.0;
+	shadow /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
 	return shadow;
 }
 
 float calculate_shadow_linear(){
 	float d = texture(depthTexture, texCoord).x;
-	vec4 fragPosView = PI * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
+	vec4 fragPosView = frame.invProj * (vec4(vec3(texCoord, d) * 2. - 1., 1.));
 	fragPosView /= fragPosView.w;
 
 	float depthLenght = -fragPosView.z;
 
-	int layer = -1;
-	for(int i = 0; i < 5; ++i){
+	int layer = CASCADE_COUNT - 1;
+	for(int i = 0; i < CASCADE_COUNT - 1; ++i){
 		if(depthLenght < cascadePlaneDistances[i]){
 			layer = i;
 			break;
 		}
 	}
-	if (layer == -1) layer = 5;
 
-	vec4 fragPosWorld = VI * fragPosView;
+	vec4 fragPosWorld = frame.invView * fragPosView;
 
 	vec4 fragPosLight = lightSpaceMatrices[layer] * fragPosWorld;
 	fragPosLight /= fragPosLight.w;
@@ -91,9 +91,9 @@ float calculate_shadow_linear(){
 	bias *= layer;
 	float shadow = 0.0f;
 	vec2 texelSize = 1.0 / vec2(textureSize(shadowTexture, 0));
-	for(int x = -1; x <= 1; ++x)
+	for(int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
 	{
-	    for(int y = -1; y <= 1; ++y)
+	    for(int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
 	    {
 	        float pcfDepth = texture(
 	                    shadowTexture,
@@ -103,13 +103,13 @@ float calculate_shadow_linear(){
 	        shadow += fragPosLight.z - bias < pcfDepth ? 1.0 : 0.0;
 	    }    
 	}
-	shadow /= 9.0;
+	shadow /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
 	return shadow;
 }
 
 void main()
 {
-	vec3 lightDir = (V * vec4(direction,0)).xyz;
+	vec3 lightDir = (frame.view * vec4(direction,0)).xyz;
 
 	vec4 Kd = texture( diffuseTexture, texCoord );
 	vec3 n = normalize(texture( normalTexture, texCoord ).xyz);
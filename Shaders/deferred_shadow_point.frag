@@ -11,8 +11,7 @@ layout(binding = 2) uniform sampler2D normalTexture;
 layout(binding = 3) uniform sampler2D depthTexture;
 
 layout(location = 3) uniform vec3 position_in;
-layout(location = 4) uniform mat4 PI;
-layout(location = 5) uniform mat4 VI;
+#include "frame.glsl"
 layout(location = 1) uniform float radius;
 layout(binding = 0) uniform samplerCube depthMap;
 
@@ -21,7 +20,7 @@ const float samples = 4.0;
 const float offset  = 0.08;
 
 float shadowCalcutaion(vec4 fragPosView,float currentDepth){
-	vec3 fragToLight = (VI * fragPosView).xyz - position_in.xyz;
+	vec3 fragToLight = (frame.invView * fragPosView).xyz - position_in.xyz;
 	float shadow  = 0.0;
 
 	for(float x = -offset; x < offset; x += offset / (samples * 0.5))
@@ -36,7 +35,7 @@ float shadowCalcutaion(vec4 fragPosView,float currentDepth){
 }
 
 vec4 getInView(in float depth){
-	vec4 position_view = PI * (vec4(vec3(texCoord, depth) * 2. - 1., 1.));
+	vec4 position_view = frame.invProj * (vec4(vec3(texCoord, depth) * 2. - 1., 1.));
 	return position_view / position_view.w;
 }
 
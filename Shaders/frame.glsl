@@ -0,0 +1,14 @@
+// The constants of the frame, FrameConstants on the C++ side. Computed once per frame from the camera
+layout(std140, binding = 0) uniform FrameConstants
+{
+	mat4 view;
+	mat4 proj;
+	mat4 viewProj;
+	mat4 invView;
+	mat4 invProj;
+	mat4 invViewProj;
+	vec4 frustumPlanes[6]; // World space, normalized, pointing inwards
+	vec4 viewport; // x, y, width, height
+	vec2 jitter; // Of the projection in pixels, zero while nothing jitters it
+	vec2 zNearFar;
+} frame;
@@ -0,0 +1,18 @@
+// The textures of every material, the index of the draw selects the array and the layer (Materials.h)
+struct Material {
+	uint textureArray;
+	uint layer;
+};
+
+restrict readonly layout(std430, binding = 3) buffer materialBuffer
+{
+	Material materials[];
+};
+
+layout(binding = 0) uniform sampler2DArray materialTextures[8];
+layout(location = 16) uniform uint materialIndex;
+
+vec4 sampleMaterial(vec2 uv) {
+	Material material = materials[materialIndex];
+	return texture(materialTextures[material.textureArray], vec3(uv, material.layer));
+}
@@ -8,10 +8,9 @@ layout(location=1) in vec2 vs_out_tex0;
 layout(location=0) out vec4 fs_out_diffuse;
 layout(location=1) out vec3 fs_out_normal;
 
-// Different geometries may be drawn with different textures attached
-layout(binding = 0) uniform sampler2D texImage;
+#include "materials.glsl"
 
 void main(void) {
-	fs_out_diffuse = vec4(texture(texImage, vs_out_tex0).xyz, 1);
+	fs_out_diffuse = vec4(sampleMaterial(vs_out_tex0).xyz, 1);
 	fs_out_normal = normalize(vs_out_normal);
 }
\ No newline at end of file
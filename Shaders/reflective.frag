@@ -9,11 +9,12 @@ layout(location=2) in vec3 pos_view;
 layout(location=0) out vec4 out_diffuse;
 layout(location=1) out vec3 out_normal;
 
-// Different geometries may be drawn with different textures attached
-layout(binding = 0) uniform sampler2D texImage;
-layout(binding = 1) uniform samplerCube environmentMap;
+#include "materials.glsl"
 
-layout(location = 4) uniform mat4 VI;
+// After the units of the materials
+layout(binding = 8) uniform samplerCube environmentMap;
+
+#include "frame.glsl"
 
 vec3 blend_screen(vec3 a, vec3 b) {
 	return a + b - a * b;
@@ -21,7 +22,7 @@ vec3 blend_screen(vec3 a, vec3 b) {
 
 void main(void) {
 	out_normal = normalize(in_normal);
-	vec3 sampleDir = (VI * vec4(reflect(pos_view,out_normal),0)).xyz;
+	vec3 sampleDir = (frame.invView * vec4(reflect(pos_view,out_normal),0)).xyz;
 
-	out_diffuse = vec4(blend_screen( texture(texImage, in_tex0).xyz, texture(environmentMap, sampleDir).xyz ),1);
+	out_diffuse = vec4(blend_screen( sampleMaterial(in_tex0).xyz, texture(environmentMap, sampleDir).xyz ),1);
 }
\ No newline at end of file
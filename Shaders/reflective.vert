@@ -3,7 +3,12 @@
 // incoming vertex attributes from the VBO via the VAO
 // now with explicit location!
 layout(location=0) in vec3 vs_in_pos;
+#if QUANTIZED_VERTEX
+// octahedral encoded, the dequantization is part of the matrices
+layout(location=1) in vec2 vs_in_normal;
+#else
 layout(location=1) in vec3 vs_in_normal;
+#endif
 layout(location=2) in vec2 vs_in_tex0;
 
 // values that are forwarded on the pipeline
@@ -13,17 +18,31 @@ layout(location=1) out vec2 vs_out_tex0;
 layout(location=2) out vec3 pos_view;
 
 // transformation this shader need to perform
-//uniform mat4 world;
 layout(location = 0) uniform mat4 worldIT;
-layout(location = 1) uniform mat4 MVP;
-layout(location = 2) uniform mat4 MVIT;
-layout(location = 3) uniform mat4 MV;
+layout(location = 1) uniform mat4 world;
+
+#include "frame.glsl"
+
+vec3 decodeNormal()
+{
+#if QUANTIZED_VERTEX
+	vec3 n = vec3(vs_in_normal, 1.0 - abs(vs_in_normal.x) - abs(vs_in_normal.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return n;
+#else
+	return vs_in_normal;
+#endif
+}
 
 void main()
 {
-	gl_Position   = MVP   * vec4( vs_in_pos, 1 );
-	vs_out_normal = (MVIT * vec4(vs_in_normal, 0)).xyz;
-	pos_view = (MV * vec4( vs_in_pos, 1 )).xyz;
+	vec4 pos_world = world * vec4( vs_in_pos, 1 );
+	gl_Position   = frame.viewProj * pos_world;
+	// The inverse transpose of view * world
+	vs_out_normal = (transpose(frame.invView) * worldIT * vec4(decodeNormal(), 0)).xyz;
+	pos_view = (frame.view * pos_world).xyz;
 	//pos_view = vs_in_normal;
 	//vs_out_normal = vs_in_normal;
 	vs_out_tex0   = vs_in_tex0;
@@ -1,4 +1,5 @@
 #include "Shadows.h"
+#include "CPUTrace.h"
 #include <SDL2/SDL.h>
 #include <string>
 
@@ -32,6 +33,7 @@ void PointLightShadow::ClearShadow(int lower, int upper, const LightInfo& info)
 }
 
 bool PointLightShadow::Update(float Frequency, std::array<int, 6>& updateValues, const LightInfo& info) {
+	CPU_TRACE_SCOPE("PointLightShadow::Update");
 	bool update = (int)(m_refreshTime + 6.0f / Frequency) > (int)m_refreshTime;
 	int lower = (int)m_refreshTime;
 	m_refreshTime += 6.0f / Frequency;
@@ -2,6 +2,7 @@
 #include "Camera.h"
 #include "Lights.h"
 #include "Logs.h"
+#include "CPUTrace.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -21,6 +22,7 @@ public:
 	}
 
 	bool Update(float Frequency, IntArray& updateValues, const LightInfo& info, const Mat4Array& transforms) {
+		CPU_TRACE_SCOPE("DirLightShadow::Update");
 		bool update = (int)(refreshTime + 6.0f / Frequency) > (int)refreshTime;
 		int lower = (int)refreshTime;
 		refreshTime += 6.0f / Frequency;
@@ -0,0 +1,292 @@
+#include "BlockCompression.h"
+#include "CPUTrace.h"
+#include "Mipmaps.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace BlockCompression
+{
+	namespace
+	{
+		uint16_t To565(const float color[3])
+		{
+			int r = std::clamp(static_cast<int>(color[0] * (31.0f / 255.0f) + 0.5f), 0, 31);
+			int g = std::clamp(static_cast<int>(color[1] * (63.0f / 255.0f) + 0.5f), 0, 63);
+			int b = std::clamp(static_cast<int>(color[2] * (31.0f / 255.0f) + 0.5f), 0, 31);
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		// The bits are replicated into the low ones, like the hardware expands them
+		void From565(uint16_t color, int result[3])
+		{
+			int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+			result[0] = (r << 3) | (r >> 2);
+			result[1] = (g << 2) | (g >> 4);
+			result[2] = (b << 3) | (b >> 2);
+		}
+
+		// Picks the nearest of the four colors for every texel, returns the squared error
+		int FitIndices(const uint8_t* texels, uint16_t color0, uint16_t color1, uint32_t& indices)
+		{
+			int palette[4][3];
+			From565(color0, palette[0]);
+			From565(color1, palette[1]);
+			for (int k = 0; k < 3; ++k)
+			{
+				palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+			}
+
+			indices = 0;
+			int error = 0;
+			for (int i = 0; i < 16; ++i)
+			{
+				const uint8_t* texel = texels + 4 * i;
+				int best = 0, bestError = INT32_MAX;
+				for (int p = 0; p < 4; ++p)
+				{
+					int dr = texel[0] - palette[p][0], dg = texel[1] - palette[p][1], db = texel[2] - palette[p][2];
+					int e = dr * dr + dg * dg + db * db;
+					if (e < bestError)
+					{
+						bestError = e;
+						best = p;
+					}
+				}
+				indices |= static_cast<uint32_t>(best) << (2 * i);
+				error += bestError;
+			}
+			return error;
+		}
+
+		// Endpoints along the principal axis of the colors, then refined by least squares for the chosen indices
+		void EncodeColor(const uint8_t* texels, uint8_t* block)
+		{
+			float mean[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; ++i)
+				for (int k = 0; k < 3; ++k) mean[k] += texels[4 * i + k];
+			for (float& m : mean) m /= 16.0f;
+
+			// Covariance: xx, xy, xz, yy, yz, zz
+			float cov[6] = {};
+			for (int i = 0; i < 16; ++i)
+			{
+				float d[3] = { texels[4 * i] - mean[0], texels[4 * i + 1] - mean[1], texels[4 * i + 2] - mean[2] };
+				cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+				cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+			}
+
+			// Power iteration, starting from the row of the largest variance
+			float axis[3];
+			if (cov[0] >= cov[3] && cov[0] >= cov[5]) { axis[0] = cov[0]; axis[1] = cov[1]; axis[2] = cov[2]; }
+			else if (cov[3] >= cov[5]) { axis[0] = cov[1]; axis[1] = cov[3]; axis[2] = cov[4]; }
+			else { axis[0] = cov[2]; axis[1] = cov[4]; axis[2] = cov[5]; }
+			for (int iteration = 0; iteration < 8; ++iteration)
+			{
+				float next[3] =
+				{
+					cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+					cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+					cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+				};
+				float scale = std::max({ std::abs(next[0]), std::abs(next[1]), std::abs(next[2]) });
+				if (scale == 0.0f) break;
+				for (int k = 0; k < 3; ++k) axis[k] = next[k] / scale;
+			}
+			float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+			float end0[3], end1[3];
+			if (length2 > 0.0f)
+			{
+				float low = 0.0f, high = 0.0f;
+				for (int i = 0; i < 16; ++i)
+				{
+					float t = ((texels[4 * i] - mean[0]) * axis[0] + (texels[4 * i + 1] - mean[1]) * axis[1] + (texels[4 * i + 2] - mean[2]) * axis[2]) / length2;
+					low = std::min(low, t);
+					high = std::max(high, t);
+				}
+				for (int k = 0; k < 3; ++k)
+				{
+					end0[k] = mean[k] + axis[k] * high;
+					end1[k] = mean[k] + axis[k] * low;
+				}
+			}
+			else
+			{
+				std::copy_n(mean, 3, end0);
+				std::copy_n(mean, 3, end1);
+			}
+
+			uint16_t color0 = To565(end0), color1 = To565(end1);
+			uint32_t indices;
+			int error = FitIndices(texels, color0, color1, indices);
+
+			// Each texel is weight * end0 + (1 - weight) * end1, solved for the two endpoints
+			static constexpr float Weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+			for (int i = 0; i < 16; ++i)
+			{
+				float w = Weights[(indices >> (2 * i)) & 3];
+				aa += w * w;
+				ab += w * (1.0f - w);
+				bb += (1.0f - w) * (1.0f - w);
+				for (int k = 0; k < 3; ++k)
+				{
+					ax[k] += w * texels[4 * i + k];
+					bx[k] += (1.0f - w) * texels[4 * i + k];
+				}
+			}
+			float determinant = aa * bb - ab * ab;
+			if (std::abs(determinant) > 1e-6f)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					end0[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+					end1[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+				}
+				uint16_t refined0 = To565(end0), refined1 = To565(end1);
+				uint32_t refinedIndices;
+				if (FitIndices(texels, refined0, refined1, refinedIndices) < error)
+				{
+					color0 = refined0;
+					color1 = refined1;
+					indices = refinedIndices;
+				}
+			}
+
+			// The 4 color mode of BC1 needs color0 > color1, swapping the endpoints maps 0 <-> 1 and 2 <-> 3
+			if (color0 < color1)
+			{
+				std::swap(color0, color1);
+				indices ^= 0x55555555u;
+			}
+			else if (color0 == color1) indices = 0;
+
+			block[0] = static_cast<uint8_t>(color0);
+			block[1] = static_cast<uint8_t>(color0 >> 8);
+			block[2] = static_cast<uint8_t>(color1);
+			block[3] = static_cast<uint8_t>(color1 >> 8);
+			for (int b = 0; b < 4; ++b) block[4 + b] = static_cast<uint8_t>(indices >> (8 * b));
+		}
+
+		// 8 alpha mode between the extremes, or a single value
+		void EncodeAlpha(const uint8_t* texels, uint8_t* block)
+		{
+			int alpha0 = 0, alpha1 = 255;
+			for (int i = 0; i < 16; ++i)
+			{
+				alpha0 = std::max<int>(alpha0, texels[4 * i + 3]);
+				alpha1 = std::min<int>(alpha1, texels[4 * i + 3]);
+			}
+
+			uint64_t indices = 0;
+			if (alpha0 > alpha1)
+			{
+				int palette[8] = { alpha0, alpha1 };
+				for (int p = 2; p < 8; ++p) palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+
+				for (int i = 0; i < 16; ++i)
+				{
+					int best = 0, bestError = INT32_MAX;
+					for (int p = 0; p < 8; ++p)
+					{
+						int e = std::abs(texels[4 * i + 3] - palette[p]);
+						if (e < bestError)
+						{
+							bestError = e;
+							best = p;
+						}
+					}
+					indices |= static_cast<uint64_t>(best) << (3 * i);
+				}
+			}
+
+			block[0] = static_cast<uint8_t>(alpha0);
+			block[1] = static_cast<uint8_t>(alpha1);
+			for (int b = 0; b < 6; ++b) block[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+		}
+	}
+
+	GLenum GLFormat(Format format)
+	{
+		return format == Format::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+
+	void EncodeBC1(const uint8_t* texels, uint8_t* block)
+	{
+		EncodeColor(texels, block);
+	}
+
+	void EncodeBC3(const uint8_t* texels, uint8_t* block)
+	{
+		EncodeAlpha(texels, block);
+		// The color block of BC3 is always in the 4 color mode
+		EncodeColor(texels, block + 8);
+	}
+
+	CompressedImage Compress(const ImageRGBA& image, bool mipmaps, unsigned int threadCount)
+	{
+		CPU_TRACE_SCOPE("BlockCompression::Compress");
+		CompressedImage result;
+		if (image.width <= 0 || image.height <= 0) return result;
+
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(image.pixels.data());
+		bool opaque = true;
+		for (size_t i = 0; i < image.pixels.size() && opaque; ++i) opaque = bytes[4 * i + 3] == 255;
+		result.format = opaque ? Format::BC1 : Format::BC3;
+		const size_t blockSize = BlockSize(result.format);
+
+		std::vector<ImageRGBA> mips;
+		if (mipmaps) mips = Mipmaps::BuildChain(image, true, threadCount);
+		auto levelImage = [&](size_t level) -> const ImageRGBA& { return level == 0 ? image : mips[level - 1]; };
+
+		// One job per block row of every level
+		std::vector<std::pair<uint32_t, uint32_t>> rows;
+		uint64_t offset = 0;
+		for (size_t level = 0; level <= mips.size(); ++level)
+		{
+			const ImageRGBA& source = levelImage(level);
+			const uint32_t blocksX = (source.width + 3) / 4, blocksY = (source.height + 3) / 4;
+			result.levels.push_back({ static_cast<uint32_t>(source.width), static_cast<uint32_t>(source.height), offset, uint64_t(blocksX) * blocksY * blockSize });
+			offset += result.levels.back().size;
+			for (uint32_t y = 0; y < blocksY; ++y) rows.emplace_back(static_cast<uint32_t>(level), y);
+		}
+		result.data.resize(offset);
+
+		std::atomic<size_t> nextRow = 0;
+		auto encodeRows = [&]()
+		{
+			uint8_t texels[64];
+			for (size_t r = nextRow++; r < rows.size(); r = nextRow++)
+			{
+				const auto [level, blockY] = rows[r];
+				const ImageRGBA& source = levelImage(level);
+				const uint8_t* src = reinterpret_cast<const uint8_t*>(source.pixels.data());
+				const uint32_t blocksX = (source.width + 3) / 4;
+				uint8_t* block = result.data.data() + result.levels[level].offset + static_cast<size_t>(blockY) * blocksX * blockSize;
+				for (uint32_t blockX = 0; blockX < blocksX; ++blockX, block += blockSize)
+				{
+					for (int i = 0; i < 16; ++i)
+					{
+						const int x = std::min<int>(blockX * 4 + (i & 3), source.width - 1);
+						const int y = std::min<int>(blockY * 4 + (i >> 2), source.height - 1);
+						std::copy_n(src + (static_cast<size_t>(y) * source.width + x) * 4, 4, texels + 4 * i);
+					}
+					if (result.format == Format::BC1) EncodeBC1(texels, block);
+					else EncodeBC3(texels, block);
+				}
+			}
+		};
+
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+		threadCount = static_cast<unsigned int>(std::min<size_t>(threadCount, rows.size()));
+		std::vector<std::thread> threads;
+		for (unsigned int t = 1; t < threadCount; ++t) threads.emplace_back(encodeRows);
+		encodeRows();
+		for (std::thread& thread : threads) thread.join();
+		return result;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GLUtils.hpp"
+
+// CPU encoder for the S3TC block formats every desktop GPU samples natively: BC1 (4 bpp, opaque) and BC3 (8 bpp, with alpha).
+// A block is 4x4 texels; the edge blocks of a level that is not a multiple of 4 repeat the last row and column.
+namespace BlockCompression
+{
+	enum class Format : uint32_t { BC1, BC3 };
+
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset; // In bytes, in the data of the image
+		uint64_t size;
+	};
+
+	struct CompressedImage
+	{
+		Format format = Format::BC1;
+		std::vector<Level> levels; // Full size first
+		std::vector<uint8_t> data;
+	};
+
+	constexpr size_t BlockSize(Format format) { return format == Format::BC1 ? 8 : 16; }
+	GLenum GLFormat(Format format);
+
+	// BC1 if every texel is opaque, BC3 otherwise. With mipmaps the whole chain down to 1x1 is built (Mipmaps::BuildChain).
+	// The chain and the blocks are built on threadCount threads, 0 uses every core. Pass 1 from threads of a pool
+	CompressedImage Compress(const ImageRGBA& image, bool mipmaps, unsigned int threadCount = 0);
+
+	// texels: 16 RGBA8 texels row by row, the block is written to block
+	void EncodeBC1(const uint8_t* texels, uint8_t* block);
+	void EncodeBC3(const uint8_t* texels, uint8_t* block);
+}
@@ -0,0 +1,158 @@
+#include "CPUTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "SDL2/SDL_log.h"
+
+namespace CPUTrace
+{
+	std::atomic<bool> enabled = true;
+
+	namespace
+	{
+		// An Event the owning thread can overwrite while WriteJSON copies it, relaxed atomics compile to plain moves
+		struct Slot
+		{
+			std::atomic<const char*> name;
+			std::atomic<uint64_t> startNs;
+			std::atomic<uint64_t> endNs;
+		};
+
+		// Single writer (the owning thread). Slot head % RingSize is written while head is published,
+		// so a reader that copied index i can tell from a later head whether the writer got to i + RingSize
+		struct ThreadBuffer
+		{
+			uint32_t threadID;
+			std::atomic<uint64_t> head = 0;
+			std::unique_ptr<Slot[]> events = std::make_unique<Slot[]>(RingSize);
+		};
+
+		// Only touched when a thread records its first event and when dumping
+		std::mutex registryMutex;
+		std::vector<std::shared_ptr<ThreadBuffer>> registry;
+
+		const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+		ThreadBuffer& LocalBuffer()
+		{
+			thread_local std::shared_ptr<ThreadBuffer> buffer = []()
+			{
+				auto newBuffer = std::make_shared<ThreadBuffer>();
+				std::lock_guard<std::mutex> lock(registryMutex);
+				newBuffer->threadID = static_cast<uint32_t>(registry.size());
+				registry.push_back(newBuffer);
+				return newBuffer;
+			}();
+			return *buffer;
+		}
+
+		// The events still in the ring, oldest first. Seqlock style: the slots that may have been overwritten
+		// during the copy are dropped by checking the head again
+		std::vector<Event> Snapshot(const ThreadBuffer& buffer)
+		{
+			const uint64_t head = buffer.head.load(std::memory_order_acquire);
+			const uint64_t from = head > RingSize ? head - RingSize : 0;
+
+			std::vector<Event> events;
+			events.reserve(head - from);
+			for (uint64_t i = from; i < head; ++i)
+			{
+				const Slot& slot = buffer.events[i % RingSize];
+				events.push_back({ slot.name.load(std::memory_order_relaxed), slot.startNs.load(std::memory_order_relaxed), slot.endNs.load(std::memory_order_relaxed) });
+			}
+
+			// Pairs with the fence in Record: if a copy saw a newer event, this sees the head it was written under
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t headAfter = buffer.head.load(std::memory_order_relaxed);
+			const uint64_t overwritten = headAfter >= RingSize ? headAfter - RingSize + 1 : 0;
+			if (overwritten > from) events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(overwritten - from, head - from)));
+			return events;
+		}
+
+		// Chrome's JSON parser rejects raw quotes, backslashes and control characters in the names
+		void WriteEscaped(std::ostream& json, const char* text)
+		{
+			for (; *text; ++text)
+			{
+				const char c = *text;
+				switch (c)
+				{
+				case '"': json << "\\\""; break;
+				case '\\': json << "\\\\"; break;
+				case '\n': json << "\\n"; break;
+				case '\r': json << "\\r"; break;
+				case '\t': json << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20)
+					{
+						char escaped[7];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+						json << escaped;
+					}
+					else json << c;
+				}
+			}
+		}
+	}
+
+	uint64_t Now() noexcept
+	{
+		// +1 so that 0 can mean "not recording" in Scope
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count() + 1;
+	}
+
+	void Record(const char* name, uint64_t startNs, uint64_t endNs) noexcept
+	{
+		ThreadBuffer& buffer = LocalBuffer();
+		uint64_t head = buffer.head.load(std::memory_order_relaxed);
+		// Orders the previous head before the slot writes for Snapshot
+		std::atomic_thread_fence(std::memory_order_release);
+		Slot& slot = buffer.events[head % RingSize];
+		slot.name.store(name, std::memory_order_relaxed);
+		slot.startNs.store(startNs, std::memory_order_relaxed);
+		slot.endNs.store(endNs, std::memory_order_relaxed);
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+
+	bool WriteJSON(const std::filesystem::path& fileName)
+	{
+		std::ofstream json(fileName);
+		if (!json.is_open())
+		{
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+				SDL_LOG_PRIORITY_ERROR,
+				"[CPUTrace] Error while opening %s!", fileName.string().c_str());
+			return false;
+		}
+
+		std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffers = registry;
+		}
+
+		json << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (const auto& buffer : buffers)
+		{
+			for (const Event& event : Snapshot(*buffer))
+			{
+				json << (first ? "" : ",\n") << "{\"name\":\"";
+				WriteEscaped(json, event.name);
+				json << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadID
+					<< ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << (event.endNs - event.startNs) / 1000.0 << "}";
+				first = false;
+			}
+		}
+		json << "\n]}\n";
+
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "[CPUTrace] Capture written to %s", fileName.string().c_str());
+		return true;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+
+// Lightweight CPU scope tracing. Every thread records into its own ring buffer without locking,
+// the last RingSize scopes per thread (minus the ones overwritten while writing) can be written out as Chrome trace_event JSON (chrome://tracing, Perfetto).
+namespace CPUTrace
+{
+	constexpr size_t RingSize = 1 << 16;
+
+	struct Event
+	{
+		const char* name; // Has to outlive the capture, string literals are expected
+		uint64_t startNs;
+		uint64_t endNs;
+	};
+
+	extern std::atomic<bool> enabled;
+
+	uint64_t Now() noexcept;
+	void Record(const char*, uint64_t, uint64_t) noexcept;
+	bool WriteJSON(const std::filesystem::path&);
+
+	class Scope
+	{
+		const char* name;
+		uint64_t start;
+	public:
+		Scope(const char* _name) noexcept : name(_name), start(enabled.load(std::memory_order_relaxed) ? Now() : 0) {}
+		~Scope() { if (start) Record(name, start, Now()); }
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+}
+
+#define CPU_TRACE_CONCAT_(a, b) a##b
+#define CPU_TRACE_CONCAT(a, b) CPU_TRACE_CONCAT_(a, b)
+#define CPU_TRACE_SCOPE(name) CPUTrace::Scope CPU_TRACE_CONCAT(cpuTraceScope, __LINE__)(name)
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Insert only open addressing hash map with Robin Hood linear probing. The entries are stored inline in one array,
+// so a lookup touches one or two cache lines instead of a bucket list and a node per entry.
+// Has the subset of the std::unordered_map interface the OBJ parser needs. Pointers to the values are invalidated by rehashing.
+template <typename Key, typename Value, typename Hash, typename Allocator = std::allocator<Key>>
+class FlatHashMap
+{
+	struct Slot
+	{
+		Key key;
+		Value value;
+		uint32_t distance; // 0 if empty, otherwise 1 + the distance from the home slot
+	};
+	using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+
+	std::vector<Slot, SlotAllocator> slots;
+	size_t count = 0;
+	unsigned int shift = 64;
+
+	// Rehash above 7/8, Robin Hood probing keeps the probe lengths short even that full
+	static constexpr size_t MaxLoadNumerator = 7;
+	static constexpr size_t MaxLoadDenominator = 8;
+
+	// Fibonacci hashing takes the top bits, the low bits of the hash may be correlated (e.g. when sharding by them)
+	size_t Home(size_t hash) const { return static_cast<size_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> shift); }
+	size_t Mask() const { return slots.size() - 1; }
+
+	void Rehash(size_t capacity)
+	{
+		std::vector<Slot, SlotAllocator> old(capacity, Slot{}, slots.get_allocator());
+		old.swap(slots);
+		shift = 64;
+		for (size_t c = capacity; c > 1; c >>= 1) --shift;
+		count = 0;
+		for (Slot& slot : old)
+			if (slot.distance != 0) Insert(std::move(slot.key), std::move(slot.value), Home(Hash{}(slot.key)), 1);
+	}
+
+	// The key must not be in the map yet, probing continues from slot i where it would be distance away from its home
+	Value* Insert(Key&& key, Value&& value, size_t i, uint32_t distance)
+	{
+		Slot carried{ std::move(key), std::move(value), distance };
+		Value* result = nullptr;
+		for (;; i = (i + 1) & Mask(), ++carried.distance)
+		{
+			Slot& slot = slots[i];
+			if (slot.distance == 0)
+			{
+				slot = std::move(carried);
+				++count;
+				return result ? result : &slot.value;
+			}
+			// Take the place of an entry closer to its home, and carry that one on
+			if (slot.distance < carried.distance)
+			{
+				std::swap(slot, carried);
+				if (!result) result = &slot.value;
+			}
+		}
+	}
+
+public:
+	explicit FlatHashMap(size_t expectedCount = 0, const Allocator& allocator = Allocator()) : slots(SlotAllocator(allocator))
+	{
+		reserve(expectedCount);
+	}
+
+	// Makes room for count entries without rehashing
+	void reserve(size_t expectedCount)
+	{
+		size_t capacity = 16;
+		while (capacity * MaxLoadNumerator / MaxLoadDenominator < expectedCount) capacity *= 2;
+		if (capacity > slots.size()) Rehash(capacity);
+	}
+
+	// Like std::unordered_map::try_emplace: the value of the key and whether it was inserted now
+	std::pair<Value*, bool> try_emplace(const Key& key, Value value)
+	{
+		if (slots.empty() || (count + 1) * MaxLoadDenominator > slots.size() * MaxLoadNumerator) Rehash(slots.empty() ? 16 : slots.size() * 2);
+
+		size_t i = Home(Hash{}(key));
+		uint32_t distance = 1;
+		// An entry closer to its home than the key would be means the key is not in the map
+		for (; slots[i].distance >= distance; i = (i + 1) & Mask(), ++distance)
+			if (slots[i].distance == distance && slots[i].key == key) return { &slots[i].value, false };
+
+		return { Insert(Key(key), std::move(value), i, distance), true };
+	}
+
+	// Value initializes the missing entries
+	Value& operator[](const Key& key) { return *try_emplace(key, Value{}).first; }
+
+	size_t size() const { return count; }
+	size_t capacity() const { return slots.size(); }
+	size_t memory() const { return slots.size() * sizeof(Slot); }
+};
@@ -1,5 +1,7 @@
 #include "GLUtils.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <stdio.h>
 #include <string>
 #include <iostream>
@@ -125,36 +127,8 @@ void AssembleProgram( const GLuint programID, const std::filesystem::path& vs_fi
 	glDeleteShader(fs_ID);
 }
 
-static void invert_image_RGBA(int pitchInPixels, int height, Uint32* image_pixels)
+bool DecodeImage(const std::filesystem::path& fileName, bool flipRows, ImageRGBA& image)
 {
-	int height_div_2 = height / 2;
-	Uint32* lower_data  =image_pixels;
-	Uint32* higher_data =image_pixels + ( height - 1 ) * pitchInPixels;
-
-	for ( int index = 0; index < height_div_2; index++ )
-	{
-		for ( int rowIndex = 0; rowIndex < pitchInPixels; rowIndex++ )
-		{
-			*lower_data ^= higher_data[ rowIndex ];
-			higher_data[ rowIndex ] ^= *lower_data;
-			*lower_data ^= higher_data[ rowIndex ];
-
-			lower_data++;
-		}
-		higher_data -= pitchInPixels;
-	}
-}
-
-void TextureFromFile(const GLuint tex, const std::filesystem::path& fileName, GLenum Type, GLenum Role)
-{
-	if (tex == 0)
-	{
-		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
-			SDL_LOG_PRIORITY_ERROR,
-			"Texture object needs to be inited before loading %s !", fileName.string().c_str());
-		return;
-	}
-
 	// Load the image
 	SDL_Surface* loaded_img = IMG_Load(fileName.string().c_str());
 
@@ -163,7 +137,7 @@ void TextureFromFile(const GLuint tex, const std::filesystem::path& fileName, GL
 		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
 			SDL_LOG_PRIORITY_ERROR,
 			"[TextureFromFile] Error while loading texture: %s", fileName.string().c_str());
-		return;
+		return false;
 	}
 
 	// SDL stores the colors in Uint32, hence we need to account for the byte
@@ -176,36 +150,56 @@ void TextureFromFile(const GLuint tex, const std::filesystem::path& fileName, GL
 
 	// Convert the image format to 32bit RGBA if it wasn't that already
 	SDL_Surface* formattedSurf = SDL_ConvertSurfaceFormat(loaded_img, format, 0);
+	SDL_FreeSurface(loaded_img);
 	if (formattedSurf == nullptr)
 	{
 		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
 			SDL_LOG_PRIORITY_ERROR,
 			"[TextureFromFile] Error while processing texture");
+		return false;
+	}
+
+	// While (0,0) in SDL means top-left, in OpenGL it means bottom-left, so the rows are copied in reverse if needed
+	image.width = formattedSurf->w;
+	image.height = formattedSurf->h;
+	image.pixels.resize(static_cast<size_t>(image.width) * image.height);
+	for (int y = 0; y < image.height; ++y)
+	{
+		const Uint8* row = static_cast<const Uint8*>(formattedSurf->pixels) + static_cast<size_t>(flipRows ? image.height - 1 - y : y) * formattedSurf->pitch;
+		std::memcpy(&image.pixels[static_cast<size_t>(y) * image.width], row, image.width * sizeof(Uint32));
+	}
+
+	SDL_FreeSurface(formattedSurf);
+	return true;
+}
+
+void TextureFromFile(const GLuint tex, const std::filesystem::path& fileName, GLenum Type, GLenum Role)
+{
+	if (tex == 0)
+	{
+		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+			SDL_LOG_PRIORITY_ERROR,
+			"Texture object needs to be inited before loading %s !", fileName.string().c_str());
 		return;
 	}
 
-	// While (0,0) in SDL means top-left, in OpenGL it means bottom-left, so we
-	// need to convert it from one to another
-	if (Type != GL_TEXTURE_CUBE_MAP && Type != GL_TEXTURE_CUBE_MAP_ARRAY)
-		invert_image_RGBA(formattedSurf->pitch / sizeof(Uint32), formattedSurf->h, reinterpret_cast<Uint32*>(formattedSurf->pixels));
+	// Cube map faces are top-down, like the SDL images
+	ImageRGBA image;
+	if (!DecodeImage(fileName, Type != GL_TEXTURE_CUBE_MAP && Type != GL_TEXTURE_CUBE_MAP_ARRAY, image)) return;
 
 	glBindTexture(Type, tex);
 	glTexImage2D(
 		Role, 						// The binding point that holds the texture
 		0, 							// Level-of-detail
 		GL_RGBA, 					// Texture's internal format (GPU side)
-		formattedSurf->w, 			// Width
-		formattedSurf->h, 			// Height
+		image.width, 				// Width
+		image.height, 				// Height
 		0, 							// Must be 0 ( https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml )
 		GL_RGBA, 					// Source (CPU side) format
 		GL_UNSIGNED_BYTE, 			// Data type of the pixel data (CPU side)
-		formattedSurf->pixels);		// Pointer to the data
+		image.pixels.data());		// Pointer to the data
 
 	glBindTexture(Type, 0);
-
-	// Free the SDL_Surfaces
-	SDL_FreeSurface(formattedSurf);
-	SDL_FreeSurface(loaded_img);
 }
 
 void SetupTextureSampling(GLenum Target, GLuint textureID, bool generateMipMap)
@@ -232,4 +226,117 @@ void CleanOGLObject(OGLObject& ObjectGPU)
 	ObjectGPU.iboID = 0;
 	glDeleteVertexArrays(1, &ObjectGPU.vaoID);
 	ObjectGPU.vaoID = 0;
-}
\ No newline at end of file
+}
+std::vector<GLushort> PackIndices(OGLObject& meshGPU, const GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+	constexpr size_t MaxVertices16 = 1 << 16;
+	// Past this many draw calls per mesh the saved bandwidth is not worth it
+	constexpr size_t MaxSubmeshes = 64;
+
+	meshGPU.count = static_cast<GLsizei>(indexCount);
+	meshGPU.indexType = GL_UNSIGNED_INT;
+	meshGPU.submeshes.clear();
+
+	std::vector<OGLSubmesh> submeshes;
+	bool use16 = vertexCount <= MaxVertices16;
+	if (!use16 && indexCount % 3 == 0)
+	{
+		// Greedily grow the triangle ranges while their vertices fit in 16 bits,
+		// the vertex fetch optimized order keeps these ranges compact
+		use16 = true;
+		size_t first = 0;
+		GLuint low = ~0u, high = 0;
+		for (size_t i = 0; i < indexCount && use16; i += 3)
+		{
+			GLuint triangleLow = std::min({ indices[i], indices[i + 1], indices[i + 2] });
+			GLuint triangleHigh = std::max({ indices[i], indices[i + 1], indices[i + 2] });
+			if (triangleHigh - triangleLow >= MaxVertices16) use16 = false;
+
+			if (std::max(high, triangleHigh) - std::min(low, triangleLow) >= MaxVertices16)
+			{
+				submeshes.push_back({ static_cast<GLsizei>(i - first), static_cast<GLintptr>(first * sizeof(GLushort)), static_cast<GLint>(low) });
+				first = i;
+				low = triangleLow;
+				high = triangleHigh;
+			}
+			else
+			{
+				low = std::min(low, triangleLow);
+				high = std::max(high, triangleHigh);
+			}
+		}
+		if (indexCount > first) submeshes.push_back({ static_cast<GLsizei>(indexCount - first), static_cast<GLintptr>(first * sizeof(GLushort)), static_cast<GLint>(low) });
+		if (submeshes.size() > MaxSubmeshes) use16 = false;
+	}
+
+	if (!use16) return {};
+
+	std::vector<GLushort> indices16(indexCount);
+	if (submeshes.empty())
+	{
+		std::copy(indices, indices + indexCount, indices16.begin());
+	}
+	else
+	{
+		for (const OGLSubmesh& submesh : submeshes)
+		{
+			size_t first = submesh.indexOffset / sizeof(GLushort);
+			for (size_t i = first; i < first + submesh.count; ++i)
+				indices16[i] = static_cast<GLushort>(indices[i] - submesh.baseVertex);
+		}
+	}
+
+	meshGPU.indexType = GL_UNSIGNED_SHORT;
+	meshGPU.submeshes = std::move(submeshes);
+	return indices16;
+}
+
+void CreateIndexBuffer(OGLObject& meshGPU, const GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+	std::vector<GLushort> indices16 = PackIndices(meshGPU, indices, indexCount, vertexCount);
+
+	glGenBuffers(1, &meshGPU.iboID);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshGPU.iboID);
+	if (meshGPU.indexType == GL_UNSIGNED_SHORT)
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indices16.data(), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
+}
+
+GLuint CreateVertexArray(GLuint vboID, GLuint iboID, GLsizei vertexSize, const std::vector<VertexAttributeDescriptor>& vertexAttrDescList)
+{
+	GLuint vaoID = 0;
+	glCreateVertexArrays(1, &vaoID);
+	glVertexArrayVertexBuffer(vaoID, 0, vboID, 0, vertexSize);
+	glVertexArrayElementBuffer(vaoID, iboID);
+
+	for (const VertexAttributeDescriptor& vertexAttrDesc : vertexAttrDescList)
+	{
+		glEnableVertexArrayAttrib(vaoID, vertexAttrDesc.index);
+		glVertexArrayAttribFormat(vaoID, vertexAttrDesc.index, vertexAttrDesc.numberOfComponents, vertexAttrDesc.glType,
+			vertexAttrDesc.normalized, static_cast<GLuint>(vertexAttrDesc.strideInBytes));
+		glVertexArrayAttribBinding(vaoID, vertexAttrDesc.index, 0);
+	}
+	return vaoID;
+}
+
+void DrawOGLObjectRange(const OGLObject& ObjectGPU, size_t firstIndex, size_t indexCount)
+{
+	const size_t indexSize = IndexSize(ObjectGPU);
+	glBindVertexArray(ObjectGPU.vaoID);
+	if (ObjectGPU.submeshes.empty())
+	{
+		glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount), ObjectGPU.indexType, reinterpret_cast<const void*>(firstIndex * indexSize));
+		return;
+	}
+
+	// The parts of the range in each submesh
+	for (const OGLSubmesh& submesh : ObjectGPU.submeshes)
+	{
+		size_t submeshFirst = submesh.indexOffset / indexSize;
+		size_t first = std::max(firstIndex, submeshFirst);
+		size_t last = std::min(firstIndex + indexCount, submeshFirst + submesh.count);
+		if (first >= last) continue;
+		glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(last - first), ObjectGPU.indexType, reinterpret_cast<const void*>(first * indexSize), submesh.baseVertex);
+	}
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <vector>
 
@@ -33,6 +34,25 @@ struct Vertex
     glm::vec2 texcoord;
 };
 
+// Half the size of Vertex, see VertexQuantization.h
+struct VertexQuantized
+{
+    uint16_t position[4]; // unorm16 in the mesh bounds, w is padding
+    int16_t  normal[2];   // snorm16 octahedral
+    uint16_t texcoord[2]; // half float
+};
+
+// Vertex format of the scene meshes, the shaders get the same QUANTIZED_VERTEX define from ProgramBuilder
+#ifndef QUANTIZED_VERTEX
+#define QUANTIZED_VERTEX 1
+#endif
+
+#if QUANTIZED_VERTEX
+using SceneVertex = VertexQuantized;
+#else
+using SceneVertex = Vertex;
+#endif
+
 // Helper functions
 
 void loadShader( const GLuint loadedShader, const std::filesystem::path& _fileName );
@@ -40,6 +60,18 @@ void compileShaderFromSource( const GLuint loadedShader, std::string_view shader
 
 void AssembleProgram( const GLuint programID, const std::filesystem::path& vs_filename, const std::filesystem::path& fs_filename );
 
+// RGBA8 pixels of an image file, tightly packed
+struct ImageRGBA
+{
+	int width = 0;
+	int height = 0;
+	std::vector<uint32_t> pixels;
+};
+
+// Decodes the file to RGBA8, with the rows in the bottom-up order of OpenGL if flipRows.
+// Touches no GL state, so it can run on any thread
+bool DecodeImage( const std::filesystem::path& fileName, bool flipRows, ImageRGBA& image );
+
 void TextureFromFile( const GLuint tex, const std::filesystem::path& fileName, GLenum Type, GLenum Role );
 
 inline void TextureFromFile( const GLuint tex, const std::filesystem::path& fileName, GLenum Type = GL_TEXTURE_2D ) { TextureFromFile( tex, fileName, Type, Type ); }
@@ -53,12 +85,22 @@ struct MeshObject
     std::vector<GLuint>  indexArray;
 };
 
+// Part of a large 16 bit index buffer, its indices are relative to baseVertex
+struct OGLSubmesh
+{
+    GLsizei  count = 0;
+    GLintptr indexOffset = 0; // In bytes
+    GLint    baseVertex = 0;
+};
+
 struct OGLObject
 {
     GLuint  vaoID = 0; // Vertex array object resource ID
     GLuint  vboID = 0; // Vertex buffer object resource ID
     GLuint  iboID = 0; // Index buffer object resource ID
     GLsizei count = 0; // How many indeces/vertices do we draw?
+    GLenum  indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when every vertex is addressable with 16 bits
+    std::vector<OGLSubmesh> submeshes; // Only for 16 bit meshes with more vertices than that, drawn one by one
 };
 
 
@@ -68,12 +110,24 @@ struct VertexAttributeDescriptor
 	std::uintptr_t strideInBytes = 0;
 	GLint          numberOfComponents = 0;
 	GLenum         glType = GL_NONE;
+	GLboolean      normalized = GL_FALSE;
 };
 
+// CPU side of CreateIndexBuffer: sets the count, index type and submeshes of meshGPU and returns the 16 bit indices,
+// or nothing if the 32 bit ones have to be uploaded as they are. Touches no GL state
+std::vector<GLushort> PackIndices( OGLObject& meshGPU, const GLuint* indices, size_t indexCount, size_t vertexCount );
+
+// Raw array version, e.g. for data mapped straight from a file
+// Uploads the indices as GLushort if possible, splitting them into submeshes if the mesh has more than 65536 vertices
+void CreateIndexBuffer( OGLObject& meshGPU, const GLuint* indices, size_t indexCount, size_t vertexCount );
+
+// Vertex array object over already filled buffers, the attributes are interleaved in vertexSize sized elements
+GLuint CreateVertexArray( GLuint vboID, GLuint iboID, GLsizei vertexSize, const std::vector<VertexAttributeDescriptor>& vertexAttrDescList );
+
 template <typename VertexT>
-[[nodiscard]] OGLObject CreateGLObjectFromMesh( const MeshObject<VertexT>& mesh, std::initializer_list<VertexAttributeDescriptor> vertexAttrDescList )
+[[nodiscard]] OGLObject CreateGLObjectFromMesh( const VertexT* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount, std::initializer_list<VertexAttributeDescriptor> vertexAttrDescList )
 {
-	OGLObject meshGPU = { 0 };
+	OGLObject meshGPU{};
 
 	glGenVertexArrays(1, &meshGPU.vaoID);	// Generate 1 Vertex Array Object (VAO)
 	glBindVertexArray(meshGPU.vaoID);		// Make the freshly generated VAO active (bind it)
@@ -84,16 +138,12 @@ template <typename VertexT>
 
 	// Transfer data to the buffer bound to GL_ARRAY_BUFFER
 	glBufferData(GL_ARRAY_BUFFER,							// Where is the buffer bound
-				  mesh.vertexArray.size() * sizeof(VertexT),// Number of BYTES
-				  mesh.vertexArray.data(),					// Pointer to the data
+				  vertexCount * sizeof(VertexT),			// Number of BYTES
+				  vertices,									// Pointer to the data
 				  GL_STATIC_DRAW);	// We do not intend to modify the data later, but we will use the buffer in a LOT of draw calls
 
-	// Generate 1 Index Buffer Object (IBO)
-	glGenBuffers(1, &meshGPU.iboID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshGPU.iboID);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexArray.size() * sizeof(GLuint), mesh.indexArray.data(), GL_STATIC_DRAW);
-
-	meshGPU.count = static_cast<GLsizei>(mesh.indexArray.size());
+	// Generate 1 Index Buffer Object (IBO), bound to the VAO
+	CreateIndexBuffer(meshGPU, indices, indexCount, vertexCount);
 
 	for ( const auto& vertexAttrDesc: vertexAttrDescList )
 	{
@@ -102,7 +152,7 @@ template <typename VertexT>
 			vertexAttrDesc.index,				// Index of the generic vertex attribute
 			vertexAttrDesc.numberOfComponents,	// Component count
 			vertexAttrDesc.glType,				// Component type
-			GL_FALSE,							// Normalize or not
+			vertexAttrDesc.normalized,			// Normalize or not
 			sizeof(VertexT),					// Stride (0 would mean tightly packed)
 			reinterpret_cast<const void*>(vertexAttrDesc.strideInBytes) // Specifies the offset of the first component
 		);
@@ -116,5 +166,18 @@ template <typename VertexT>
 	return meshGPU;
 }
 
+template <typename VertexT>
+[[nodiscard]] OGLObject CreateGLObjectFromMesh( const MeshObject<VertexT>& mesh, std::initializer_list<VertexAttributeDescriptor> vertexAttrDescList )
+{
+	return CreateGLObjectFromMesh( mesh.vertexArray.data(), mesh.vertexArray.size(), mesh.indexArray.data(), mesh.indexArray.size(), vertexAttrDescList );
+}
+
 void CleanOGLObject( OGLObject& ObjectGPU );
 
+inline size_t IndexSize( const OGLObject& ObjectGPU ) { return ObjectGPU.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); }
+
+// Binds the VAO and draws the triangles of an index range (given in indices) with the stored index type
+void DrawOGLObjectRange( const OGLObject& ObjectGPU, size_t firstIndex, size_t indexCount );
+// The first count indices
+inline void DrawOGLObject( const OGLObject& ObjectGPU ) { DrawOGLObjectRange( ObjectGPU, 0, ObjectGPU.count ); }
+
@@ -0,0 +1,159 @@
+#include "GPUProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+#include "SDL2/SDL_log.h"
+
+GPUProfiler::Scope::Scope(GPUProfiler& _profiler, const char* name) : profiler(_profiler)
+{
+	profiler.Begin(name);
+}
+
+GPUProfiler::Scope::~Scope()
+{
+	profiler.End();
+}
+
+GPUProfiler::~GPUProfiler()
+{
+	for (Section& section : m_Sections)
+		for (std::vector<GLuint>& queries : section.queries)
+			glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+}
+
+void GPUProfiler::BeginFrame()
+{
+	++m_Frame;
+	// The slot we are about to reuse was issued FrameLatency frames ago
+	if (m_Frame > FrameLatency) resolve(slot());
+	for (Section& section : m_Sections) section.used[slot()] = 0;
+}
+
+void GPUProfiler::resolve(size_t frameSlot)
+{
+	std::vector<float> frame(m_Sections.size(), 0.0f);
+	for (size_t i = 0; i < m_Sections.size(); ++i)
+	{
+		Section& section = m_Sections[i];
+		for (size_t q = 0; q < section.used[frameSlot]; ++q)
+		{
+			GLuint query = section.queries[frameSlot][q];
+			GLint available = GL_FALSE;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			// Still not ready after FrameLatency frames, the sample is missing instead of waiting for it.
+			// Counting it as 0 would pull the stats down exactly on the slowest frames
+			if (!available)
+			{
+				frame[i] = MissingSample;
+				break;
+			}
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			frame[i] += static_cast<float>(elapsed) / 1e6f;
+		}
+	}
+
+	m_History.push_back(std::move(frame));
+	if (m_History.size() > HistorySize) m_History.pop_front();
+}
+
+void GPUProfiler::Begin(const char* name)
+{
+	if (m_Current)
+	{
+		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+			SDL_LOG_PRIORITY_WARN,
+			"[GPUProfiler] %s started inside %s, timer queries can't nest!", name, m_Current->name.c_str());
+		return;
+	}
+
+	auto it = std::find_if(m_Sections.begin(), m_Sections.end(), [name](const Section& section) { return section.name == name; });
+	if (it == m_Sections.end())
+	{
+		Section section;
+		section.name = name;
+		m_Sections.push_back(std::move(section));
+		it = m_Sections.end() - 1;
+	}
+
+	Section& section = *it;
+	std::vector<GLuint>& queries = section.queries[slot()];
+	size_t& used = section.used[slot()];
+	if (used == queries.size())
+	{
+		queries.push_back(0);
+		glGenQueries(1, &queries.back());
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[used++]);
+	m_Current = &section;
+}
+
+void GPUProfiler::End()
+{
+	if (!m_Current) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	m_Current = nullptr;
+}
+
+std::vector<GPUProfiler::Stats> GPUProfiler::GetStats() const
+{
+	std::vector<Stats> result;
+	std::vector<float> times;
+	for (size_t i = 0; i < m_Sections.size(); ++i)
+	{
+		times.clear();
+		for (const std::vector<float>& frame : m_History)
+			if (i < frame.size() && !std::isnan(frame[i])) times.push_back(frame[i]);
+
+		Stats stats;
+		stats.name = m_Sections[i].name;
+		if (!times.empty())
+		{
+			stats.last = times.back();
+			stats.average = std::accumulate(times.begin(), times.end(), 0.0f) / times.size();
+			std::sort(times.begin(), times.end());
+			auto percentile = [&times](float p) { return times[static_cast<size_t>(p * (times.size() - 1))]; };
+			stats.p50 = percentile(0.50f);
+			stats.p95 = percentile(0.95f);
+			stats.p99 = percentile(0.99f);
+		}
+		result.push_back(stats);
+	}
+	return result;
+}
+
+bool GPUProfiler::WriteCSV(const std::filesystem::path& fileName) const
+{
+	std::ofstream csv(fileName);
+	if (!csv.is_open())
+	{
+		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+			SDL_LOG_PRIORITY_ERROR,
+			"[GPUProfiler] Error while opening %s!", fileName.string().c_str());
+		return false;
+	}
+
+	csv << "frame";
+	for (const Section& section : m_Sections) csv << ',' << section.name;
+	csv << '\n';
+
+	const size_t firstFrame = m_Frame + 1 - FrameLatency - m_History.size();
+	for (size_t f = 0; f < m_History.size(); ++f)
+	{
+		csv << firstFrame + f;
+		for (size_t i = 0; i < m_Sections.size(); ++i)
+		{
+			// Missing samples are left empty
+			csv << ',';
+			if (i >= m_History[f].size()) csv << 0.0f;
+			else if (!std::isnan(m_History[f][i])) csv << m_History[f][i];
+		}
+		csv << '\n';
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// GL_TIME_ELAPSED based pass timer. Queries are read back FrameLatency frames later, so it never stalls the pipeline.
+// Time elapsed queries can't nest, the scopes have to follow each other.
+class GPUProfiler
+{
+public:
+	static constexpr size_t FrameLatency = 3;
+	static constexpr size_t HistorySize = 240;
+
+	struct Stats
+	{
+		std::string name;
+		float average = 0.0f;
+		float p50 = 0.0f;
+		float p95 = 0.0f;
+		float p99 = 0.0f;
+		float last = 0.0f;
+	};
+
+	class Scope
+	{
+		GPUProfiler& profiler;
+	public:
+		Scope(GPUProfiler&, const char*);
+		~Scope();
+	};
+
+	GPUProfiler() = default;
+	~GPUProfiler();
+
+	void BeginFrame();
+	void Begin(const char*);
+	void End();
+
+	std::vector<Stats> GetStats() const;
+	// The frame times are in rows, one column per pass, all in milliseconds
+	bool WriteCSV(const std::filesystem::path&) const;
+
+private:
+	static constexpr float MissingSample = std::numeric_limits<float>::quiet_NaN();
+
+	struct Section
+	{
+		std::string name;
+		std::array<std::vector<GLuint>, FrameLatency> queries;
+		std::array<size_t, FrameLatency> used = {};
+	};
+
+	std::vector<Section> m_Sections;
+	std::deque<std::vector<float>> m_History; // per frame, indexed by section, MissingSample if a query wasn't ready
+	size_t m_Frame = 0;
+	Section* m_Current = nullptr;
+
+	size_t slot() const { return m_Frame % FrameLatency; }
+	void resolve(size_t);
+};
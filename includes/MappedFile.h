@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file (mmap / MapViewOfFile). Move-only, unmaps on destruction.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(MappedFile&&) noexcept;
+	MappedFile& operator=(MappedFile&&) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::filesystem::path&);
+	void Close();
+
+	const char* Data() const { return m_Data; }
+	size_t Size() const { return m_Size; }
+	explicit operator bool() const { return m_Open; }
+
+private:
+	const char* m_Data = nullptr;
+	size_t m_Size = 0;
+	bool m_Open = false;
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#endif
+};
@@ -0,0 +1,242 @@
+#include "MeshCache.h"
+#include "CPUTrace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "SDL2/SDL_log.h"
+
+namespace
+{
+	// fasthash64 (https://github.com/ztanml/fast-hash) over the whole buffer
+	constexpr uint64_t fasthashMix(uint64_t h)
+	{
+		h ^= h >> 23;
+		h *= 0x2127599bf4325c37ULL;
+		h ^= h >> 47;
+		return h;
+	}
+
+	uint64_t fasthash64(const char* data, size_t length, uint64_t seed)
+	{
+		constexpr uint64_t m = 0x880355f21e6d1965ULL;
+		uint64_t h = seed ^ (length * m);
+
+		const char* end = data + (length & ~size_t(7));
+		for (; data < end; data += 8)
+		{
+			uint64_t v;
+			std::memcpy(&v, data, 8);
+			h ^= fasthashMix(v);
+			h *= m;
+		}
+
+		uint64_t v = 0;
+		std::memcpy(&v, data, length & 7);
+		if (length & 7)
+		{
+			h ^= fasthashMix(v);
+			h *= m;
+		}
+		return fasthashMix(h);
+	}
+
+	bool SourceInfo(const std::filesystem::path& source, uint64_t& size, int64_t& time)
+	{
+		std::error_code ec;
+		size = std::filesystem::file_size(source, ec);
+		if (ec) return false;
+		time = std::filesystem::last_write_time(source, ec).time_since_epoch().count();
+		return !ec;
+	}
+}
+
+std::filesystem::path MeshCache::CachePath(const std::filesystem::path& source)
+{
+	std::filesystem::path cache = source;
+	cache += ".meshcache";
+	return cache;
+}
+
+uint64_t MeshCache::HashFile(const std::filesystem::path& fileName)
+{
+	MappedFile file;
+	if (!file.Open(fileName)) return 0;
+	return fasthash64(file.Data(), file.Size(), Magic);
+}
+
+uint64_t MeshCache::Hash(const void* data, size_t length, uint64_t seed)
+{
+	return fasthash64(static_cast<const char*>(data), length, seed);
+}
+
+MeshCache::Bounds MeshCache::ComputeBounds(const MeshObject<Vertex>& mesh)
+{
+	Bounds bounds = { glm::vec3(0), glm::vec3(0), glm::vec3(0), 0.0f };
+	if (mesh.vertexArray.empty()) return bounds;
+
+	bounds.min = bounds.max = mesh.vertexArray.front().position;
+	for (const Vertex& vertex : mesh.vertexArray)
+	{
+		bounds.min = glm::min(bounds.min, vertex.position);
+		bounds.max = glm::max(bounds.max, vertex.position);
+		bounds.center += vertex.position;
+	}
+	bounds.center /= static_cast<float>(mesh.vertexArray.size());
+
+	for (const Vertex& vertex : mesh.vertexArray)
+		bounds.radius = std::max(bounds.radius, glm::length(vertex.position - bounds.center));
+	return bounds;
+}
+
+bool MeshCache::Load(const std::filesystem::path& source, View& view, uint32_t vertexSize, uint32_t flags)
+{
+	CPU_TRACE_SCOPE("MeshCache::Load");
+	view = View();
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!SourceInfo(source, sourceSize, sourceTime)) return false;
+
+	const std::filesystem::path cachePath = CachePath(source);
+	MappedFile file;
+	if (!file.Open(cachePath) || file.Size() < sizeof(Header)) return false;
+
+	const Header* header = reinterpret_cast<const Header*>(file.Data());
+	if (header->magic != Magic || header->version != Version || vertexSize == 0 || header->vertexSize != vertexSize || header->flags != flags) return false;
+	// The counts come from the file, every one is checked against what is left before anything is added or multiplied
+	const uint64_t payloadSize = file.Size() - sizeof(Header);
+	if (header->vertexCount > payloadSize / vertexSize) return false;
+	const uint64_t indexBytes = payloadSize - header->vertexCount * vertexSize;
+	if (header->indexCount > indexBytes / sizeof(GLuint)) return false;
+	const uint64_t meshletBytes = indexBytes - header->indexCount * sizeof(GLuint);
+	if (meshletBytes % sizeof(Meshlet) != 0 || header->meshletCount != meshletBytes / sizeof(Meshlet)) return false;
+	if (header->meshletCount != 0 && (flags & Meshlets) == 0) return false;
+	if (header->sourceSize != sourceSize) return false;
+	if (header->lodCount > MeshSimplifier::MaxLods) return false;
+	for (uint32_t i = 0; i < header->lodCount; ++i)
+	{
+		const MeshLod& lod = header->lods[i];
+		if (lod.indexOffset > header->indexCount || lod.indexCount > header->indexCount - lod.indexOffset) return false;
+	}
+
+	if (header->sourceTime != sourceTime)
+	{
+		if (HashFile(source) != header->sourceHash) return false;
+
+		// Same content, only touched. Refresh the time stamp so the next start skips the hashing,
+		// the mapping is dropped meanwhile since Windows doesn't let us write a mapped file
+		Header updated = *header;
+		updated.sourceTime = sourceTime;
+		file.Close();
+		{
+			std::fstream cacheFile(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+			if (cacheFile) cacheFile.write(reinterpret_cast<const char*>(&updated), sizeof(Header));
+		}
+		if (!file.Open(cachePath) || file.Size() < sizeof(Header)) return false;
+		header = reinterpret_cast<const Header*>(file.Data());
+		if (std::memcmp(header, &updated, sizeof(Header)) != 0) return false;
+	}
+
+	// Right sizes don't mean right contents, the meshlet build and the 16 bit packing index the vertices on the CPU
+	const GLuint* indices = reinterpret_cast<const GLuint*>(file.Data() + sizeof(Header) + header->vertexCount * vertexSize);
+	GLuint maxIndex = 0;
+	for (uint64_t i = 0; i < header->indexCount; ++i) maxIndex = std::max(maxIndex, indices[i]);
+	if (header->indexCount != 0 && maxIndex >= header->vertexCount) return false;
+
+	view.header = header;
+	view.vertices = file.Data() + sizeof(Header);
+	view.indices = indices;
+	view.meshlets = reinterpret_cast<const uint8_t*>(indices + header->indexCount);
+	view.file = std::move(file);
+	return true;
+}
+
+::Meshlets::MeshletSet MeshCache::LoadMeshlets(const View& view)
+{
+	::Meshlets::MeshletSet meshlets;
+	const size_t count = view.header ? view.header->meshletCount : 0;
+	for (auto* values : { &meshlets.centerX, &meshlets.centerY, &meshlets.centerZ, &meshlets.radius, &meshlets.axisX, &meshlets.axisY, &meshlets.axisZ, &meshlets.coneCos, &meshlets.coneSin })
+		values->resize(count);
+	meshlets.counts.resize(count);
+	meshlets.offsets.resize(count);
+	meshlets.baseVertices.resize(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		Meshlet meshlet;
+		std::memcpy(&meshlet, static_cast<const uint8_t*>(view.meshlets) + i * sizeof(Meshlet), sizeof(Meshlet));
+		meshlets.centerX[i] = meshlet.center[0];
+		meshlets.centerY[i] = meshlet.center[1];
+		meshlets.centerZ[i] = meshlet.center[2];
+		meshlets.radius[i] = meshlet.radius;
+		meshlets.axisX[i] = meshlet.axis[0];
+		meshlets.axisY[i] = meshlet.axis[1];
+		meshlets.axisZ[i] = meshlet.axis[2];
+		meshlets.coneCos[i] = meshlet.coneCos;
+		meshlets.coneSin[i] = meshlet.coneSin;
+		meshlets.counts[i] = meshlet.count;
+		meshlets.offsets[i] = static_cast<GLintptr>(meshlet.offset);
+		meshlets.baseVertices[i] = meshlet.baseVertex;
+	}
+	return meshlets;
+}
+
+bool MeshCache::store(const std::filesystem::path& source, const void* vertices, uint32_t vertexSize, size_t vertexCount,
+	const std::vector<GLuint>& indices, const Bounds& bounds, const std::vector<MeshLod>& lods, const ::Meshlets::MeshletSet& meshletSet, uint32_t flags)
+{
+	CPU_TRACE_SCOPE("MeshCache::Store");
+
+	Header header = {};
+	header.magic = Magic;
+	header.version = Version;
+	header.vertexSize = vertexSize;
+	header.flags = flags;
+	if (!SourceInfo(source, header.sourceSize, header.sourceTime)) return false;
+	header.sourceHash = HashFile(source);
+	header.vertexCount = vertexCount;
+	header.indexCount = indices.size();
+	header.bounds = bounds;
+	header.lodCount = static_cast<uint32_t>(std::min(lods.size(), MeshSimplifier::MaxLods));
+	std::copy_n(lods.begin(), header.lodCount, header.lods);
+
+	std::vector<Meshlet> meshlets((flags & Meshlets) ? meshletSet.size() : 0);
+	for (size_t i = 0; i < meshlets.size(); ++i)
+	{
+		meshlets[i] = {
+			{ meshletSet.centerX[i], meshletSet.centerY[i], meshletSet.centerZ[i] }, meshletSet.radius[i],
+			{ meshletSet.axisX[i], meshletSet.axisY[i], meshletSet.axisZ[i] }, meshletSet.coneCos[i], meshletSet.coneSin[i],
+			meshletSet.counts[i], static_cast<int64_t>(meshletSet.offsets[i]), meshletSet.baseVertices[i], 0 };
+	}
+	header.meshletCount = meshlets.size();
+
+	// Written under a temporary name first, a crash mid-write must not leave a valid looking cache behind
+	const std::filesystem::path cachePath = CachePath(source);
+	std::filesystem::path tempPath = cachePath;
+	tempPath += ".tmp";
+	{
+		std::ofstream cacheFile(tempPath, std::ios::binary | std::ios::trunc);
+		if (!cacheFile)
+		{
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+				SDL_LOG_PRIORITY_WARN,
+				"[MeshCache] Error while opening %s!", tempPath.string().c_str());
+			return false;
+		}
+		cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		cacheFile.write(static_cast<const char*>(vertices), vertexCount * vertexSize);
+		cacheFile.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(GLuint));
+		cacheFile.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size() * sizeof(Meshlet));
+		if (!cacheFile) return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
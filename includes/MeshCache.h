@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#include "GLUtils.hpp"
+#include "MappedFile.h"
+#include "Meshlets.h"
+#include "MeshSimplifier.h"
+
+// Versioned binary dump of a parsed mesh, stored next to the source as <source>.meshcache.
+// Layout: Header, VertexT[vertexCount], GLuint[indexCount], Meshlet[meshletCount]. Loading only maps the file, the arrays are used in place.
+// The index array holds every level of detail, the header has their ranges.
+class MeshCache
+{
+public:
+	static constexpr uint32_t Magic = 0x4853454D; // "MESH"
+	static constexpr uint32_t Version = 4;
+
+	// Header flags, a cache is only used if they match the requested ones
+	static constexpr uint32_t Optimized = 1 << 0;
+	static constexpr uint32_t Quantized = 1 << 1; // VertexQuantized instead of Vertex
+	static constexpr uint32_t Lods = 1 << 2;
+	static constexpr uint32_t Meshlets = 1 << 3; // The meshlets of the full level of detail follow the indices
+
+	struct Bounds
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		glm::vec3 center; // Average of the vertices, all in the original (not quantized) space
+		float radius;	  // Around center
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t flags;
+		// The source is only hashed when its size matches but its time stamp doesn't (e.g. after a fresh checkout)
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		Bounds bounds;
+		uint32_t lodCount; // 0 if there is only the full mesh
+		MeshLod lods[MeshSimplifier::MaxLods];
+		uint64_t meshletCount;
+	};
+
+	// One element of a ::Meshlets::MeshletSet
+	struct Meshlet
+	{
+		float center[3];
+		float radius;
+		float axis[3];
+		float coneCos;
+		float coneSin;
+		int32_t count;
+		int64_t offset;
+		int32_t baseVertex;
+		int32_t padding;
+	};
+
+	// The pointers are valid while the view (its mapping) is alive
+	struct View
+	{
+		MappedFile file;
+		const Header* header = nullptr;
+		const void* vertices = nullptr; // vertexSize sized elements
+		const GLuint* indices = nullptr;
+		const void* meshlets = nullptr; // Meshlet elements, only 4 byte aligned
+	};
+
+	static std::filesystem::path CachePath(const std::filesystem::path& source);
+
+	// False if there is no cache or it is stale, corrupt or from another version
+	static bool Load(const std::filesystem::path& source, View&, uint32_t vertexSize, uint32_t flags = 0);
+
+	// The meshlets are only stored with the Meshlets flag
+	template <typename VertexT>
+	static bool Store(const std::filesystem::path& source, const MeshObject<VertexT>& mesh, const Bounds& bounds, const std::vector<MeshLod>& lods,
+		const ::Meshlets::MeshletSet& meshlets, uint32_t flags = 0)
+	{
+		return store(source, mesh.vertexArray.data(), sizeof(VertexT), mesh.vertexArray.size(), mesh.indexArray, bounds, lods, meshlets, flags);
+	}
+
+	// The meshlets of a loaded cache. Their ranges come from the file, see ::Meshlets::Matches
+	static ::Meshlets::MeshletSet LoadMeshlets(const View&);
+
+	static Bounds ComputeBounds(const MeshObject<Vertex>&);
+	static uint64_t HashFile(const std::filesystem::path&);
+	// The same hash over a buffer, the seed chains several buffers
+	static uint64_t Hash(const void* data, size_t length, uint64_t seed = Magic);
+
+private:
+	static bool store(const std::filesystem::path&, const void*, uint32_t, size_t, const std::vector<GLuint>&, const Bounds&, const std::vector<MeshLod>&,
+		const ::Meshlets::MeshletSet&, uint32_t);
+};
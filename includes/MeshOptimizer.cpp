@@ -0,0 +1,239 @@
+#include "MeshOptimizer.h"
+#include "CPUTrace.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "SDL2/SDL_log.h"
+
+namespace MeshOptimizer
+{
+	CacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+	{
+		CacheStats stats;
+		if (indices.size() < 3 || vertexCount == 0) return stats;
+
+		// A vertex is in the FIFO if it was pushed less than cacheSize misses ago
+		std::vector<size_t> pushedAt(vertexCount, 0);
+		size_t misses = 0;
+		for (GLuint index : indices)
+		{
+			if (pushedAt[index] == 0 || misses - pushedAt[index] + 1 > cacheSize)
+			{
+				++misses;
+				pushedAt[index] = misses;
+			}
+		}
+
+		// Only count the referenced vertices for the ATVR
+		size_t usedVertices = std::count_if(pushedAt.begin(), pushedAt.end(), [](size_t time) { return time != 0; });
+		stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+		stats.atvr = static_cast<float>(misses) / usedVertices;
+		return stats;
+	}
+
+	std::vector<size_t> OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize, float splitAcmr)
+	{
+		CPU_TRACE_SCOPE("MeshOptimizer::OptimizeVertexCache");
+		std::vector<size_t> clusters;
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) return clusters;
+
+		// Vertex -> triangle adjacency, in CSR form
+		std::vector<uint32_t> liveCount(vertexCount, 0);
+		for (GLuint index : indices) ++liveCount[index];
+
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; ++v) adjacencyOffset[v + 1] = adjacencyOffset[v] + liveCount[v];
+
+		std::vector<uint32_t> adjacency(indices.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		std::vector<uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<GLuint> deadEnd;
+		std::vector<GLuint> candidates;
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+
+		uint32_t time = cacheSize + 1;
+		uint32_t clusterStartTime = time; // The misses of the current cluster are time - clusterStartTime
+		size_t cursor = 0;
+
+		// Next vertex with live triangles, from the dead end stack or in input order
+		auto skipDeadEnd = [&]() -> int64_t
+		{
+			while (!deadEnd.empty())
+			{
+				GLuint v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveCount[v] > 0) return v;
+			}
+			for (; cursor < vertexCount; ++cursor)
+				if (liveCount[cursor] > 0) return static_cast<int64_t>(cursor);
+			return -1;
+		};
+
+		int64_t fanning = skipDeadEnd();
+		clusters.push_back(0);
+		while (fanning >= 0)
+		{
+			candidates.clear();
+			for (uint32_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a)
+			{
+				uint32_t triangle = adjacency[a];
+				if (emitted[triangle]) continue;
+
+				for (size_t k = 0; k < 3; ++k)
+				{
+					GLuint v = indices[triangle * 3 + k];
+					result.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--liveCount[v];
+					if (time - cacheTime[v] > cacheSize) cacheTime[v] = time++;
+				}
+				emitted[triangle] = true;
+			}
+
+			// Split when the cluster has paid off its cold start, the cache is flushed as the clusters get reordered
+			const size_t clusterTriangles = result.size() / 3 - clusters.back();
+			if (splitAcmr > 0.0f && clusterTriangles > 0 && result.size() / 3 < triangleCount &&
+				static_cast<float>(time - clusterStartTime) <= splitAcmr * clusterTriangles)
+			{
+				clusters.push_back(result.size() / 3);
+				time += cacheSize + 1;
+				clusterStartTime = time;
+			}
+
+			// Prefer the candidate that stays in the cache the longest while its remaining fan is emitted
+			int64_t next = -1;
+			int64_t bestPriority = -1;
+			for (GLuint v : candidates)
+			{
+				if (liveCount[v] == 0) continue;
+
+				int64_t priority = 0;
+				if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize) priority = time - cacheTime[v];
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					next = v;
+				}
+			}
+
+			if (next < 0)
+			{
+				next = skipDeadEnd();
+				// The cache is effectively flushed here, so the triangles can be reordered at this boundary
+				if (next >= 0 && result.size() / 3 != clusters.back())
+				{
+					clusters.push_back(result.size() / 3);
+					clusterStartTime = time;
+				}
+			}
+			fanning = next;
+		}
+
+		indices = std::move(result);
+		return clusters;
+	}
+
+	void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<size_t>& clusters, const std::vector<Vertex>& vertices)
+	{
+		CPU_TRACE_SCOPE("MeshOptimizer::OptimizeOverdraw");
+		const size_t triangleCount = indices.size() / 3;
+		if (clusters.size() < 2) return;
+
+		glm::vec3 meshCenter(0.0f);
+		float meshArea = 0.0f;
+
+		struct Cluster
+		{
+			size_t first, count;
+			glm::vec3 center; // Area weighted
+			glm::vec3 normal;
+			float area;
+			float sortKey;
+		};
+		std::vector<Cluster> sorted(clusters.size());
+
+		for (size_t c = 0; c < clusters.size(); ++c)
+		{
+			Cluster& cluster = sorted[c];
+			cluster.first = clusters[c];
+			cluster.count = (c + 1 < clusters.size() ? clusters[c + 1] : triangleCount) - cluster.first;
+			cluster.center = glm::vec3(0.0f);
+			cluster.normal = glm::vec3(0.0f);
+			cluster.area = 0.0f;
+
+			for (size_t t = cluster.first; t < cluster.first + cluster.count; ++t)
+			{
+				const glm::vec3& p0 = vertices[indices[t * 3 + 0]].position;
+				const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+				const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+
+				glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(areaNormal);
+				cluster.center += (p0 + p1 + p2) * (area / 3.0f);
+				cluster.normal += areaNormal;
+				cluster.area += area;
+			}
+
+			meshCenter += cluster.center;
+			meshArea += cluster.area;
+			if (cluster.area > 0.0f) cluster.center /= cluster.area;
+		}
+		if (meshArea > 0.0f) meshCenter /= meshArea;
+
+		for (Cluster& cluster : sorted)
+		{
+			float normalLength = glm::length(cluster.normal);
+			cluster.sortKey = normalLength > 0.0f ? glm::dot(cluster.center - meshCenter, cluster.normal / normalLength) : 0.0f;
+		}
+
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<GLuint> result;
+		result.reserve(indices.size());
+		for (const Cluster& cluster : sorted)
+			result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + (cluster.first + cluster.count) * 3);
+		indices = std::move(result);
+	}
+
+	void OptimizeVertexFetch(MeshObject<Vertex>& mesh)
+	{
+		CPU_TRACE_SCOPE("MeshOptimizer::OptimizeVertexFetch");
+		constexpr GLuint Unused = ~0u;
+		std::vector<GLuint> remap(mesh.vertexArray.size(), Unused);
+		std::vector<Vertex> vertices;
+		vertices.reserve(mesh.vertexArray.size());
+
+		for (GLuint& index : mesh.indexArray)
+		{
+			if (remap[index] == Unused)
+			{
+				remap[index] = static_cast<GLuint>(vertices.size());
+				vertices.push_back(mesh.vertexArray[index]);
+			}
+			index = remap[index];
+		}
+		mesh.vertexArray = std::move(vertices);
+	}
+
+	void Optimize(MeshObject<Vertex>& mesh, const char* name)
+	{
+		CacheStats before = AnalyzeVertexCache(mesh.indexArray, mesh.vertexArray.size());
+
+		std::vector<size_t> clusters = OptimizeVertexCache(mesh.indexArray, mesh.vertexArray.size());
+		OptimizeOverdraw(mesh.indexArray, clusters, mesh.vertexArray);
+		OptimizeVertexFetch(mesh);
+
+		CacheStats after = AnalyzeVertexCache(mesh.indexArray, mesh.vertexArray.size());
+		SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "[MeshOptimizer] %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %zu clusters",
+			name, before.acmr, after.acmr, before.atvr, after.atvr, clusters.size());
+	}
+}
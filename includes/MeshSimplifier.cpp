@@ -0,0 +1,239 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "CPUTrace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+namespace MeshSimplifier
+{
+	// Symmetric 4x4 matrix, evaluates to the sum of the squared distances from a set of planes
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+		double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+		double a22 = 0.0, a23 = 0.0;
+		double a33 = 0.0;
+
+		static Quadric FromPlane(const glm::vec3& normal, float distance)
+		{
+			const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+			Quadric q;
+			q.a00 = a * a; q.a01 = a * b; q.a02 = a * c; q.a03 = a * d;
+			q.a11 = b * b; q.a12 = b * c; q.a13 = b * d;
+			q.a22 = c * c; q.a23 = c * d;
+			q.a33 = d * d;
+			return q;
+		}
+
+		Quadric& operator+=(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			return *this;
+		}
+
+		double Evaluate(const glm::vec3& p) const
+		{
+			const double x = p.x, y = p.y, z = p.z;
+			double result = a00 * x * x + a11 * y * y + a22 * z * z + a33
+				+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z + a03 * x + a13 * y + a23 * z);
+			return std::max(result, 0.0);
+		}
+	};
+
+	// Keeps the quadrics between the reductions, so a LOD chain accumulates the error of all the collapses before it
+	class Simplifier
+	{
+		const std::vector<glm::vec3>& positions;
+		std::vector<GLuint> indices;
+		std::vector<Quadric> quadrics;
+		std::vector<bool> locked;
+		double maxCost = 0.0;
+
+		bool Flips(GLuint from, GLuint to, const std::vector<uint32_t>& adjacencyOffset, const std::vector<uint32_t>& adjacency) const;
+
+	public:
+		Simplifier(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices);
+
+		// False if the target can't be reached
+		bool Reduce(size_t targetIndexCount);
+
+		const std::vector<GLuint>& Indices() const { return indices; }
+		float Error() const { return static_cast<float>(std::sqrt(maxCost)); }
+	};
+
+	Simplifier::Simplifier(const std::vector<glm::vec3>& _positions, const std::vector<GLuint>& _indices) :
+		positions(_positions),
+		indices(_indices),
+		quadrics(_positions.size()),
+		locked(_positions.size(), false)
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(indices.size());
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			const glm::vec3& p0 = positions[indices[i + 0]];
+			glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f)
+			{
+				normal /= length;
+				Quadric plane = Quadric::FromPlane(normal, -glm::dot(normal, p0));
+				for (size_t k = 0; k < 3; ++k) quadrics[indices[i + k]] += plane;
+			}
+
+			for (size_t k = 0; k < 3; ++k)
+			{
+				GLuint a = indices[i + k], b = indices[i + (k + 1) % 3];
+				++edgeUse[(static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b)];
+			}
+		}
+
+		// Open (and non-manifold) edges stay, these are the borders and the attribute seams
+		for (const auto& [edge, count] : edgeUse)
+		{
+			if (count == 2) continue;
+			locked[edge >> 32] = true;
+			locked[edge & 0xFFFFFFFF] = true;
+		}
+	}
+
+	bool Simplifier::Flips(GLuint from, GLuint to, const std::vector<uint32_t>& adjacencyOffset, const std::vector<uint32_t>& adjacency) const
+	{
+		for (uint32_t a = adjacencyOffset[from]; a < adjacencyOffset[from + 1]; ++a)
+		{
+			const GLuint* triangle = &indices[adjacency[a] * 3];
+			if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue; // Collapses to nothing
+
+			glm::vec3 p[3], moved[3];
+			for (size_t k = 0; k < 3; ++k)
+			{
+				p[k] = positions[triangle[k]];
+				moved[k] = triangle[k] == from ? positions[to] : p[k];
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			if (glm::dot(before, after) <= 0.0f) return true;
+		}
+		return false;
+	}
+
+	bool Simplifier::Reduce(size_t targetIndexCount)
+	{
+		const size_t vertexCount = positions.size();
+
+		struct Collapse
+		{
+			GLuint from, to;
+			double cost;
+		};
+		std::vector<Collapse> collapses;
+		std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<bool> touched(vertexCount);
+		std::vector<GLuint> remap(vertexCount);
+
+		while (indices.size() > targetIndexCount)
+		{
+			// Vertex -> triangle adjacency of the current mesh
+			std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+			for (GLuint index : indices) ++adjacencyOffset[index + 1];
+			for (size_t v = 0; v < vertexCount; ++v) adjacencyOffset[v + 1] += adjacencyOffset[v];
+			adjacency.resize(indices.size());
+			{
+				std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+				for (size_t i = 0; i < indices.size(); ++i) adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			// Every half edge is a candidate, the vertex stays where the edge's other end is
+			collapses.clear();
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				for (size_t k = 0; k < 3; ++k)
+				{
+					GLuint a = indices[i + k], b = indices[i + (k + 1) % 3];
+					if (!locked[a]) collapses.push_back({ a, b, quadrics[a].Evaluate(positions[b]) + quadrics[b].Evaluate(positions[b]) });
+					if (!locked[b]) collapses.push_back({ b, a, quadrics[b].Evaluate(positions[a]) + quadrics[a].Evaluate(positions[a]) });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+			// Independent collapses only: the triangles around a collapsed vertex are not touched again in this pass.
+			// A collapse removes about two triangles
+			const size_t maxCollapses = std::max<size_t>((indices.size() - targetIndexCount) / 6, 1);
+			std::fill(touched.begin(), touched.end(), false);
+			std::iota(remap.begin(), remap.end(), 0);
+			size_t collapsed = 0;
+
+			for (const Collapse& collapse : collapses)
+			{
+				if (collapsed >= maxCollapses) break;
+				if (touched[collapse.from] || touched[collapse.to]) continue;
+				if (Flips(collapse.from, collapse.to, adjacencyOffset, adjacency)) continue;
+
+				remap[collapse.from] = collapse.to;
+				quadrics[collapse.to] += quadrics[collapse.from];
+				maxCost = std::max(maxCost, collapse.cost);
+
+				for (uint32_t a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; ++a)
+					for (size_t k = 0; k < 3; ++k) touched[indices[adjacency[a] * 3 + k]] = true;
+				touched[collapse.to] = true;
+				++collapsed;
+			}
+			if (collapsed == 0) return false;
+
+			size_t write = 0;
+			for (size_t i = 0; i < indices.size(); i += 3)
+			{
+				GLuint a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+				if (a == b || b == c || a == c) continue;
+				indices[write++] = a;
+				indices[write++] = b;
+				indices[write++] = c;
+			}
+			indices.resize(write);
+		}
+		return true;
+	}
+
+	std::vector<GLuint> Simplify(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, size_t targetIndexCount, float* resultError)
+	{
+		CPU_TRACE_SCOPE("MeshSimplifier::Simplify");
+		Simplifier simplifier(positions, indices);
+		simplifier.Reduce(targetIndexCount);
+		if (resultError) *resultError = simplifier.Error();
+		return simplifier.Indices();
+	}
+
+	std::vector<MeshLod> BuildLodChain(const std::vector<glm::vec3>& positions, std::vector<GLuint>& indices, size_t maxLods)
+	{
+		CPU_TRACE_SCOPE("MeshSimplifier::BuildLodChain");
+		std::vector<MeshLod> lods;
+		lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+		if (indices.size() % 3 != 0) return lods;
+
+		Simplifier simplifier(positions, indices);
+		size_t previousCount = indices.size();
+		while (lods.size() < maxLods)
+		{
+			simplifier.Reduce(previousCount / 6 * 3);
+			const size_t count = simplifier.Indices().size();
+			if (count == 0 || count > previousCount * 4 / 5) break;
+
+			std::vector<GLuint> lodIndices = simplifier.Indices();
+			// The levels are drawn without the overdraw sort, so no clusters beyond the dead ends
+			MeshOptimizer::OptimizeVertexCache(lodIndices, positions.size(), MeshOptimizer::CacheSize, 0.0f);
+
+			lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(count), simplifier.Error() });
+			indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+			previousCount = count;
+		}
+		return lods;
+	}
+}
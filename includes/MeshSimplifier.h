@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GLUtils.hpp"
+
+// A level of detail is a range of the mesh's index buffer, all levels share the vertex buffer
+struct MeshLod
+{
+	uint32_t indexOffset = 0;
+	uint32_t indexCount = 0;
+	float error = 0.0f; // Geometric deviation from the full mesh, in the mesh's own space
+};
+
+// Quadric error edge collapse (Garland & Heckbert 1997). A vertex is only ever collapsed onto a neighbour,
+// so the simplified meshes reuse the original vertices. Vertices on open edges, which include the UV and normal seams
+// since the seam vertices are separate, are kept in place.
+namespace MeshSimplifier
+{
+	constexpr size_t MaxLods = 5;
+
+	// Collapses edges until at most targetIndexCount indices are left or nothing can be collapsed, the error is written to resultError
+	std::vector<GLuint> Simplify(const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices, size_t targetIndexCount, float* resultError = nullptr);
+
+	// Appends the coarser levels to indices, halving the triangle count each time.
+	// The chain ends early when a level would not remove at least a fifth of the triangles
+	std::vector<MeshLod> BuildLodChain(const std::vector<glm::vec3>& positions, std::vector<GLuint>& indices, size_t maxLods = MaxLods);
+}
@@ -0,0 +1,274 @@
+#include "Meshlets.h"
+#include "CPUTrace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Meshlets
+{
+	static void AddMeshlet(MeshletSet& result, const std::vector<glm::vec3>& positions, const GLuint* indices, size_t first, size_t last, size_t indexSize, GLint baseVertex)
+	{
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		glm::vec3 normalSum(0.0f);
+		for (size_t i = first; i < last; i += 3)
+		{
+			const glm::vec3& p0 = positions[indices[i + 0]];
+			const glm::vec3& p1 = positions[indices[i + 1]];
+			const glm::vec3& p2 = positions[indices[i + 2]];
+			boundsMin = glm::min(glm::min(boundsMin, p0), glm::min(p1, p2));
+			boundsMax = glm::max(glm::max(boundsMax, p0), glm::max(p1, p2));
+
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f) normalSum += normal / length;
+		}
+
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		float radius = 0.0f;
+		for (size_t i = first; i < last; ++i)
+			radius = std::max(radius, glm::length(positions[indices[i]] - center));
+
+		// The cone has to contain every normal, degenerate triangles face nowhere and are ignored
+		float sumLength = glm::length(normalSum);
+		glm::vec3 axis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 0.0f, 1.0f);
+		float coneCos = sumLength > 0.0f ? 1.0f : 0.0f;
+		for (size_t i = first; i < last && coneCos > 0.0f; i += 3)
+		{
+			const glm::vec3& p0 = positions[indices[i + 0]];
+			glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+			float length = glm::length(normal);
+			if (length > 0.0f) coneCos = std::min(coneCos, glm::dot(axis, normal / length));
+		}
+		coneCos = std::max(coneCos, 0.0f);
+
+		result.centerX.push_back(center.x);
+		result.centerY.push_back(center.y);
+		result.centerZ.push_back(center.z);
+		result.radius.push_back(radius);
+		result.axisX.push_back(axis.x);
+		result.axisY.push_back(axis.y);
+		result.axisZ.push_back(axis.z);
+		result.coneCos.push_back(coneCos);
+		result.coneSin.push_back(std::sqrt(1.0f - coneCos * coneCos));
+		result.counts.push_back(static_cast<GLsizei>(last - first));
+		result.offsets.push_back(static_cast<GLintptr>(first * indexSize));
+		result.baseVertices.push_back(baseVertex);
+	}
+
+	MeshletSet Build(const std::vector<glm::vec3>& positions, const GLuint* indices, size_t indexCount, const OGLObject& meshGPU)
+	{
+		CPU_TRACE_SCOPE("Meshlets::Build");
+		MeshletSet result;
+		if (indexCount % 3 != 0) return result;
+
+		const size_t indexSize = IndexSize(meshGPU);
+
+		// A meshlet can't cross the 16 bit submeshes, they have different base vertices
+		std::vector<OGLSubmesh> ranges = meshGPU.submeshes;
+		if (ranges.empty()) ranges.push_back({ static_cast<GLsizei>(indexCount), 0, 0 });
+
+		// The vertices of the current meshlet are marked with its stamp
+		std::vector<uint32_t> stamps(positions.size(), 0);
+		uint32_t stamp = 1;
+
+		for (const OGLSubmesh& range : ranges)
+		{
+			// The index buffer can have more (the coarser levels of detail) after the indices of the meshlets
+			const size_t rangeFirst = range.indexOffset / indexSize;
+			const size_t rangeLast = std::min(rangeFirst + range.count, indexCount);
+			if (rangeFirst >= rangeLast) continue;
+
+			size_t first = rangeFirst;
+			size_t vertexCount = 0;
+			for (size_t i = rangeFirst; i < rangeLast; i += 3)
+			{
+				auto newVertices = [&]()
+				{
+					size_t count = 0;
+					for (size_t k = 0; k < 3; ++k)
+						if (stamps[indices[i + k]] != stamp && std::find(indices + i, indices + i + k, indices[i + k]) == indices + i + k) ++count;
+					return count;
+				};
+
+				size_t added = newVertices();
+				if (vertexCount + added > MaxVertices || (i - first) / 3 >= MaxTriangles)
+				{
+					AddMeshlet(result, positions, indices, first, i, indexSize, range.baseVertex);
+					first = i;
+					vertexCount = 0;
+					++stamp;
+					added = newVertices();
+				}
+
+				for (size_t k = 0; k < 3; ++k) stamps[indices[i + k]] = stamp;
+				vertexCount += added;
+			}
+			if (rangeLast > first) AddMeshlet(result, positions, indices, first, rangeLast, indexSize, range.baseVertex);
+			++stamp;
+		}
+		return result;
+	}
+
+	bool Matches(const MeshletSet& meshlets, size_t indexCount, const OGLObject& meshGPU)
+	{
+		const size_t indexSize = IndexSize(meshGPU);
+		std::vector<OGLSubmesh> ranges = meshGPU.submeshes;
+		if (ranges.empty()) ranges.push_back({ static_cast<GLsizei>(indexCount), 0, 0 });
+
+		for (size_t m = 0; m < meshlets.size(); ++m)
+		{
+			const GLsizei count = meshlets.counts[m];
+			const GLintptr offset = meshlets.offsets[m];
+			if (count <= 0 || count % 3 != 0 || offset < 0 || offset % indexSize != 0) return false;
+			const size_t first = static_cast<size_t>(offset) / indexSize;
+
+			auto inRange = [&](const OGLSubmesh& range)
+			{
+				const size_t rangeFirst = range.indexOffset / indexSize;
+				const size_t rangeLast = std::min(rangeFirst + range.count, indexCount);
+				return range.baseVertex == meshlets.baseVertices[m] && first >= rangeFirst && first <= rangeLast && static_cast<size_t>(count) <= rangeLast - first;
+			};
+			if (std::none_of(ranges.begin(), ranges.end(), inRange)) return false;
+		}
+		return true;
+	}
+
+	Frustum ExtractFrustum(const glm::mat4& viewProj)
+	{
+		// Gribb & Hartmann, the rows of the matrix give the clip planes (-w <= x, y, z <= w)
+		glm::mat4 rows = glm::transpose(viewProj);
+		Frustum frustum;
+		frustum.planes[0] = rows[3] + rows[0];
+		frustum.planes[1] = rows[3] - rows[0];
+		frustum.planes[2] = rows[3] + rows[1];
+		frustum.planes[3] = rows[3] - rows[1];
+		frustum.planes[4] = rows[3] + rows[2];
+		frustum.planes[5] = rows[3] - rows[2];
+		for (glm::vec4& plane : frustum.planes)
+			plane /= glm::length(glm::vec3(plane));
+		return frustum;
+	}
+
+	View PerspectiveView(const glm::mat4& viewProj, const glm::vec3& eye, float viewportHeight)
+	{
+		View view;
+		view.frusta.push_back(ExtractFrustum(viewProj));
+		view.eye = eye;
+		view.pixelsPerUnit = PixelsPerUnit(viewProj, viewportHeight);
+		return view;
+	}
+
+	float PixelsPerUnit(const glm::mat4& viewProj, float viewportHeight)
+	{
+		// The view matrix is a rigid transform, so the length of the clip space y row is the projection's y scale
+		glm::vec3 row = glm::vec3(viewProj[0][1], viewProj[1][1], viewProj[2][1]);
+		return glm::length(row) * viewportHeight * 0.5f;
+	}
+
+	void Draw(const OGLObject& meshGPU, const MeshletSet& meshlets, const glm::mat4& model, const View& view)
+	{
+		const size_t count = meshlets.size();
+		if (count == 0)
+		{
+			DrawOGLObject(meshGPU);
+			return;
+		}
+
+		// Rendering is single threaded, the scratch arrays are reused between the draws
+		static std::vector<uint8_t> visible;
+		static std::vector<GLsizei> drawCounts;
+		static std::vector<const void*> drawOffsets;
+		static std::vector<GLint> drawBaseVertices;
+		visible.assign(count, view.frusta.empty() ? 1 : 0);
+
+		const float* cx = meshlets.centerX.data();
+		const float* cy = meshlets.centerY.data();
+		const float* cz = meshlets.centerZ.data();
+		const float* r = meshlets.radius.data();
+
+		// Everything is tested in the mesh's space: a plane maps with the transpose of the model matrix,
+		// and which side of a triangle the eye is on doesn't change under an affine transform
+		const glm::mat4 modelTranspose = glm::transpose(model);
+		for (const Frustum& frustum : view.frusta)
+		{
+			glm::vec4 planes[6];
+			for (int p = 0; p < 6; ++p)
+			{
+				planes[p] = modelTranspose * frustum.planes[p];
+				planes[p] /= glm::length(glm::vec3(planes[p]));
+			}
+
+			for (size_t m = 0; m < count; ++m)
+			{
+				bool inside = true;
+				for (int p = 0; p < 6; ++p)
+					inside &= planes[p].x * cx[m] + planes[p].y * cy[m] + planes[p].z * cz[m] + planes[p].w >= -r[m];
+				visible[m] |= static_cast<uint8_t>(inside);
+			}
+		}
+
+		const float* ax = meshlets.axisX.data();
+		const float* ay = meshlets.axisY.data();
+		const float* az = meshlets.axisZ.data();
+		const float* coneCos = meshlets.coneCos.data();
+		const float* coneSin = meshlets.coneSin.data();
+
+		// A mirroring transform flips the winding, the cone test is skipped then
+		if (glm::determinant(glm::mat3(model)) > 0.0f)
+		{
+			const glm::mat4 toMesh = glm::inverse(model);
+			if (view.orthographic)
+			{
+				// Back facing if the angle between the direction and every normal is below 90 degrees
+				const glm::vec3 direction = glm::normalize(glm::vec3(toMesh * glm::vec4(view.direction, 0.0f)));
+				for (size_t m = 0; m < count; ++m)
+				{
+					float cosPhi = direction.x * ax[m] + direction.y * ay[m] + direction.z * az[m];
+					float sinPhi = std::sqrt(std::max(1.0f - cosPhi * cosPhi, 0.0f));
+					bool backFacing = coneCos[m] > 0.0f && cosPhi * coneCos[m] - sinPhi * coneSin[m] > 0.0f;
+					visible[m] &= static_cast<uint8_t>(!backFacing);
+				}
+			}
+			else
+			{
+				// Conservative over the bounding sphere: the eye has to be behind every triangle plane by more than the radius
+				const glm::vec3 eye = glm::vec3(toMesh * glm::vec4(view.eye, 1.0f));
+				for (size_t m = 0; m < count; ++m)
+				{
+					float dx = cx[m] - eye.x, dy = cy[m] - eye.y, dz = cz[m] - eye.z;
+					float distance2 = dx * dx + dy * dy + dz * dz;
+					float along = dx * ax[m] + dy * ay[m] + dz * az[m];
+					float across = std::sqrt(std::max(distance2 - along * along, 0.0f));
+					bool backFacing = coneCos[m] > 0.0f && along * coneCos[m] - across * coneSin[m] > r[m];
+					visible[m] &= static_cast<uint8_t>(!backFacing);
+				}
+			}
+		}
+
+		// Neighbouring visible meshlets are merged into one range
+		drawCounts.clear();
+		drawOffsets.clear();
+		drawBaseVertices.clear();
+		const size_t indexSize = IndexSize(meshGPU);
+		for (size_t m = 0; m < count; ++m)
+		{
+			if (!visible[m]) continue;
+			if (!drawCounts.empty() && drawBaseVertices.back() == meshlets.baseVertices[m] &&
+				reinterpret_cast<GLintptr>(drawOffsets.back()) + static_cast<GLintptr>(drawCounts.back() * indexSize) == meshlets.offsets[m])
+			{
+				drawCounts.back() += meshlets.counts[m];
+				continue;
+			}
+			drawCounts.push_back(meshlets.counts[m]);
+			drawOffsets.push_back(reinterpret_cast<const void*>(meshlets.offsets[m]));
+			drawBaseVertices.push_back(meshlets.baseVertices[m]);
+		}
+		if (drawCounts.empty()) return;
+
+		glBindVertexArray(meshGPU.vaoID);
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), meshGPU.indexType, drawOffsets.data(),
+			static_cast<GLsizei>(drawCounts.size()), drawBaseVertices.data());
+	}
+}
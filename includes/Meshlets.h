@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GLUtils.hpp"
+
+// Splits the index buffer of a mesh into meshlets, runs of about 64 vertices and 124 triangles,
+// each with a bounding sphere and a normal cone, so the parts of the mesh outside the view or facing away can be skipped.
+// The meshlets are consecutive ranges of the (cache optimized) index buffer, the buffer itself is not changed.
+namespace Meshlets
+{
+	constexpr size_t MaxVertices = 64;
+	constexpr size_t MaxTriangles = 124;
+
+	// Structure of arrays, so the culling loops vectorize. The bounds are in the mesh's own space.
+	struct MeshletSet
+	{
+		std::vector<float> centerX, centerY, centerZ, radius;
+		// Every triangle normal is within the cone around axis, its half angle is given by its cosine and sine.
+		// coneCos is 0 if the normals are too spread for the cone test
+		std::vector<float> axisX, axisY, axisZ, coneCos, coneSin;
+
+		// Draw ranges in the OGLObject's index buffer
+		std::vector<GLsizei> counts;
+		std::vector<GLintptr> offsets; // In bytes
+		std::vector<GLint> baseVertices;
+
+		size_t size() const { return counts.size(); }
+	};
+
+	// The positions are in the mesh's own space, the indices are the ones the OGLObject was created from.
+	// Only the first indexCount indices are split, the rest of the buffer (e.g. the coarser levels of detail) is left out
+	MeshletSet Build(const std::vector<glm::vec3>& positions, const GLuint* indices, size_t indexCount, const OGLObject& meshGPU);
+
+	// True if every draw range of the meshlets (e.g. read from a cache) lies within the first indexCount indices
+	// and in a single submesh with its base vertex, the ranges Build would split
+	bool Matches(const MeshletSet&, size_t indexCount, const OGLObject& meshGPU);
+
+	struct Frustum
+	{
+		glm::vec4 planes[6]; // Normalized, pointing inwards
+	};
+
+	// Planes of the clip volume of a (perspective or orthographic) view projection matrix
+	Frustum ExtractFrustum(const glm::mat4& viewProj);
+
+	// A view the meshes are drawn in, for the culling and the level of detail selection
+	struct View
+	{
+		std::vector<Frustum> frusta; // A meshlet is kept if it intersects any of them
+		// Back facing meshlets are culled as seen from eye, or along direction if orthographic
+		glm::vec3 eye = glm::vec3(0.0f);
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+		bool orthographic = false;
+
+		// Pixels covered by a unit long segment, at unit distance if perspective. 0 always draws the full detail
+		float pixelsPerUnit = 0.0f;
+		// The coarsest level of detail with a projected error below this many pixels is used
+		float lodThreshold = 1.0f;
+		// Keep the last level of the entity within a band around the threshold, so it doesn't flicker between two levels.
+		// Only for the camera: every light and probe is a view of its own, sharing one level per entity they'd undo each other's
+		bool lodHysteresis = true;
+	};
+
+	View PerspectiveView(const glm::mat4& viewProj, const glm::vec3& eye, float viewportHeight);
+
+	// Of a view projection matrix, for a viewport viewportHeight pixels high. Works for perspective and orthographic projections
+	float PixelsPerUnit(const glm::mat4& viewProj, float viewportHeight);
+
+	// Draws the meshlets of the mesh that are visible in the view, or the whole mesh if it has no meshlets.
+	// model maps the mesh's own space to world space (without the dequantization)
+	void Draw(const OGLObject& meshGPU, const MeshletSet& meshlets, const glm::mat4& model, const View& view);
+}
@@ -0,0 +1,211 @@
+#include "Mipmaps.h"
+#include "CPUTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include <SDL2/SDL_log.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MIPMAPS_SSE2
+#endif
+
+namespace Mipmaps
+{
+	namespace
+	{
+		// Resolution of the linear to sRGB table, fine enough that the dark end still rounds to the right code
+		constexpr int LinearSteps = 8192;
+
+		struct Tables
+		{
+			float toLinear[256]; // sRGB code to linear light
+			float toUnit[256];	 // Code / 255
+			uint8_t toSrgb[LinearSteps];
+		};
+
+		const Tables& GetTables()
+		{
+			static const Tables tables = []()
+			{
+				Tables result;
+				for (int code = 0; code < 256; ++code)
+				{
+					float c = code / 255.0f;
+					result.toLinear[code] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+					result.toUnit[code] = c;
+				}
+				for (int i = 0; i < LinearSteps; ++i)
+				{
+					float l = i / float(LinearSteps - 1);
+					float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+					result.toSrgb[i] = static_cast<uint8_t>(std::clamp(std::lround(c * 255.0f), 0l, 255l));
+				}
+				return result;
+			}();
+			return tables;
+		}
+
+		// Rows of the result in a band, the bands of a level are filtered in parallel
+		constexpr int BandRows = 32;
+		// Smaller levels are filtered on the calling thread, starting threads would cost more
+		constexpr size_t MinParallelTexels = 256 * 256;
+
+		template <bool Srgb>
+		void DownsampleRows(const ImageRGBA& source, ImageRGBA& result, int firstRow, int lastRow)
+		{
+			const Tables& tables = GetTables();
+			const float* colorTable = Srgb ? tables.toLinear : tables.toUnit;
+			// The sum of the four texels to the output code, or to the index in toSrgb
+			const float colorScale = Srgb ? (LinearSteps - 1) / 4.0f : 255.0f / 4.0f;
+
+			const uint8_t* src = reinterpret_cast<const uint8_t*>(source.pixels.data());
+			uint8_t* dst = reinterpret_cast<uint8_t*>(result.pixels.data());
+			for (int y = firstRow; y < lastRow; ++y)
+			{
+				const uint8_t* row0 = src + static_cast<size_t>(std::min(2 * y, source.height - 1)) * source.width * 4;
+				const uint8_t* row1 = src + static_cast<size_t>(std::min(2 * y + 1, source.height - 1)) * source.width * 4;
+				uint8_t* out = dst + static_cast<size_t>(y) * result.width * 4;
+				for (int x = 0; x < result.width; ++x, out += 4)
+				{
+					const int x0 = std::min(2 * x, source.width - 1) * 4, x1 = std::min(2 * x + 1, source.width - 1) * 4;
+					const uint8_t* texels[4] = { row0 + x0, row0 + x1, row1 + x0, row1 + x1 };
+
+#ifdef MIPMAPS_SSE2
+					__m128 sum = _mm_setzero_ps();
+					for (const uint8_t* texel : texels)
+						sum = _mm_add_ps(sum, _mm_setr_ps(colorTable[texel[0]], colorTable[texel[1]], colorTable[texel[2]], tables.toUnit[texel[3]]));
+					alignas(16) int32_t q[4];
+					_mm_store_si128(reinterpret_cast<__m128i*>(q), _mm_cvtps_epi32(_mm_mul_ps(sum, _mm_setr_ps(colorScale, colorScale, colorScale, 255.0f / 4.0f))));
+#else
+					float sum[4] = {};
+					for (const uint8_t* texel : texels)
+					{
+						for (int k = 0; k < 3; ++k) sum[k] += colorTable[texel[k]];
+						sum[3] += tables.toUnit[texel[3]];
+					}
+					int32_t q[4];
+					for (int k = 0; k < 4; ++k) q[k] = static_cast<int32_t>(std::lrint(sum[k] * (k < 3 ? colorScale : 255.0f / 4.0f)));
+#endif
+					for (int k = 0; k < 3; ++k) out[k] = Srgb ? tables.toSrgb[q[k]] : static_cast<uint8_t>(q[k]);
+					out[3] = static_cast<uint8_t>(q[3]);
+				}
+			}
+		}
+
+		ImageRGBA TestImage(int size)
+		{
+			ImageRGBA image;
+			image.width = image.height = size;
+			image.pixels.resize(static_cast<size_t>(size) * size);
+			for (int y = 0; y < size; ++y)
+				for (int x = 0; x < size; ++x)
+				{
+					uint32_t hash = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u;
+					hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+					image.pixels[static_cast<size_t>(y) * size + x] = (hash & 0x00FFFFFFu) | 0xFF000000u;
+				}
+			return image;
+		}
+	}
+
+	int LevelCount(int width, int height)
+	{
+		int levels = 1;
+		for (int size = std::max(width, height); size > 1; size /= 2) ++levels;
+		return levels;
+	}
+
+	ImageRGBA Downsample(const ImageRGBA& source, bool srgb, unsigned int threadCount)
+	{
+		ImageRGBA result;
+		result.width = std::max(1, source.width / 2);
+		result.height = std::max(1, source.height / 2);
+		result.pixels.resize(static_cast<size_t>(result.width) * result.height);
+
+		const int bandCount = (result.height + BandRows - 1) / BandRows;
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+		if (result.pixels.size() < MinParallelTexels) threadCount = 1;
+		threadCount = std::min(threadCount, static_cast<unsigned int>(bandCount));
+
+		std::atomic<int> nextBand = 0;
+		auto filterBands = [&]()
+		{
+			for (int band = nextBand++; band < bandCount; band = nextBand++)
+			{
+				const int firstRow = band * BandRows, lastRow = std::min(result.height, firstRow + BandRows);
+				if (srgb) DownsampleRows<true>(source, result, firstRow, lastRow);
+				else DownsampleRows<false>(source, result, firstRow, lastRow);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned int t = 1; t < threadCount; ++t) threads.emplace_back(filterBands);
+		filterBands();
+		for (std::thread& thread : threads) thread.join();
+		return result;
+	}
+
+	std::vector<ImageRGBA> BuildChain(const ImageRGBA& image, bool srgb, unsigned int threadCount)
+	{
+		CPU_TRACE_SCOPE("Mipmaps::BuildChain");
+		std::vector<ImageRGBA> levels;
+		levels.reserve(LevelCount(image.width, image.height) - 1);
+		for (const ImageRGBA* previous = &image; previous->width > 1 || previous->height > 1; previous = &levels.back())
+			levels.push_back(Downsample(*previous, srgb, threadCount));
+		return levels;
+	}
+
+	void Benchmark(int maxSize)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto milliseconds = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+		const unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+		for (int size = 1024; size <= maxSize; size *= 2)
+		{
+			const ImageRGBA image = TestImage(size);
+
+			// The old path: the rows flipped in a separate pass, mutable storage and glGenerateMipmap
+			ImageRGBA flipped = image;
+			GLuint texture = 0;
+			glGenTextures(1, &texture);
+			auto start = Clock::now();
+			for (int y = 0; y < size / 2; ++y)
+				std::swap_ranges(flipped.pixels.begin() + static_cast<size_t>(y) * size, flipped.pixels.begin() + static_cast<size_t>(y + 1) * size,
+					flipped.pixels.begin() + static_cast<size_t>(size - 1 - y) * size);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, flipped.pixels.data());
+			glGenerateMipmap(GL_TEXTURE_2D);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glFinish();
+			const double generateTime = milliseconds(start);
+			glDeleteTextures(1, &texture);
+
+			// The CPU chain on one thread, for the scaling
+			start = Clock::now();
+			BuildChain(image, true, 1);
+			const double serialChainTime = milliseconds(start);
+
+			// The CPU chain on every core, uploaded into storage allocated once for every level
+			start = Clock::now();
+			std::vector<ImageRGBA> chain = BuildChain(image);
+			const double chainTime = milliseconds(start);
+			glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+			glTextureStorage2D(texture, LevelCount(size, size), GL_RGBA8, size, size);
+			glTextureSubImage2D(texture, 0, 0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.data());
+			for (size_t level = 0; level < chain.size(); ++level)
+				glTextureSubImage2D(texture, static_cast<GLint>(level + 1), 0, 0, chain[level].width, chain[level].height, GL_RGBA, GL_UNSIGNED_BYTE, chain[level].pixels.data());
+			glFinish();
+			const double immutableTime = milliseconds(start);
+			glDeleteTextures(1, &texture);
+
+			SDL_Log("[Mipmaps] %5dx%-5d glTexImage2D + glGenerateMipmap: %8.1f ms, CPU chain + glTextureStorage2D: %8.1f ms %5.2fx (chain %.1f ms on %u threads, %.1f ms on 1)",
+				size, size, generateTime, immutableTime, generateTime / immutableTime, chainTime, threadCount, serialChainTime);
+		}
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "GLUtils.hpp"
+
+// CPU mip chains, so the textures can be allocated with their final size in immutable storage
+// and uploaded level by level instead of calling glGenerateMipmap after the upload.
+namespace Mipmaps
+{
+	// Levels of a full chain down to 1x1
+	int LevelCount(int width, int height);
+
+	// 2x2 box filter, the last row or column is repeated for odd sizes. With srgb the colors are averaged in linear light
+	// (the texels are sRGB encoded, the result too), alpha always as it is.
+	// Bands of rows are filtered on threadCount threads, 0 uses every core; small levels stay on the calling thread.
+	// The threads are started per call, from threads of a pool (e.g. the AssetLoader workers) pass 1
+	ImageRGBA Downsample(const ImageRGBA& source, bool srgb = true, unsigned int threadCount = 0);
+
+	// The levels after the image, down to 1x1, every level split across the threads like Downsample
+	std::vector<ImageRGBA> BuildChain(const ImageRGBA& image, bool srgb = true, unsigned int threadCount = 0);
+
+	// Logs the time of the glTexImage2D + glGenerateMipmap path and of the CPU chain uploaded to immutable storage
+	// for square textures from 1024 up to maxSize, and the chain on one thread against every core. Needs a current context
+	void Benchmark(int maxSize);
+}
@@ -1,22 +1,177 @@
 #include "ObjParser.h"
+#include "CPUTrace.h"
+#include "MappedFile.h"
 #include <array>
 #include <list>
 #include <string>
 #include <charconv>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
 
 #include <glm/gtx/norm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include "SDL2/SDL_log.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OBJPARSER_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OBJPARSER_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 using namespace std;
 
+// Whitespace as std::isspace classifies it in the "C" locale
+static constexpr std::array<bool, 256> SpaceTable = []()
+{
+	std::array<bool, 256> table = {};
+	for ( unsigned char c : { ' ', '\t', '\n', '\v', '\f', '\r' } ) table[ c ] = true;
+	return table;
+}();
+
+static inline bool isSpace( char c ) noexcept
+{
+	return SpaceTable[ static_cast<unsigned char>( c ) ];
+}
+
+static inline unsigned int firstSetBit( uint32_t mask ) noexcept
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward( &index, mask );
+	return index;
+#else
+	return __builtin_ctz( mask );
+#endif
+}
+
+// Scanners for the first newline / whitespace from p, 32 or 16 bytes at a time where the rest is long enough
+static const char* findNewline( const char* p, const char* end ) noexcept
+{
+#if defined(OBJPARSER_AVX2)
+	const __m256i newline32 = _mm256_set1_epi8( '\n' );
+	for ( ; end - p >= 32; p += 32 )
+	{
+		const __m256i bytes = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+		const uint32_t mask = static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( bytes, newline32 ) ) );
+		if ( mask ) return p + firstSetBit( mask );
+	}
+#endif
+#if defined(OBJPARSER_SSE2)
+	const __m128i newline = _mm_set1_epi8( '\n' );
+	for ( ; end - p >= 16; p += 16 )
+	{
+		const __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+		const uint32_t mask = static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( bytes, newline ) ) );
+		if ( mask ) return p + firstSetBit( mask );
+	}
+#endif
+	while ( p < end && *p != '\n' ) ++p;
+	return p;
+}
+
+static const char* findSpace( const char* p, const char* end ) noexcept
+{
+	// ' ' or '\t' ... '\r', the signed compares leave out the bytes above 127
+#if defined(OBJPARSER_AVX2)
+	const __m256i space32 = _mm256_set1_epi8( ' ' ), below32 = _mm256_set1_epi8( '\t' - 1 ), above32 = _mm256_set1_epi8( '\r' + 1 );
+	for ( ; end - p >= 32; p += 32 )
+	{
+		const __m256i bytes = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+		const __m256i control = _mm256_and_si256( _mm256_cmpgt_epi8( bytes, below32 ), _mm256_cmpgt_epi8( above32, bytes ) );
+		const uint32_t mask = static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_or_si256( _mm256_cmpeq_epi8( bytes, space32 ), control ) ) );
+		if ( mask ) return p + firstSetBit( mask );
+	}
+#endif
+#if defined(OBJPARSER_SSE2)
+	const __m128i space = _mm_set1_epi8( ' ' ), below = _mm_set1_epi8( '\t' - 1 ), above = _mm_set1_epi8( '\r' + 1 );
+	for ( ; end - p >= 16; p += 16 )
+	{
+		const __m128i bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+		const __m128i control = _mm_and_si128( _mm_cmpgt_epi8( bytes, below ), _mm_cmplt_epi8( bytes, above ) );
+		const uint32_t mask = static_cast<uint32_t>( _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( bytes, space ), control ) ) );
+		if ( mask ) return p + firstSetBit( mask );
+	}
+#endif
+	while ( p < end && !isSpace( *p ) ) ++p;
+	return p;
+}
+
+// Parses a decimal float at p like std::from_chars, returns the end of it, or nullptr if from_chars has to do it.
+// Up to 19 digits and below 2^53 the digits are exact in a double, and one multiplication or division by an exact
+// power of ten (up to 1e22) rounds correctly (Clinger's fast path). Rounding that double to float again only differs
+// from rounding the decimal directly when the double is exactly halfway between two floats, those are left to from_chars.
+static const char* parseFloatFast( const char* p, const char* end, float& value ) noexcept
+{
+	static constexpr double Powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+										 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	const bool negative = p < end && *p == '-';
+	if ( negative ) ++p;
+
+	uint64_t mantissa = 0;
+	const char* digits = p;
+	for ( ; p < end && static_cast<unsigned char>( *p - '0' ) < 10; ++p ) mantissa = mantissa * 10 + ( *p - '0' );
+	ptrdiff_t digitCount = p - digits;
+	int exponent = 0;
+
+	if ( p < end && *p == '.' )
+	{
+		const char* fraction = ++p;
+		for ( ; p < end && static_cast<unsigned char>( *p - '0' ) < 10; ++p ) mantissa = mantissa * 10 + ( *p - '0' );
+		exponent = -static_cast<int>( p - fraction );
+		digitCount += p - fraction;
+	}
+	if ( digitCount == 0 || digitCount > 19 ) return nullptr;
+
+	if ( p < end && ( *p == 'e' || *p == 'E' ) )
+	{
+		++p;
+		const bool negativeExponent = p < end && *p == '-';
+		if ( p < end && ( *p == '-' || *p == '+' ) ) ++p;
+		int explicitExponent = 0;
+		const char* exponentDigits = p;
+		for ( ; p < end && static_cast<unsigned char>( *p - '0' ) < 10 && p - exponentDigits < 4; ++p ) explicitExponent = explicitExponent * 10 + ( *p - '0' );
+		if ( p == exponentDigits || ( p < end && static_cast<unsigned char>( *p - '0' ) < 10 ) ) return nullptr;
+		exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+
+	if ( mantissa > ( uint64_t( 1 ) << 53 ) || exponent < -22 || exponent > 22 ) return nullptr;
+
+	double result = static_cast<double>( mantissa );
+	result = exponent < 0 ? result / Powers[ -exponent ] : result * Powers[ exponent ];
+
+	// 29 of the 52 fraction bits are dropped by the conversion, 1e-22 .. 2^53 * 1e22 is in the normal float range
+	uint64_t bits;
+	std::memcpy( &bits, &result, sizeof( bits ) );
+	if ( ( bits & 0x1FFFFFFF ) == 0x10000000 ) return nullptr;
+
+	value = negative ? -static_cast<float>( result ) : static_cast<float>( result );
+	return p;
+}
+
 class InMemoryTokenizer
 {
 public:
 	InMemoryTokenizer() = default;
 	void SetData( const char* ptr, size_t Length ) noexcept;
 	std::string_view NextToken( bool onlySameLine = false ) noexcept;
+	// Same as std::from_chars on NextToken( onlySameLine ) in one pass, value is unchanged if there is no number.
+	// Returns false if there was no token
+	bool NextFloat( float& value, bool onlySameLine = false ) noexcept;
 	void ToNextLine() noexcept;
+	unsigned short RecordType( std::string_view token ) const noexcept;
 	operator bool() const noexcept;
 private:
 	const char* currentPtr = nullptr;
@@ -31,8 +186,7 @@ void InMemoryTokenizer::SetData( const char* ptr, size_t Length ) noexcept
 
 std::string_view InMemoryTokenizer::NextToken( bool onlySameLine ) noexcept
 {
-	for ( ;currentPtr < endPtr 
-			&& std::isspace(static_cast<unsigned char>(*currentPtr) ); ++currentPtr )
+	for ( ;currentPtr < endPtr && isSpace( *currentPtr ); ++currentPtr )
 	{
 		if ( onlySameLine && *currentPtr == '\n' )
 		{
@@ -40,23 +194,38 @@ std::string_view InMemoryTokenizer::NextToken( bool onlySameLine ) noexcept
 		}
 	}
 	const char* tPtr = currentPtr;
-	std::size_t tLength = 0;
+	currentPtr = findSpace( currentPtr, endPtr );
 
-	while ( currentPtr < endPtr 
-			&& !std::isspace(static_cast<unsigned char>(*currentPtr) ) )
+	return std::string_view( tPtr, currentPtr - tPtr );
+}
+
+bool InMemoryTokenizer::NextFloat( float& value, bool onlySameLine ) noexcept
+{
+	for ( ;currentPtr < endPtr && isSpace( *currentPtr ); ++currentPtr )
+	{
+		if ( onlySameLine && *currentPtr == '\n' ) return false;
+	}
+	if ( currentPtr == endPtr ) return false;
+
+	// The number has to be the whole token, otherwise from_chars decides what the token means
+	float fastValue;
+	const char* numberEnd = parseFloatFast( currentPtr, endPtr, fastValue );
+	if ( numberEnd && ( numberEnd == endPtr || isSpace( *numberEnd ) ) )
 	{
-		currentPtr++;
-		tLength++;
+		value = fastValue;
+		currentPtr = numberEnd;
+		return true;
 	}
 
-	return std::string_view( tPtr, tLength );
+	const char* tokenEnd = findSpace( currentPtr, endPtr );
+	std::from_chars( currentPtr, tokenEnd, value );
+	currentPtr = tokenEnd;
+	return true;
 }
 
 void InMemoryTokenizer::ToNextLine() noexcept
 {
-	while ( currentPtr < endPtr && *currentPtr != '\n' )
-		currentPtr++;
-	currentPtr++;
+	currentPtr = findNewline( currentPtr, endPtr ) + 1;
 }
 
 InMemoryTokenizer::operator bool() const noexcept
@@ -71,26 +240,141 @@ constexpr unsigned short From2Char( const char ch1, const char ch2)
 	return sh;
 }
 
+// The first two characters of the token, e.g. "vn" or "v ", without reading past the buffer
+unsigned short InMemoryTokenizer::RecordType( std::string_view token ) const noexcept
+{
+	if ( token.size() > 1 ) return From2Char( token[ 0 ], token[ 1 ] );
+	const char* next = token.data() + token.size();
+	return From2Char( token[ 0 ], next < endPtr ? *next : '\n' );
+}
+
 static std::vector<unsigned int> triangulatePolygon( const std::vector<glm::vec2>& );
 
-ObjParser::Mesh ObjParser::parse(const std::filesystem::path& fileName)
+static glm::vec3 readVec3( InMemoryTokenizer& tokenizer ) noexcept
+{
+	glm::vec3 result( 0.0f );
+
+	tokenizer.NextFloat( result.x );
+	tokenizer.NextFloat( result.y );
+	tokenizer.NextFloat( result.z );
+
+	return result;
+}
+
+// v <x> <y> <z> [<w>]
+static glm::vec3 readPosition( InMemoryTokenizer& tokenizer ) noexcept
+{
+	glm::vec3 result = readVec3( tokenizer );
+
+	float w = 1.0f;
+	if ( tokenizer.NextFloat( w, true ) )
+	{
+		result.x /= w;
+		result.y /= w;
+		result.z /= w;
+	}
+
+	return result;
+}
+
+// vt <s> <t>
+static glm::vec2 readTexcoord( InMemoryTokenizer& tokenizer ) noexcept
+{
+	glm::vec2 result( 0.0f );
+
+	tokenizer.NextFloat( result.x );
+	tokenizer.NextFloat( result.y );
+
+	return result;
+}
+
+// std::from_chars for the face indices, without its overflow checks while the digits can't overflow
+static void parseIndex( const char* first, const char* last, uint32_t& value ) noexcept
+{
+	if ( last - first > 9 )
+	{
+		std::from_chars( first, last, value );
+		return;
+	}
+
+	uint32_t result = 0;
+	const char* p = first;
+	for ( ; p < last && static_cast<unsigned char>( *p - '0' ) < 10; ++p ) result = result * 10 + ( *p - '0' );
+	if ( p != first ) value = result;
+}
+
+static glm::vec3 faceNormal( const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2 )
+{
+	return glm::normalize( glm::cross( p1 - p0, p2 - p0 ) );
+}
+
+// State of the serial parse, so the input can also be fed in line aligned pieces
+struct ObjParser::SerialParser
 {
 	Mesh resultMesh;
 
 	std::vector<glm::vec3> positions;
 	std::vector<glm::vec3> normals;
 	std::vector<glm::vec2> texcoords;
+	std::vector<glm::vec3> generatedNormals; // See GeneratedNormal
 
 	std::vector<IndexedVert> face_vertIds;
-	face_vertIds.reserve( 4 );
-	bool needsNormalComputation = false;
-	std::unordered_map<IndexedVert, unsigned int, IndexedVertHash> vertexIndices;
+	// The first vertex of every position is kept by the position, only the other ones (on the seams) go to the map
+	struct PositionVertex
+	{
+		uint32_t index = 0; // 1 + the vertex index, 0 if the position has no vertex yet
+		uint32_t vt = 0, vn = 0;
+	};
+	std::vector<PositionVertex> positionVertices;
+	VertexMap<unsigned int> vertexIndices;
+
+	unsigned int nIndexedVerts = 0;
+
+	// If set, every face corner is appended in lookup order (for the dedup benchmark)
+	std::vector<IndexedVert>* corners = nullptr;
+
+	// From the first face that refers to a v, vt or vn line further down, the faces wait for Finish,
+	// so that every vertex is still numbered in the order of the faces
+	struct DeferredFace
+	{
+		uint32_t first;
+		uint32_t count;
+		size_t normalSlot; // Of the first generated normal, if needed
+		bool needsNormals;
+	};
+	std::vector<IndexedVert> deferredVerts;
+	std::vector<DeferredFace> deferredFaces;
+
+	void Parse( const char* data, size_t size );
+	// Resolves the deferred faces, once the whole file went through Parse
+	void Finish();
+	void AddFace( std::vector<IndexedVert>& face, bool needsNormals, size_t normalSlot );
+};
+
+size_t ObjParser::StreamingThreshold = size_t(1) << 30;
+
+ObjParser::Mesh ObjParser::parse( const std::filesystem::path& fileName, unsigned int threadCount )
+{
+	CPU_TRACE_SCOPE("ObjParser::parse");
+
+	if ( threadCount == 0 ) threadCount = std::max( 1u, std::thread::hardware_concurrency() );
 
 	std::error_code ec;
 	std::size_t fileSize = std::filesystem::file_size( fileName, ec );
 
 	if ( ec ) throw(EXC_FILENOTFOUND);
 
+	// Mapped or copied, the pages of a huge file would compete with the result for memory, read it in pieces instead
+	if ( fileSize > StreamingThreshold ) return parseStreaming( fileName );
+
+	// Zero copy, the tokenizer reads the mapped pages directly
+	MappedFile objFile;
+	if ( objFile.Open( fileName ) )
+	{
+		if ( threadCount > 1 ) return parseParallel( objFile.Data(), objFile.Size(), threadCount );
+		return parseSerial( objFile.Data(), objFile.Size() );
+	}
+
 	std::vector<char> objRawData( fileSize );
 
 	std::ifstream objFileStrm( fileName, std::ios::binary );
@@ -99,15 +383,324 @@ ObjParser::Mesh ObjParser::parse(const std::filesystem::path& fileName)
 
 	objFileStrm.read( objRawData.data(), fileSize );
 
-	InMemoryTokenizer tokenizer;
+	if ( threadCount > 1 ) return parseParallel( objRawData.data(), fileSize, threadCount );
+	return parseSerial( objRawData.data(), fileSize );
+}
 
-	tokenizer.SetData( objRawData.data(), fileSize );
+ObjParser::Mesh ObjParser::parseStreaming( const std::filesystem::path& fileName, size_t windowSize )
+{
+	CPU_TRACE_SCOPE("ObjParser::parseStreaming");
 
-	unsigned int nIndexedVerts = 0;
+	std::ifstream objFileStrm( fileName, std::ios::binary );
+
+	if ( !objFileStrm ) throw(EXC_FILENOTFOUND);
+
+	SerialParser parser;
+	std::vector<char> window( windowSize );
+	size_t carried = 0; // Start of an unfinished line from the previous window
+
+	while ( objFileStrm )
+	{
+		// A line longer than the window, let it grow
+		if ( carried == window.size() ) window.resize( window.size() * 2 );
+
+		objFileStrm.read( window.data() + carried, window.size() - carried );
+		const size_t filled = carried + static_cast<size_t>( objFileStrm.gcount() );
+
+		size_t complete = filled;
+		if ( objFileStrm )
+		{
+			while ( complete > 0 && window[ complete - 1 ] != '\n' ) --complete;
+			if ( complete == 0 )
+			{
+				carried = filled;
+				continue;
+			}
+		}
+
+		parser.Parse( window.data(), complete );
+
+		carried = filled - complete;
+		std::copy( window.begin() + complete, window.begin() + filled, window.begin() );
+	}
+
+	parser.Finish();
+	return std::move( parser.resultMesh );
+}
+
+// f (<pi>[/<ti>][/<ni>])3+
+// Returns true if a vertex had no normal index, the face normals have to be computed then
+bool ObjParser::readFace( InMemoryTokenizer& tokenizer, std::vector<IndexedVert>& face_vertIds )
+{
+	face_vertIds.clear();
+	bool needsNormalComputation = false;
+
+	std::string_view faceVertT = tokenizer.NextToken( true );
+	while ( !faceVertT.empty() )
+	{
+		face_vertIds.emplace_back( IndexedVert{} );
+		IndexedVert& idxVert = face_vertIds.back();
+
+		size_t posEndOffs = faceVertT.find_first_of( '/', 0 );
+		if ( posEndOffs == std::string_view::npos ) posEndOffs = faceVertT.size();
+
+		parseIndex( faceVertT.data(), faceVertT.data() + posEndOffs, idxVert.v );
+		idxVert.v--;
+
+		size_t texStartOffs = posEndOffs + 1;
+		size_t texEndOffs = faceVertT.find_first_of( '/', texStartOffs );
+		if ( texEndOffs == std::string_view::npos ) texEndOffs = faceVertT.size();
+		if ( texEndOffs > texStartOffs ) parseIndex( faceVertT.data() + texStartOffs, faceVertT.data() + texEndOffs, idxVert.vt );
+		if ( idxVert.vt ) idxVert.vt--; 
+		size_t normStartOffs = texEndOffs + 1;
+
+		if ( faceVertT.size() > normStartOffs )
+		{
+			parseIndex( faceVertT.data() + normStartOffs, faceVertT.data() + faceVertT.size(), idxVert.vn );
+			idxVert.vn--;
+		}
+		else needsNormalComputation = true;
+		
+		faceVertT = tokenizer.NextToken( true );
+	}
+
+	return needsNormalComputation;
+}
+
+// Splits polygons with more than 3 vertices to triangles, keeping the CCW orientation
+void ObjParser::triangulateFace( std::vector<IndexedVert>& face_vertIds, const std::vector<glm::vec3>& positions )
+{
+	if ( 3 < face_vertIds.size() )
+	{
+		std::vector<IndexedVert> face_vertIdsFace2Tris;
+		if ( 4 == face_vertIds.size() )
+		{
+			glm::vec3 v10 = positions[ face_vertIds[ 0 ].v ] - positions[ face_vertIds[ 1 ].v ];
+			glm::vec3 v12 = positions[ face_vertIds[ 2 ].v ] - positions[ face_vertIds[ 1 ].v ];
+
+			glm::vec3 v32 = positions[ face_vertIds[ 2 ].v ] - positions[ face_vertIds[ 3 ].v ];
+			glm::vec3 v30 = positions[ face_vertIds[ 0 ].v ] - positions[ face_vertIds[ 3 ].v ];
+
+			float angle_012 = ::acosf( glm::dot(v10,v12) / sqrtf( glm::dot(v10,v10) * glm::dot(v12,v12) ) );
+			float angle_230 = ::acosf( glm::dot(v32,v30) / sqrtf( glm::dot(v32,v32) * glm::dot(v30,v30) ) );
+			
+			if ( ( angle_012 + angle_230 ) <= glm::pi<float>() )
+			{
+				face_vertIdsFace2Tris =
+				{ face_vertIds[ 0 ], face_vertIds[ 1 ], face_vertIds[ 2 ],
+				  face_vertIds[ 0 ], face_vertIds[ 2 ], face_vertIds[ 3 ] };
+			}
+			else
+			{
+				face_vertIdsFace2Tris =
+				{ face_vertIds[ 0 ], face_vertIds[ 1 ], face_vertIds[ 3 ],
+				  face_vertIds[ 1 ], face_vertIds[ 2 ], face_vertIds[ 3 ] };
+			}
+		}
+		else 
+		{
+			// Calculate the best fitting plane
+			glm::vec3 MidPoint( 0.0 );
+			for ( const auto& vertex : face_vertIds )
+			{
+				MidPoint += positions[ vertex.v ];
+			}
+			MidPoint /= float( face_vertIds.size() );
+
+			std::vector<glm::vec3> centeredPoints( face_vertIds.size() );
+
+			std::transform( face_vertIds.cbegin(), face_vertIds.cend(), centeredPoints.begin(),
+							[&positions,MidPoint]( const IndexedVert& faceV )->glm::vec3
+							{ return positions[ faceV.v ] - MidPoint;}
+							);
+
+			float cov_xx = 0.0f, cov_xy = 0.0f;
+			float cov_yy = 0.0f, cov_yz = 0.0f;
+			float cov_xz = 0.0f, cov_zz = 0.0f;
+
+			for ( const glm::vec3& centeredP : centeredPoints )
+			{
+				cov_xx += centeredP.x * centeredP.x;
+				cov_xy += centeredP.x * centeredP.y;
+				
+				cov_yy += centeredP.y * centeredP.y;
+				cov_yz += centeredP.y * centeredP.z;
+
+				cov_xz += centeredP.x * centeredP.z;
+				cov_zz += centeredP.z * centeredP.z;
+			}
+
+			// viktor-vad: Very strange, but the pca.hpp and pca.inc disappeared from glm/gtx.
+			// Did not find any explanation for this.
+			// Instead of some header file copy-hacking, I implemented a 3x3 verion of eigen decomposition.
+			// It was not intended, but most likely it is faster than the original glm pca, since that is a general method with Housholder and QR.
+			// https://dl.acm.org/doi/epdf/10.1145/355578.366316
+			// https://en.wikipedia.org/wiki/Eigenvalue_algorithm#2%C3%972_matrices
+			glm::vec3 eigenVectors[2];
+			{
+				glm::vec3 eigenVectors_[3];
+				float p1 = cov_xy * cov_xy + cov_xz * cov_xz + cov_yz * cov_yz;
+				float trC = cov_xx + cov_yy + cov_zz;
+				float eig1 = 0.0f, eig2 = 0.0f, eig3 = 0.0f;
+
+				// normal case
+				if ( p1 > 1e-15f )
+				{
+					float q = trC / 3.0f;
+					float p2 = ( cov_xx - q ) * ( cov_xx - q ) + ( cov_yy - q ) * ( cov_yy - q ) + ( cov_zz - q ) * ( cov_zz - q ) + 2.0f * p1;
+					float p = std::sqrt( p2 / 6.0f );
+
+					float cov_xx_q = cov_xx - q;
+					float cov_yy_q = cov_yy - q;
+					float cov_zz_q = cov_zz - q;
+
+					float r = glm::clamp( ( cov_xx_q * cov_yy_q * cov_zz_q + 2.0f * cov_xy * cov_yz * cov_xz - cov_xx_q * cov_yz * cov_yz - cov_yy_q * cov_xz * cov_xz - cov_zz_q * cov_xy * cov_xy ) / ( 2.0f * p * p * p ),
+										  -1.0f, 1.0f );
+
+					float phi = ::acosf( r ) / 3.0f;
+
+					eig1 = q + 2.0f * p * std::cos( phi );
+					eig2 = q + 2.0f * p * std::cos( phi + ( 2.0f * glm::pi<float>() / 3.0f ) );
+					eig3 = trC - eig1 - eig2;
+				}
+				else // covariance matrix is numericaly diagonal. We assume eigen values are the diagonal values.
+				{
+					eig1 = std::max( { cov_xx, cov_yy, cov_zz } );
+					eig3 = std::min( { cov_xx, cov_yy, cov_zz } );
+					eig2 = trC - eig1 - eig2;
+				}
+
+				eigenVectors_[ 0 ] = glm::vec3( cov_xy * cov_xy + cov_xz * cov_xz + ( cov_xx - eig2 ) * ( cov_xx - eig3 ),
+											   cov_xy * ( ( cov_xx - eig3 ) + ( cov_yy - eig2 ) ) + cov_xz * cov_yz,
+											   cov_xz * ( ( cov_xx - eig3 ) + ( cov_zz - eig2 ) ) + cov_xy * cov_yz );
+
+				eigenVectors_[ 1 ] = glm::vec3( cov_xy * ( ( cov_xx - eig1 ) + ( cov_yy - eig3 ) ) + cov_xz * cov_yz,
+											   cov_yz * cov_yz + cov_xy * cov_xy + ( cov_yy - eig1 ) * ( cov_yy - eig3 ),
+											   cov_yz * ( ( cov_yy - eig3 ) + ( cov_zz - eig1 ) ) + cov_xy * cov_xz );
+
+				eigenVectors_[ 2 ] = glm::vec3( cov_xz * ( ( cov_xx - eig1 ) + ( cov_zz - eig2 ) ) + cov_xy * cov_yz,
+											   cov_yz * ( ( cov_yy - eig1 ) + ( cov_zz - eig2 ) ) + cov_xy * cov_xz,
+											   cov_yz * cov_yz + cov_xz * cov_xz + ( cov_zz - eig1 ) * ( cov_zz - eig2 ) );
+				
+				// Simplification of original method.
+				// We only need the first 2 eigen vectors for 2D projection.
+				// Therefor we are not intereted, which is bigger, but in leaving the smallest out.
+				float minEig = std::min( { eig1, eig2, eig3 } );
+
+				if ( eig3 == minEig )
+				{
+					eigenVectors[ 0 ] = glm::normalize( eigenVectors_[ 0 ] );
+					eigenVectors[ 1 ] = glm::normalize( eigenVectors_[ 1 ] );
+				}
+				else if ( eig2 == minEig )
+				{
+                    eigenVectors[ 0 ] = glm::normalize( eigenVectors_[ 0 ] );
+                    eigenVectors[ 1 ] = glm::normalize( eigenVectors_[ 2 ] );
+                }
+				else //if ( eig1 == minEig ) most unlikly case
+				{
+                    eigenVectors[ 0 ] = glm::normalize( eigenVectors_[ 1 ] );
+                    eigenVectors[ 1 ] = glm::normalize( eigenVectors_[ 2 ] );
+                }
+			}
+
+			std::vector<glm::vec2> facePointsProjected( face_vertIds.size() );
+			
+
+			std::transform(centeredPoints.cbegin(),centeredPoints.cend(),facePointsProjected.begin(),
+							[ &eigenVectors ]( const glm::vec3& cp )->glm::vec2
+							{
+								return glm::vec2(
+									glm::dot( cp, eigenVectors[0] ),
+									glm::dot( cp, eigenVectors[1] )
+								);
+							} );
+
+			// checking the orientation. CCW should be kept
+			float sum = 0.0;
+			for ( int i = 0; i < facePointsProjected.size() - 1; ++i )
+			{
+				sum += ( facePointsProjected[ i + 1 ].x - facePointsProjected[ i ].x ) *
+					( facePointsProjected[ i + 1 ].y + facePointsProjected[ i ].y );
+			}
+			sum += ( facePointsProjected.front().x - facePointsProjected.back().x ) *
+				( facePointsProjected.front().y + facePointsProjected.back().y );
+
+			if ( sum > 0.0f )
+			{
+				for ( int i = 0; i < facePointsProjected.size(); ++i )
+					facePointsProjected[ i ].y *= -1.0f;
+			}
+
+			std::vector<unsigned int> triIndices = triangulatePolygon( facePointsProjected );
+			
+			face_vertIdsFace2Tris.resize( triIndices.size() );
+			std::transform( triIndices.cbegin(), triIndices.cend(), face_vertIdsFace2Tris.begin(),
+							[ &face_vertIds ]( const unsigned int fTriId )->IndexedVert
+							{
+								return face_vertIds[ fTriId ];
+							} );
+
+		}
+		face_vertIds = std::move( face_vertIdsFace2Tris );
+	}
+
+}
+
+// Number of v records, to size the positions and the dedup tables before the parse. Every position is used by at least
+// one vertex normally, so it is a lower bound that doesn't overshoot on closed meshes. Indented records are missed, it is only an estimate
+static size_t countPositions( const char* data, size_t size )
+{
+	auto isPositionLine = [ & ]( const char* line )
+	{
+		return data + size - line > 1 && line[ 0 ] == 'v' && ( line[ 1 ] == ' ' || line[ 1 ] == '\t' );
+	};
+
+	size_t count = isPositionLine( data ) ? 1 : 0;
+	const char* p = data;
+	const char* const end = data + size;
+#if defined(OBJPARSER_SSE2)
+	// "\nv " or "\nv\t" starting in the block
+	const __m128i newline = _mm_set1_epi8( '\n' ), v = _mm_set1_epi8( 'v' ), space = _mm_set1_epi8( ' ' ), tab = _mm_set1_epi8( '\t' );
+	for ( ; end - p >= 18; p += 16 )
+	{
+		const __m128i first = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+		const __m128i second = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + 1 ) );
+		const __m128i third = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + 2 ) );
+		const __m128i separator = _mm_or_si128( _mm_cmpeq_epi8( third, space ), _mm_cmpeq_epi8( third, tab ) );
+		uint32_t mask = static_cast<uint32_t>( _mm_movemask_epi8( _mm_and_si128( _mm_and_si128( _mm_cmpeq_epi8( first, newline ), _mm_cmpeq_epi8( second, v ) ), separator ) ) );
+		for ( ; mask; mask &= mask - 1 ) ++count;
+	}
+#endif
+	for ( ; p < end; ++p )
+		if ( *p == '\n' && isPositionLine( p + 1 ) ) ++count;
+	return count;
+}
+
+ObjParser::Mesh ObjParser::parseSerial( const char* data, size_t size )
+{
+	SerialParser parser;
+	const size_t positionCount = countPositions( data, size );
+	parser.positions.reserve( positionCount );
+	parser.positionVertices.reserve( positionCount );
+	parser.Parse( data, size );
+	parser.Finish();
+	return std::move( parser.resultMesh );
+}
+
+void ObjParser::SerialParser::Parse( const char* data, size_t size )
+{
+	face_vertIds.reserve( 4 );
+	bool needsNormalComputation = false;
+
+	InMemoryTokenizer tokenizer;
+
+	tokenizer.SetData( data, size );
 
 	while ( tokenizer )
 	{
 		std::string_view token = tokenizer.NextToken();
+		if ( token.empty() ) break; // trailing white space
 
 		if ( token[ 0 ] == '#' )
 		{
@@ -115,7 +708,7 @@ ObjParser::Mesh ObjParser::parse(const std::filesystem::path& fileName)
 			continue;
 		}
 
-		switch ( *reinterpret_cast<const unsigned short*>( token.data() ) )
+		switch ( tokenizer.RecordType( token ) )
 		{
 			case From2Char('m','t'): //mtllib <.mtl file>
 			{
@@ -141,312 +734,589 @@ ObjParser::Mesh ObjParser::parse(const std::filesystem::path& fileName)
 			case From2Char('v',' '):
 			case From2Char('v','\t'): // v <x> <y> <z> [<w>]
 			{
-				positions.emplace_back(glm::vec3());
-
-				float& x = positions.back().x;
-				float& y = positions.back().y;
-				float& z = positions.back().z;
-
-				std::string_view coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), x );
-				coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), y );
-				coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), z );
-				coordT = tokenizer.NextToken(true);
-
-				if ( !coordT.empty() )
-				{
-					float w;
-					std::from_chars( coordT.data(), coordT.data() + coordT.size(), w );
-					x /= w;
-					y /= w;
-					z /= w;
-				}
+				positions.push_back( readPosition( tokenizer ) );
 			}break;
 			case From2Char('v','n'): // vn <nx> <ny> <nz>
 			{
-				normals.emplace_back(glm::vec3());
-
-				float& x = normals.back().x;
-				float& y = normals.back().y;
-				float& z = normals.back().z;
-
-				std::string_view coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), x );
-				coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), y );
-				coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), z );
-				
+				normals.push_back( readVec3( tokenizer ) );
 			}break;
 			case From2Char('v','t'): // vt <s> <t>
 			{
-				texcoords.emplace_back(glm::vec2());
-
-				float& s = texcoords.back().x;
-				float& t = texcoords.back().y;
-
-				std::string_view coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), s );
-				coordT = tokenizer.NextToken();
-				std::from_chars( coordT.data(), coordT.data() + coordT.size(), t );
-	
+				texcoords.push_back( readTexcoord( tokenizer ) );
 			}break;
 			case From2Char('f',' '):
 			case From2Char('f','\t'): // f (<pi>[/<ti>][/<ni>])3+
 			{
-				face_vertIds.clear();
-				needsNormalComputation = false;
+				needsNormalComputation = readFace( tokenizer, face_vertIds );
+
+				if ( texcoords.empty() ) texcoords.emplace_back( glm::vec2( 0.0 ) );
+
+				// A polygon is always split to count - 2 triangles, their normals get slots in the order of the faces
+				const size_t normalSlot = generatedNormals.size();
+				if ( needsNormalComputation && face_vertIds.size() >= 3 ) generatedNormals.resize( generatedNormals.size() + face_vertIds.size() - 2 );
 
-				std::string_view faceVertT = tokenizer.NextToken( true );
-				while ( !faceVertT.empty() )
+				bool forward = !deferredFaces.empty();
+				for ( const auto& vertex : face_vertIds )
+					forward = forward || vertex.v >= positions.size() || vertex.vt >= texcoords.size() || ( !needsNormalComputation && vertex.vn >= normals.size() );
+
+				if ( forward )
 				{
-					face_vertIds.emplace_back( IndexedVert{} );
-					IndexedVert& idxVert = face_vertIds.back();
-
-					size_t posEndOffs = faceVertT.find_first_of( '/', 0 );
-					if ( posEndOffs == std::string_view::npos ) posEndOffs = faceVertT.size();
-
-					std::from_chars( faceVertT.data(), faceVertT.data() + posEndOffs, idxVert.v );
-					idxVert.v--;
-
-					size_t texStartOffs = posEndOffs + 1;
-					size_t texEndOffs = faceVertT.find_first_of( '/', texStartOffs );
-					if ( texEndOffs == std::string_view::npos ) texEndOffs = faceVertT.size();
-					if ( texEndOffs > texStartOffs ) std::from_chars( faceVertT.data() + texStartOffs, faceVertT.data() + texEndOffs, idxVert.vt);
-					if ( idxVert.vt ) idxVert.vt--; 
-					size_t normStartOffs = texEndOffs + 1;
-
-					if ( faceVertT.size() > normStartOffs )
-					{
-						std::from_chars( faceVertT.data() + normStartOffs, faceVertT.data() + faceVertT.size(), idxVert.vn );
-						idxVert.vn--;
-					}
-					else needsNormalComputation = true;
-					
-					faceVertT = tokenizer.NextToken( true );
+					deferredFaces.push_back( { static_cast<uint32_t>( deferredVerts.size() ), static_cast<uint32_t>( face_vertIds.size() ), normalSlot, needsNormalComputation } );
+					deferredVerts.insert( deferredVerts.end(), face_vertIds.begin(), face_vertIds.end() );
 				}
+				else AddFace( face_vertIds, needsNormalComputation, normalSlot );
+			}break;
+		}
 
-				if ( 3 < face_vertIds.size() )
-				{
-					std::vector<IndexedVert> face_vertIdsFace2Tris;
-					if ( 4 == face_vertIds.size() )
-					{
-						glm::vec3 v10 = positions[ face_vertIds[ 0 ].v ] - positions[ face_vertIds[ 1 ].v ];
-						glm::vec3 v12 = positions[ face_vertIds[ 2 ].v ] - positions[ face_vertIds[ 1 ].v ];
-
-						glm::vec3 v32 = positions[ face_vertIds[ 2 ].v ] - positions[ face_vertIds[ 3 ].v ];
-						glm::vec3 v30 = positions[ face_vertIds[ 0 ].v ] - positions[ face_vertIds[ 3 ].v ];
-
-						float angle_012 = ::acosf( glm::dot(v10,v12) / sqrtf( glm::dot(v10,v10) * glm::dot(v12,v12) ) );
-						float angle_230 = ::acosf( glm::dot(v32,v30) / sqrtf( glm::dot(v32,v32) * glm::dot(v30,v30) ) );
-						
-						if ( ( angle_012 + angle_230 ) <= glm::pi<float>() )
-						{
-							face_vertIdsFace2Tris =
-							{ face_vertIds[ 0 ], face_vertIds[ 1 ], face_vertIds[ 2 ],
-							  face_vertIds[ 0 ], face_vertIds[ 2 ], face_vertIds[ 3 ] };
-						}
-						else
-						{
-							face_vertIdsFace2Tris =
-							{ face_vertIds[ 0 ], face_vertIds[ 1 ], face_vertIds[ 3 ],
-							  face_vertIds[ 1 ], face_vertIds[ 2 ], face_vertIds[ 3 ] };
-						}
-					}
-					else 
-					{
-						// Calculate the best fitting plane
-						glm::vec3 MidPoint( 0.0 );
-						for ( const auto& vertex : face_vertIds )
-						{
-							MidPoint += positions[ vertex.v ];
-						}
-						MidPoint /= float( face_vertIds.size() );
-
-						std::vector<glm::vec3> centeredPoints( face_vertIds.size() );
-
-						std::transform( face_vertIds.cbegin(), face_vertIds.cend(), centeredPoints.begin(),
-										[&positions,MidPoint]( const IndexedVert& faceV )->glm::vec3
-										{ return positions[ faceV.v ] - MidPoint;}
-										);
-
-						float cov_xx = 0.0f, cov_xy = 0.0f;
-						float cov_yy = 0.0f, cov_yz = 0.0f;
-						float cov_xz = 0.0f, cov_zz = 0.0f;
-
-						for ( const glm::vec3& centeredP : centeredPoints )
-						{
-							cov_xx += centeredP.x * centeredP.x;
-							cov_xy += centeredP.x * centeredP.y;
-							
-							cov_yy += centeredP.y * centeredP.y;
-							cov_yz += centeredP.y * centeredP.z;
-
-							cov_xz += centeredP.x * centeredP.z;
-							cov_zz += centeredP.z * centeredP.z;
-						}
-
-						// viktor-vad: Very strange, but the pca.hpp and pca.inc disappeared from glm/gtx.
-						// Did not find any explanation for this.
-						// Instead of some header file copy-hacking, I implemented a 3x3 verion of eigen decomposition.
-						// It was not intended, but most likely it is faster than the original glm pca, since that is a general method with Housholder and QR.
-						// https://dl.acm.org/doi/epdf/10.1145/355578.366316
-						// https://en.wikipedia.org/wiki/Eigenvalue_algorithm#2%C3%972_matrices
-						glm::vec3 eigenVectors[2];
-						{
-							glm::vec3 eigenVectors_[3];
-							float p1 = cov_xy * cov_xy + cov_xz * cov_xz + cov_yz * cov_yz;
-							float trC = cov_xx + cov_yy + cov_zz;
-							float eig1 = 0.0f, eig2 = 0.0f, eig3 = 0.0f;
-
-							// normal case
-							if ( p1 > 1e-15f )
-							{
-								float q = trC / 3.0f;
-								float p2 = ( cov_xx - q ) * ( cov_xx - q ) + ( cov_yy - q ) * ( cov_yy - q ) + ( cov_zz - q ) * ( cov_zz - q ) + 2.0f * p1;
-								float p = std::sqrt( p2 / 6.0f );
+		tokenizer.ToNextLine();
+	}
+}
 
-								float cov_xx_q = cov_xx - q;
-								float cov_yy_q = cov_yy - q;
-								float cov_zz_q = cov_zz - q;
+void ObjParser::SerialParser::Finish()
+{
+	std::vector<IndexedVert> face;
+	for ( const DeferredFace& deferred : deferredFaces )
+	{
+		face.assign( deferredVerts.begin() + deferred.first, deferredVerts.begin() + deferred.first + deferred.count );
 
-								float r = glm::clamp( ( cov_xx_q * cov_yy_q * cov_zz_q + 2.0f * cov_xy * cov_yz * cov_xz - cov_xx_q * cov_yz * cov_yz - cov_yy_q * cov_xz * cov_xz - cov_zz_q * cov_xy * cov_xy ) / ( 2.0f * p * p * p ),
-													  -1.0f, 1.0f );
+		// Still out of range with the whole file read, the file is broken
+		if ( faceInRange( face.data(), face.size(), deferred.needsNormals, positions.size(), texcoords.size(), normals.size() ) )
+			AddFace( face, deferred.needsNormals, deferred.normalSlot );
+	}
+	deferredVerts = {};
+	deferredFaces = {};
+}
 
-								float phi = ::acosf( r ) / 3.0f;
+bool ObjParser::faceInRange( const IndexedVert* corners, size_t count, bool needsNormals, size_t positionCount, size_t texcoordCount, size_t normalCount )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const IndexedVert& vertex = corners[ i ];
+		if ( vertex.v >= positionCount || vertex.vt >= texcoordCount || ( !needsNormals && vertex.vn >= normalCount ) ) return false;
+	}
+	return true;
+}
 
-								eig1 = q + 2.0f * p * std::cos( phi );
-								eig2 = q + 2.0f * p * std::cos( phi + ( 2.0f * glm::pi<float>() / 3.0f ) );
-								eig3 = trC - eig1 - eig2;
-							}
-							else // covariance matrix is numericaly diagonal. We assume eigen values are the diagonal values.
-							{
-								eig1 = std::max( { cov_xx, cov_yy, cov_zz } );
-								eig3 = std::min( { cov_xx, cov_yy, cov_zz } );
-								eig2 = trC - eig1 - eig2;
-							}
-
-							eigenVectors_[ 0 ] = glm::vec3( cov_xy * cov_xy + cov_xz * cov_xz + ( cov_xx - eig2 ) * ( cov_xx - eig3 ),
-														   cov_xy * ( ( cov_xx - eig3 ) + ( cov_yy - eig2 ) ) + cov_xz * cov_yz,
-														   cov_xz * ( ( cov_xx - eig3 ) + ( cov_zz - eig2 ) ) + cov_xy * cov_yz );
-
-							eigenVectors_[ 1 ] = glm::vec3( cov_xy * ( ( cov_xx - eig1 ) + ( cov_yy - eig3 ) ) + cov_xz * cov_yz,
-														   cov_yz * cov_yz + cov_xy * cov_xy + ( cov_yy - eig1 ) * ( cov_yy - eig3 ),
-														   cov_yz * ( ( cov_yy - eig3 ) + ( cov_zz - eig1 ) ) + cov_xy * cov_xz );
-
-							eigenVectors_[ 2 ] = glm::vec3( cov_xz * ( ( cov_xx - eig1 ) + ( cov_zz - eig2 ) ) + cov_xy * cov_yz,
-														   cov_yz * ( ( cov_yy - eig1 ) + ( cov_zz - eig2 ) ) + cov_xy * cov_xz,
-														   cov_yz * cov_yz + cov_xz * cov_xz + ( cov_zz - eig1 ) * ( cov_zz - eig2 ) );
-							
-							// Simplification of original method.
-							// We only need the first 2 eigen vectors for 2D projection.
-							// Therefor we are not intereted, which is bigger, but in leaving the smallest out.
-							float minEig = std::min( { eig1, eig2, eig3 } );
-
-							if ( eig3 == minEig )
-							{
-								eigenVectors[ 0 ] = glm::normalize( eigenVectors_[ 0 ] );
-								eigenVectors[ 1 ] = glm::normalize( eigenVectors_[ 1 ] );
-							}
-							else if ( eig2 == minEig )
-							{
-                                eigenVectors[ 0 ] = glm::normalize( eigenVectors_[ 0 ] );
-                                eigenVectors[ 1 ] = glm::normalize( eigenVectors_[ 2 ] );
-                            }
-							else //if ( eig1 == minEig ) most unlikly case
-							{
-                                eigenVectors[ 0 ] = glm::normalize( eigenVectors_[ 1 ] );
-                                eigenVectors[ 1 ] = glm::normalize( eigenVectors_[ 2 ] );
-                            }
-						}
-
-						std::vector<glm::vec2> facePointsProjected( face_vertIds.size() );
-						
-
-						std::transform(centeredPoints.cbegin(),centeredPoints.cend(),facePointsProjected.begin(),
-										[ &eigenVectors ]( const glm::vec3& cp )->glm::vec2
-										{
-											return glm::vec2(
-												glm::dot( cp, eigenVectors[0] ),
-												glm::dot( cp, eigenVectors[1] )
-											);
-										} );
-
-						// checking the orientation. CCW should be kept
-						float sum = 0.0;
-						for ( int i = 0; i < facePointsProjected.size() - 1; ++i )
-						{
-							sum += ( facePointsProjected[ i + 1 ].x - facePointsProjected[ i ].x ) *
-								( facePointsProjected[ i + 1 ].y + facePointsProjected[ i ].y );
-						}
-						sum += ( facePointsProjected.front().x - facePointsProjected.back().x ) *
-							( facePointsProjected.front().y + facePointsProjected.back().y );
-
-						if ( sum > 0.0f )
-						{
-							for ( int i = 0; i < facePointsProjected.size(); ++i )
-								facePointsProjected[ i ].y *= -1.0f;
-						}
-
-						std::vector<unsigned int> triIndices = triangulatePolygon( facePointsProjected );
-						
-						face_vertIdsFace2Tris.resize( triIndices.size() );
-						std::transform( triIndices.cbegin(), triIndices.cend(), face_vertIdsFace2Tris.begin(),
-										[ &face_vertIds ]( const unsigned int fTriId )->IndexedVert
-										{
-											return face_vertIds[ fTriId ];
-										} );
-
-					}
-					face_vertIds = std::move( face_vertIdsFace2Tris );
-				}
-				
-				if ( texcoords.empty() ) texcoords.emplace_back( glm::vec2( 0.0 ) );
-				
-				if ( needsNormalComputation )
+void ObjParser::SerialParser::AddFace( std::vector<IndexedVert>& face, bool needsNormals, size_t normalSlot )
+{
+	triangulateFace( face, positions );
+
+	if ( needsNormals && face.size() >= 3 )
+	{
+		for ( size_t i = 0; i < face.size(); i += 3, ++normalSlot )
+		{
+			generatedNormals[ normalSlot ] = faceNormal( positions[ face[ i ].v ], positions[ face[ i + 1 ].v ], positions[ face[ i + 2 ].v ] );
+			face[ i ].vn = face[ i + 1 ].vn = face[ i + 2 ].vn = GeneratedNormal | static_cast<uint32_t>( normalSlot );
+		}
+	}
+
+	if ( corners ) corners->insert( corners->end(), face.begin(), face.end() );
+
+	if ( positionVertices.size() < positions.size() ) positionVertices.resize( positions.size() );
+
+	for ( const auto& vertex : face )
+	{
+		// The faces referring forward waited for their positions, every position has its entry
+		PositionVertex& first = positionVertices[ vertex.v ];
+		if ( first.index != 0 && first.vt == vertex.vt && first.vn == vertex.vn )
+		{
+			resultMesh.indexArray.push_back( first.index - 1 );
+			continue;
+		}
+
+		unsigned int newIndex = 0;
+		unsigned int& vIndex = first.index == 0 ? newIndex : vertexIndices[ vertex ];
+		if (vIndex == 0) // new vertex
+		{
+			Vertex v;
+			v.position = positions[vertex.v];
+			v.texcoord = texcoords[vertex.vt];
+			v.normal = vertex.vn & GeneratedNormal ? generatedNormals[vertex.vn & ~GeneratedNormal] : normals[vertex.vn];
+
+			resultMesh.vertexArray.push_back(v);
+			resultMesh.indexArray.push_back(nIndexedVerts++);
+			vIndex = nIndexedVerts;	
+			if ( first.index == 0 ) first = { vIndex, vertex.vt, vertex.vn };
+		} else {
+			resultMesh.indexArray.push_back(vIndex-1);
+		}
+	}
+}
+
+// Parallel parse
+// 1. Every chunk (starting at a line) collects its own v, vn, vt records and raw faces.
+//    Face indices are absolute in OBJ, only the generated normals and the dummy texcoord depend on what came before,
+//    so generated normals get reserved slots in the chunk's normal list, in file order.
+// 2. The attribute arrays are concatenated (prefix sums), then the faces are triangulated and the normals computed.
+// 3. Vertices are deduplicated in each chunk, then across chunks in hash shards. The first occurrence owns the vertex,
+//    ordering the owners by (chunk, local first occurrence) gives exactly the serial numbering.
+
+struct ObjParser::Chunk
+{
+	struct Face
+	{
+		uint32_t first;
+		uint32_t count;
+		uint32_t normalSlot; // Local index of the first generated normal (see GeneratedNormal), if needed
+		bool needsNormals;
+	};
+
+	const char* begin;
+	const char* end;
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> texcoords;
+	std::vector<IndexedVert> faceVerts;
+	std::vector<Face> faces;
+	size_t generatedNormalCount = 0;
+	size_t texcoordsBeforeFirstFace = SIZE_MAX; // SIZE_MAX: the chunk has no faces
+
+	size_t positionOffset = 0;
+	size_t normalOffset = 0;
+	size_t texcoordOffset = 0;
+	size_t generatedNormalOffset = 0;
+
+	std::vector<IndexedVert> triangleVerts;
+
+	std::vector<IndexedVert> unique;	 // In order of first occurrence
+	std::vector<size_t> uniqueHash;
+	std::vector<uint32_t> localIndices; // Per triangle vertex, into unique
+	std::vector<std::pair<uint32_t, uint32_t>> owner; // Per unique vertex, the (chunk, unique) of the global first occurrence
+	std::vector<uint32_t> globalIndices; // Per unique vertex
+	size_t ownedOffset = 0;
+	size_t indexOffset = 0;
+};
+
+template <typename F>
+static void parallelFor( size_t count, unsigned int threadCount, F&& func )
+{
+	std::atomic<size_t> next = 0;
+	auto worker = [ & ]()
+	{
+		for ( size_t i = next++; i < count; i = next++ ) func( i );
+	};
+
+	std::vector<std::thread> threads;
+	for ( unsigned int t = 1; t < std::min<size_t>( threadCount, count ); ++t ) threads.emplace_back( worker );
+	worker();
+	for ( std::thread& thread : threads ) thread.join();
+}
+
+ObjParser::Mesh ObjParser::parseParallel( const char* data, size_t size, unsigned int threadCount )
+{
+	// Small files are not worth the threads
+	constexpr size_t MinChunkSize = 1 << 20;
+	const size_t chunkCount = std::clamp<size_t>( size / MinChunkSize, 1, threadCount * 4 );
+	if ( chunkCount == 1 ) return parseSerial( data, size );
+
+	std::vector<Chunk> chunks( chunkCount );
+	{
+		const char* begin = data;
+		const char* const end = data + size;
+		for ( size_t c = 0; c < chunkCount; ++c )
+		{
+			const char* chunkEnd = ( c + 1 == chunkCount ) ? end : std::max( begin, data + size * ( c + 1 ) / chunkCount );
+			while ( chunkEnd < end && *( chunkEnd - 1 ) != '\n' ) ++chunkEnd;
+			chunks[ c ].begin = begin;
+			chunks[ c ].end = chunkEnd;
+			begin = chunkEnd;
+		}
+	}
+
+	//
+	// 1: Records
+	//
+
+	parallelFor( chunkCount, threadCount, [ & ]( size_t c )
+	{
+		CPU_TRACE_SCOPE("ObjParser::parseChunk");
+		Chunk& chunk = chunks[ c ];
+		std::vector<IndexedVert> face_vertIds;
+
+		InMemoryTokenizer tokenizer;
+		tokenizer.SetData( chunk.begin, chunk.end - chunk.begin );
+
+		while ( tokenizer )
+		{
+			std::string_view token = tokenizer.NextToken();
+			if ( token.empty() ) break; // trailing white space
+
+			if ( token[ 0 ] == '#' )
+			{
+				tokenizer.ToNextLine();
+				continue;
+			}
+
+			switch ( tokenizer.RecordType( token ) )
+			{
+				case From2Char('v',' '):
+				case From2Char('v','\t'):
+					chunk.positions.push_back( readPosition( tokenizer ) );
+					break;
+				case From2Char('v','n'):
+					chunk.normals.push_back( readVec3( tokenizer ) );
+					break;
+				case From2Char('v','t'):
+					chunk.texcoords.push_back( readTexcoord( tokenizer ) );
+					break;
+				case From2Char('f',' '):
+				case From2Char('f','\t'):
 				{
-					for ( int i = 0; i < face_vertIds.size(); i += 3 )
-					{
-						glm::vec3 n = glm::normalize( glm::cross(
-							positions[face_vertIds[i + 1].v] - positions[face_vertIds[i].v],
-							positions[face_vertIds[i + 2].v] - positions[face_vertIds[i].v]
-						) );
-
-						unsigned int n_idx = static_cast<unsigned int>( normals.size() );
-						normals.push_back( n );
-						face_vertIds[ i ].vn = face_vertIds[ i + 1 ].vn = face_vertIds[ i + 2 ].vn = n_idx;
-					}
-				}
+					bool needsNormals = readFace( tokenizer, face_vertIds );
+					if ( chunk.faces.empty() ) chunk.texcoordsBeforeFirstFace = chunk.texcoords.size();
 
+					Chunk::Face face = { static_cast<uint32_t>( chunk.faceVerts.size() ), static_cast<uint32_t>( face_vertIds.size() ),
+										 static_cast<uint32_t>( chunk.generatedNormalCount ), needsNormals };
+					// A polygon is always split to count - 2 triangles
+					if ( needsNormals && face.count >= 3 ) chunk.generatedNormalCount += face.count - 2;
 
-				for ( const auto& vertex : face_vertIds )
+					chunk.faces.push_back( face );
+					chunk.faceVerts.insert( chunk.faceVerts.end(), face_vertIds.begin(), face_vertIds.end() );
+				} break;
+			}
+
+			tokenizer.ToNextLine();
+		}
+	} );
+
+	//
+	// 2: Concatenate the attributes, triangulate
+	//
+
+	// The serial parser inserts a (0,0) texcoord at the first face if no vt came before it
+	bool dummyTexcoord = false;
+	{
+		size_t texcoordsBefore = 0;
+		for ( const Chunk& chunk : chunks )
+		{
+			if ( chunk.texcoordsBeforeFirstFace != SIZE_MAX )
+			{
+				dummyTexcoord = texcoordsBefore + chunk.texcoordsBeforeFirstFace == 0;
+				break;
+			}
+			texcoordsBefore += chunk.texcoords.size();
+		}
+	}
+
+	size_t positionCount = 0, normalCount = 0, texcoordCount = dummyTexcoord ? 1 : 0, generatedNormalCount = 0;
+	for ( Chunk& chunk : chunks )
+	{
+		chunk.positionOffset = positionCount;
+		chunk.normalOffset = normalCount;
+		chunk.texcoordOffset = texcoordCount;
+		chunk.generatedNormalOffset = generatedNormalCount;
+		positionCount += chunk.positions.size();
+		normalCount += chunk.normals.size();
+		texcoordCount += chunk.texcoords.size();
+		generatedNormalCount += chunk.generatedNormalCount;
+	}
+
+	std::vector<glm::vec3> positions( positionCount );
+	std::vector<glm::vec3> normals( normalCount );
+	std::vector<glm::vec2> texcoords( texcoordCount );
+	std::vector<glm::vec3> generatedNormals( generatedNormalCount );
+	if ( dummyTexcoord ) texcoords[ 0 ] = glm::vec2( 0.0 );
+
+	parallelFor( chunkCount, threadCount, [ & ]( size_t c )
+	{
+		Chunk& chunk = chunks[ c ];
+		std::copy( chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionOffset );
+		std::copy( chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalOffset );
+		std::copy( chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + chunk.texcoordOffset );
+		chunk.positions = {};
+		chunk.normals = {};
+		chunk.texcoords = {};
+	} );
+
+	parallelFor( chunkCount, threadCount, [ & ]( size_t c )
+	{
+		CPU_TRACE_SCOPE("ObjParser::triangulateChunk");
+		Chunk& chunk = chunks[ c ];
+		std::vector<IndexedVert> face_vertIds;
+		chunk.triangleVerts.reserve( chunk.faceVerts.size() );
+
+		for ( const Chunk::Face& face : chunk.faces )
+		{
+			// Dropped like in SerialParser::Finish, its generated normal slots stay unused there too
+			if ( !faceInRange( chunk.faceVerts.data() + face.first, face.count, face.needsNormals, positions.size(), texcoords.size(), normals.size() ) ) continue;
+
+			face_vertIds.assign( chunk.faceVerts.begin() + face.first, chunk.faceVerts.begin() + face.first + face.count );
+			triangulateFace( face_vertIds, positions );
+
+			if ( face.needsNormals && face.count >= 3 )
+			{
+				uint32_t n_idx = static_cast<uint32_t>( chunk.generatedNormalOffset + face.normalSlot );
+				for ( size_t i = 0; i < face_vertIds.size(); i += 3, ++n_idx )
 				{
-					unsigned int& vIndex = vertexIndices[ vertex ];
-					if (vIndex == 0) // new vertex
-					{
-						Vertex v;
-						v.position = positions[vertex.v];
-						v.texcoord = texcoords[vertex.vt];
-						v.normal = normals[vertex.vn];
-
-						resultMesh.vertexArray.push_back(v);
-						resultMesh.indexArray.push_back(nIndexedVerts++);
-						vIndex = nIndexedVerts;	
-					} else {
-						resultMesh.indexArray.push_back(vIndex-1);
-					}
+					generatedNormals[ n_idx ] = faceNormal( positions[ face_vertIds[ i ].v ], positions[ face_vertIds[ i + 1 ].v ], positions[ face_vertIds[ i + 2 ].v ] );
+					face_vertIds[ i ].vn = face_vertIds[ i + 1 ].vn = face_vertIds[ i + 2 ].vn = GeneratedNormal | n_idx;
 				}
-			}break;
+			}
+
+			chunk.triangleVerts.insert( chunk.triangleVerts.end(), face_vertIds.begin(), face_vertIds.end() );
 		}
+		chunk.faceVerts = {};
+		chunk.faces = {};
+	} );
 
-		tokenizer.ToNextLine();
+	//
+	// 3: Deduplicate, first in the chunks then across them
+	//
+
+	parallelFor( chunkCount, threadCount, [ & ]( size_t c )
+	{
+		CPU_TRACE_SCOPE("ObjParser::dedupChunk");
+		Chunk& chunk = chunks[ c ];
+		VertexMap<uint32_t> localIndices( chunk.triangleVerts.size() / 3 );
+		chunk.localIndices.resize( chunk.triangleVerts.size() );
+
+		for ( size_t i = 0; i < chunk.triangleVerts.size(); ++i )
+		{
+			auto [ index, inserted ] = localIndices.try_emplace( chunk.triangleVerts[ i ], static_cast<uint32_t>( chunk.unique.size() ) );
+			if ( inserted )
+			{
+				chunk.unique.push_back( chunk.triangleVerts[ i ] );
+				chunk.uniqueHash.push_back( IndexedVertHash{}( chunk.triangleVerts[ i ] ) );
+			}
+			chunk.localIndices[ i ] = *index;
+		}
+		chunk.owner.resize( chunk.unique.size() );
+		chunk.globalIndices.resize( chunk.unique.size() );
+		chunk.triangleVerts = {};
+	} );
+
+	// Every shard sees its keys in file order, so the first insert is the global first occurrence
+	const size_t shardCount = threadCount;
+	size_t chunkUniqueCount = 0;
+	for ( const Chunk& chunk : chunks ) chunkUniqueCount += chunk.unique.size();
+
+	parallelFor( shardCount, threadCount, [ & ]( size_t shard )
+	{
+		CPU_TRACE_SCOPE("ObjParser::dedupShard");
+		VertexMap<std::pair<uint32_t, uint32_t>> firstOccurrence( chunkUniqueCount / shardCount );
+		for ( uint32_t c = 0; c < chunkCount; ++c )
+		{
+			Chunk& chunk = chunks[ c ];
+			for ( uint32_t u = 0; u < chunk.unique.size(); ++u )
+			{
+				if ( chunk.uniqueHash[ u ] % shardCount != shard ) continue;
+				chunk.owner[ u ] = *firstOccurrence.try_emplace( chunk.unique[ u ], { c, u } ).first;
+			}
+		}
+	} );
+
+	size_t vertexCount = 0, indexCount = 0;
+	for ( uint32_t c = 0; c < chunkCount; ++c )
+	{
+		Chunk& chunk = chunks[ c ];
+		chunk.ownedOffset = vertexCount;
+		chunk.indexOffset = indexCount;
+		for ( uint32_t u = 0; u < chunk.unique.size(); ++u )
+			if ( chunk.owner[ u ].first == c ) ++vertexCount;
+		indexCount += chunk.localIndices.size();
 	}
 
+	Mesh resultMesh;
+	resultMesh.vertexArray.resize( vertexCount );
+	resultMesh.indexArray.resize( indexCount );
+
+	parallelFor( chunkCount, threadCount, [ & ]( size_t c )
+	{
+		Chunk& chunk = chunks[ c ];
+		uint32_t globalIndex = static_cast<uint32_t>( chunk.ownedOffset );
+		for ( uint32_t u = 0; u < chunk.unique.size(); ++u )
+		{
+			if ( chunk.owner[ u ].first != c ) continue;
+
+			const IndexedVert& vertex = chunk.unique[ u ];
+			Vertex& v = resultMesh.vertexArray[ globalIndex ];
+			v.position = positions[ vertex.v ];
+			v.texcoord = texcoords[ vertex.vt ];
+			v.normal = vertex.vn & GeneratedNormal ? generatedNormals[ vertex.vn & ~GeneratedNormal ] : normals[ vertex.vn ];
+			chunk.globalIndices[ u ] = globalIndex++;
+		}
+	} );
+
+	parallelFor( chunkCount, threadCount, [ & ]( size_t c )
+	{
+		Chunk& chunk = chunks[ c ];
+		for ( uint32_t u = 0; u < chunk.unique.size(); ++u )
+		{
+			auto [ ownerChunk, ownerUnique ] = chunk.owner[ u ];
+			if ( ownerChunk != c ) chunk.globalIndices[ u ] = chunks[ ownerChunk ].globalIndices[ ownerUnique ];
+		}
+		for ( size_t i = 0; i < chunk.localIndices.size(); ++i )
+			resultMesh.indexArray[ chunk.indexOffset + i ] = chunk.globalIndices[ chunk.localIndices[ i ] ];
+	} );
+
 	return resultMesh;
 }
 
+void ObjParser::Benchmark( const std::filesystem::path& fileName )
+{
+	std::error_code ec;
+	const double megaBytes = std::filesystem::file_size( fileName, ec ) / ( 1024.0 * 1024.0 );
+	if ( ec )
+	{
+		SDL_LogMessage( SDL_LOG_CATEGORY_ERROR, SDL_LOG_PRIORITY_ERROR, "[ObjParser] Error while opening %s!", fileName.string().c_str() );
+		return;
+	}
+
+	auto timedParse = [ &fileName ]( unsigned int threadCount, Mesh& mesh )
+	{
+		auto start = std::chrono::steady_clock::now();
+		mesh = parse( fileName, threadCount );
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	};
+
+	auto identicalTo = []( const Mesh& mesh, const Mesh& reference )
+	{
+		return mesh.indexArray == reference.indexArray && mesh.vertexArray.size() == reference.vertexArray.size()
+			&& std::memcmp( mesh.vertexArray.data(), reference.vertexArray.data(), mesh.vertexArray.size() * sizeof( Vertex ) ) == 0;
+	};
+
+	// The serial parse reads the mapped file (or its copy) as long as it's below the streaming threshold
+	const size_t streamingThreshold = StreamingThreshold;
+	StreamingThreshold = std::numeric_limits<size_t>::max();
+
+	Mesh reference;
+	const double serialTime = timedParse( 1, reference );
+	SDL_Log( "[ObjParser] %s: %.1f MB, %zu vertices, %zu indices", fileName.string().c_str(), megaBytes, reference.vertexArray.size(), reference.indexArray.size() );
+	SDL_Log( "[ObjParser] %2u threads: %8.1f ms %8.1f MB/s", 1u, serialTime * 1000.0, megaBytes / serialTime );
+
+	const unsigned int maxThreads = std::max( 1u, std::thread::hardware_concurrency() );
+	for ( unsigned int threadCount = 2; threadCount <= maxThreads; threadCount = threadCount * 2 > maxThreads && threadCount != maxThreads ? maxThreads : threadCount * 2 )
+	{
+		Mesh mesh;
+		const double time = timedParse( threadCount, mesh );
+		SDL_Log( "[ObjParser] %2u threads: %8.1f ms %8.1f MB/s %5.2fx%s", threadCount, time * 1000.0, megaBytes / time, serialTime / time,
+				 identicalTo( mesh, reference ) ? "" : " OUTPUT DIFFERS FROM SERIAL" );
+	}
+
+	StreamingThreshold = streamingThreshold;
+
+	// The same file broken: a face past the end of the positions first (the serial parse defers the faces from there on)
+	// and one last, both have to be dropped the same way with threads
+	{
+		MappedFile source;
+		if ( source.Open( fileName ) )
+		{
+			const std::string_view badFace = "f 1//1 2//2 99999999//1\n";
+			std::vector<char> broken( badFace.begin(), badFace.end() );
+			broken.insert( broken.end(), source.Data(), source.Data() + source.Size() );
+			broken.push_back( '\n' );
+			broken.insert( broken.end(), badFace.begin(), badFace.end() );
+
+			const Mesh serial = parseSerial( broken.data(), broken.size() );
+			const unsigned int threadCount = std::max( 4u, maxThreads );
+			const Mesh parallel = parseParallel( broken.data(), broken.size(), threadCount );
+			SDL_Log( "[ObjParser] with out of range faces: %zu indices, %u threads%s", serial.indexArray.size(), threadCount,
+					 identicalTo( parallel, serial ) ? "" : " OUTPUT DIFFERS FROM SERIAL" );
+		}
+	}
+
+	// The default window, then a small one so that lines and faces straddle many window boundaries
+	for ( size_t windowSize : { size_t( 64 ) << 20, size_t( 4 ) << 10 } )
+	{
+		auto start = std::chrono::steady_clock::now();
+		const Mesh mesh = parseStreaming( fileName, windowSize );
+		const double time = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+		SDL_Log( "[ObjParser] streaming, %6zu KB window: %8.1f ms %8.1f MB/s %5.2fx%s", windowSize >> 10, time * 1000.0, megaBytes / time, serialTime / time,
+				 identicalTo( mesh, reference ) ? "" : " OUTPUT DIFFERS FROM SERIAL" );
+	}
+
+	MappedFile objFile;
+	if ( objFile.Open( fileName ) ) benchmarkDedup( objFile.Data(), objFile.Size() );
+}
+
+namespace
+{
+	// Live and peak bytes of the containers in the dedup benchmark
+	struct AllocationStats
+	{
+		size_t current = 0;
+		size_t peak = 0;
+	};
+
+	template <typename T>
+	struct CountingAllocator
+	{
+		using value_type = T;
+		AllocationStats* stats;
+
+		explicit CountingAllocator( AllocationStats* _stats ) noexcept : stats( _stats ) {}
+		template <typename U>
+		CountingAllocator( const CountingAllocator<U>& other ) noexcept : stats( other.stats ) {}
+
+		T* allocate( size_t n )
+		{
+			stats->current += n * sizeof( T );
+			stats->peak = std::max( stats->peak, stats->current );
+			return std::allocator<T>{}.allocate( n );
+		}
+		void deallocate( T* p, size_t n ) noexcept
+		{
+			stats->current -= n * sizeof( T );
+			std::allocator<T>{}.deallocate( p, n );
+		}
+
+		template <typename U>
+		bool operator==( const CountingAllocator<U>& other ) const noexcept { return stats == other.stats; }
+		template <typename U>
+		bool operator!=( const CountingAllocator<U>& other ) const noexcept { return stats != other.stats; }
+	};
+}
+
+void ObjParser::benchmarkDedup( const char* data, size_t size )
+{
+	// The face corners in the order the serial parse looks them up
+	std::vector<IndexedVert> corners;
+	{
+		SerialParser recorder;
+		recorder.corners = &corners;
+		recorder.Parse( data, size );
+		recorder.Finish();
+	}
+
+	// Both maps number the vertices the way the parser does
+	auto timedDedup = [ &corners ]( auto& map )
+	{
+		auto start = std::chrono::steady_clock::now();
+		uint32_t next = 0;
+		for ( const IndexedVert& corner : corners )
+			if ( map.try_emplace( corner, next ).second ) ++next;
+		return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	};
+
+	AllocationStats nodeStats;
+	double nodeTime;
+	size_t nodeCount;
+	{
+		using Allocator = CountingAllocator<std::pair<const IndexedVert, uint32_t>>;
+		std::unordered_map<IndexedVert, uint32_t, IndexedVertHash, std::equal_to<IndexedVert>, Allocator> map( 0, IndexedVertHash{}, std::equal_to<IndexedVert>{}, Allocator( &nodeStats ) );
+		nodeTime = timedDedup( map );
+		nodeCount = map.size();
+	}
+
+	AllocationStats flatStats;
+	double flatTime;
+	size_t flatCount;
+	{
+		// Sized from the same pre-scan as the serial parse, which is part of the measured time
+		auto start = std::chrono::steady_clock::now();
+		FlatHashMap<IndexedVert, uint32_t, IndexedVertHash, CountingAllocator<IndexedVert>> map( countPositions( data, size ), CountingAllocator<IndexedVert>( &flatStats ) );
+		const double sizingTime = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+		flatTime = sizingTime + timedDedup( map );
+		flatCount = map.size();
+	}
+
+	constexpr double MB = 1024.0 * 1024.0;
+	SDL_Log( "[ObjParser] Dedup of %zu corners to %zu vertices%s", corners.size(), flatCount, flatCount == nodeCount ? "" : " VERTEX COUNTS DIFFER" );
+	SDL_Log( "[ObjParser]   std::unordered_map: %8.1f ms, peak %8.1f MB", nodeTime * 1000.0, nodeStats.peak / MB );
+	SDL_Log( "[ObjParser]   FlatHashMap:        %8.1f ms, peak %8.1f MB", flatTime * 1000.0, flatStats.peak / MB );
+}
+
 // Hash function for IndexedVert
 // version of fasthash64 https://github.com/ztanml/fast-hash
 // simplified for using only for 1 64 bit data (seed is the other one).
@@ -474,7 +1344,7 @@ static inline constexpr uint64_t fasthash64( uint64_t v, uint64_t seed )
 
 std::size_t ObjParser::IndexedVertHash::operator()( const IndexedVert& iv ) const noexcept
 {
-	return fasthash64( iv.vt, iv.vn_64 );
+	return fasthash64( iv.v_vt, iv.vn );
 }
 
 static std::vector<unsigned int> triangulatePolygon( const std::vector<glm::vec2>& polygon )
@@ -3,11 +3,12 @@
 #include <filesystem>
 #include <fstream>
 #include <vector>
-#include <unordered_map>
 #include <functional>
 
+#include "FlatHashMap.h"
 #include "GLUtils.hpp"
 
+class InMemoryTokenizer;
 
 class ObjParser
 {
@@ -15,7 +16,19 @@ public:
 
 	typedef MeshObject<Vertex> Mesh;
 
-	static Mesh parse(const std::filesystem::path& fileName);
+	// threadCount > 1 parses line aligned chunks in parallel, 0 uses every hardware thread.
+	// The result is identical to the serial parse either way.
+	static Mesh parse(const std::filesystem::path& fileName, unsigned int threadCount = 1);
+
+	// Reads the file in windowSize pieces, so only the result has to fit into memory. Always serial.
+	// parse uses this for every file bigger than StreamingThreshold, set it to 0 to stream everything.
+	static Mesh parseStreaming(const std::filesystem::path& fileName, size_t windowSize = 64 << 20);
+	static size_t StreamingThreshold;
+
+	// Logs the throughput of the serial and parallel parse of the file for 1, 2, 4, ... threads,
+	// and of the streaming parse (checking that all of them give the same mesh),
+	// then the time and peak memory of the vertex deduplication with std::unordered_map and with FlatHashMap
+	static void Benchmark(const std::filesystem::path& fileName);
 
 	enum Exception { EXC_FILENOTFOUND };
 
@@ -52,4 +65,23 @@ private:
 	{
 		std::size_t operator()( const IndexedVert& iv ) const noexcept;
 	};
+
+	// Marks IndexedVert::vn of the normals computed for the faces without one, the rest is the index among those.
+	// Kept apart from the vn lines, so that their indices don't shift
+	static constexpr uint32_t GeneratedNormal = 0x80000000u;
+
+	// (v, vt, vn) -> vertex index
+	template <typename Value>
+	using VertexMap = FlatHashMap<IndexedVert, Value, IndexedVertHash>;
+
+	struct Chunk;
+	struct SerialParser;
+
+	static Mesh parseSerial( const char* data, size_t size );
+	static Mesh parseParallel( const char* data, size_t size, unsigned int threadCount );
+	static bool readFace( InMemoryTokenizer& tokenizer, std::vector<IndexedVert>& face_vertIds );
+	static void triangulateFace( std::vector<IndexedVert>& face_vertIds, const std::vector<glm::vec3>& positions );
+	// False if a corner refers past the attributes of the whole file, the face is dropped then
+	static bool faceInRange( const IndexedVert* corners, size_t count, bool needsNormals, size_t positionCount, size_t texcoordCount, size_t normalCount );
+	static void benchmarkDedup( const char* data, size_t size );
 };
@@ -1,9 +1,11 @@
 ﻿#pragma once
 #include "GLUtils.hpp"
+#include "CPUTrace.h"
 
 template <typename SurfT>
 [[nodiscard]] MeshObject<Vertex> GetParamSurfMesh( const SurfT& surf, const std::size_t N = 80, const std::size_t M = 40 )
 {
+	CPU_TRACE_SCOPE("GetParamSurfMesh");
     MeshObject<Vertex> outputMesh;
 
 	// We approximate our parametric surface with NxM rectangles => must be evaluated at (N+1)x(M+1) points
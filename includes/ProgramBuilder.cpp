@@ -1,10 +1,45 @@
 #include "ProgramBuilder.h"
 
+#include "CPUTrace.h"
+#include "GLUtils.hpp"
+#include "MeshCache.h"
+#include "ProgramCache.h"
+
 #include "SDL2/SDL_log.h"
+#include <algorithm>
 #include <fstream>
 #include <string>
 
 
+// Compile time switches of the C++ side the shaders have to follow and the ones of the program, inserted after the #version line
+static std::string InsertDefines(const std::string& shaderCode, const std::string& programDefines)
+{
+	const std::string defines = "#define QUANTIZED_VERTEX " + std::to_string(QUANTIZED_VERTEX) + "\n" + programDefines;
+
+	size_t version = shaderCode.find("#version");
+	if (version == std::string::npos) return defines + "#line 1\n" + shaderCode;
+
+	size_t lineEnd = shaderCode.find('\n', version);
+	if (lineEnd == std::string::npos) return shaderCode + "\n" + defines;
+
+	// Keep the line numbers of the compile errors right
+	size_t nextLine = std::count(shaderCode.begin(), shaderCode.begin() + lineEnd, '\n') + 2;
+	return shaderCode.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + shaderCode.substr(lineEnd + 1);
+}
+
+// The file of an #include "file" line
+static bool ParseInclude(const std::string& line, std::filesystem::path& include)
+{
+	size_t directive = line.find_first_not_of(" \t");
+	if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) return false;
+
+	size_t open = line.find('"', directive + 8);
+	size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+	if (close == std::string::npos) return false;
+	include = line.substr(open + 1, close - open - 1);
+	return true;
+}
+
 ProgramBuilder::ProgramBuilder(const GLuint _programID) : programID(_programID)
 {
 	if (programID == 0)
@@ -18,7 +53,7 @@ ProgramBuilder::ProgramBuilder(const GLuint _programID) : programID(_programID)
 
 ProgramBuilder::~ProgramBuilder()
 {
-	if (!shaderIDs.empty())
+	if (!stages.empty())
 	{
 		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
 			SDL_LOG_PRIORITY_ERROR,
@@ -26,16 +61,11 @@ ProgramBuilder::~ProgramBuilder()
 	}
 }
 
-void ProgramBuilder::LoadShader( const GLuint loadedShader, const std::filesystem::path& fileName )
+std::string ProgramBuilder::LoadShader(const std::filesystem::path& fileName, std::vector<std::filesystem::path>& files)
 {
-	// Upon failure, log the error message and return with -1
-	if (loadedShader == 0)
-	{
-		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
-			SDL_LOG_PRIORITY_ERROR,
-			"Shader needs to be inited before loading %s !", fileName.string().c_str());
-		return;
-	}
+	// The source string number of the file in the #line directives
+	const int fileIndex = static_cast<int>(files.size());
+	files.push_back(fileName.lexically_normal());
 
 	// Loading a shader from disk
 	std::string shaderCode = "";
@@ -47,19 +77,37 @@ void ProgramBuilder::LoadShader( const GLuint loadedShader, const std::filesyste
 		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
 			SDL_LOG_PRIORITY_ERROR,
 			"Error while opening shader file %s!", fileName.string().c_str());
-		return;
+		return {};
 	}
 
-	// Load the contents of the file into the 'shaderCode' variable.
+	// Load the contents of the file into the 'shaderCode' variable, with the included files in place of their lines
 	std::string line = "";
+	int lineNumber = 0;
 	while (std::getline(shaderStream, line))
 	{
-		shaderCode += line + "\n";
+		++lineNumber;
+		std::filesystem::path include;
+		if (!ParseInclude(line, include))
+		{
+			shaderCode += line + "\n";
+			continue;
+		}
+
+		// Relative to the including file, and only once per stage
+		include = (fileName.parent_path() / include).lexically_normal();
+		if (std::find(files.begin(), files.end(), include) != files.end())
+		{
+			shaderCode += "\n";
+			continue;
+		}
+		shaderCode += "#line 1 " + std::to_string(files.size()) + "\n";
+		shaderCode += LoadShader(include, files);
+		shaderCode += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
 	}
 
 	shaderStream.close();
 
-	CompileShaderFromSource(loadedShader, shaderCode);
+	return shaderCode;
 }
 
 void ProgramBuilder::CompileShaderFromSource(const GLuint loadedShader, std::string_view shaderCode)
@@ -70,69 +118,187 @@ void ProgramBuilder::CompileShaderFromSource(const GLuint loadedShader, std::str
 
 	glShaderSource(loadedShader, 1, &sourcePointer, &sourceLength);
 
-	// Let's compile the shader
+	// Let's compile the shader, the status is checked by FinishProgram
 	glCompileShader(loadedShader);
+}
 
-	// Check whether the compilation was successful
-	GLint result = GL_FALSE;
-	int infoLogLength;
+namespace
+{
+	// Linked (or still linking) programs whose status hasn't been checked yet
+	struct PendingProgram
+	{
+		GLuint programID;
+		std::vector<GLuint> shaderIDs;
+		std::vector<std::string> shaderFiles; // For the errors, the files of the source string numbers
+		bool cached;
+		uint64_t key;
+	};
 
-	// For this, retrieve the status
-	glGetShaderiv(loadedShader, GL_COMPILE_STATUS, &result);
-	glGetShaderiv(loadedShader, GL_INFO_LOG_LENGTH, &infoLogLength);
+	bool batching = false;
+	std::vector<PendingProgram> pendingPrograms;
 
-	if (GL_FALSE == result || infoLogLength != 0)
+	bool ParallelCompile()
 	{
-		// Get and log the error message.
-		std::string ErrorMessage(infoLogLength, '\0');
-		glGetShaderInfoLog(loadedShader, infoLogLength, NULL, ErrorMessage.data());
+		return GLEW_KHR_parallel_shader_compile;
+	}
 
-		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
-			(result) ? SDL_LOG_PRIORITY_WARN : SDL_LOG_PRIORITY_ERROR,
-			"[glLinkProgram] Shader compile error: %s", ErrorMessage.data());
+	void CheckShader(const GLuint loadedShader, const std::string& files)
+	{
+		// Check whether the compilation was successful
+		GLint result = GL_FALSE;
+		int infoLogLength;
+
+		// For this, retrieve the status
+		glGetShaderiv(loadedShader, GL_COMPILE_STATUS, &result);
+		glGetShaderiv(loadedShader, GL_INFO_LOG_LENGTH, &infoLogLength);
+
+		if (GL_FALSE == result || infoLogLength != 0)
+		{
+			// Get and log the error message.
+			std::string ErrorMessage(infoLogLength, '\0');
+			glGetShaderInfoLog(loadedShader, infoLogLength, NULL, ErrorMessage.data());
+
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+				(result) ? SDL_LOG_PRIORITY_WARN : SDL_LOG_PRIORITY_ERROR,
+				"[glLinkProgram] Shader compile error in %s: %s", files.c_str(), ErrorMessage.data());
+		}
+	}
+
+	// Waits for the program if it is still compiling, logs the errors, caches the binary and releases the shaders
+	void FinishProgram(const PendingProgram& pending)
+	{
+		for (size_t i = 0; i < pending.shaderIDs.size(); ++i) CheckShader(pending.shaderIDs[i], pending.shaderFiles[i]);
+
+		// Check for linking errors
+		GLint infoLogLength = 0, result = 0;
+
+		glGetProgramiv(pending.programID, GL_LINK_STATUS, &result);
+		glGetProgramiv(pending.programID, GL_INFO_LOG_LENGTH, &infoLogLength);
+		if (GL_FALSE == result || infoLogLength != 0)
+		{
+			std::string ErrorMessage(infoLogLength, '\0');
+			glGetProgramInfoLog(pending.programID, infoLogLength, nullptr, ErrorMessage.data());
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+				(result) ? SDL_LOG_PRIORITY_WARN : SDL_LOG_PRIORITY_ERROR,
+				"[glLinkProgram] Shader linking error: %s", ErrorMessage.data());
+		}
+
+		if (result && pending.cached) ProgramCache::Store(pending.programID, pending.key);
+
+		// No need for these
+		std::for_each(pending.shaderIDs.begin(), pending.shaderIDs.end(), glDeleteShader);
 	}
 }
 
-void ProgramBuilder::AttachShader(const GLuint shaderID, const std::filesystem::path& fileName)
+void ProgramBuilder::BeginBatch()
 {
-	shaderIDs.push_back(shaderID);
-	LoadShader(shaderID, fileName);
+	batching = true;
+	// Let the driver pick the number of compiler threads
+	if (ParallelCompile()) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
 
-	// Add shader to the program
-	glAttachShader(programID, shaderID);
+void ProgramBuilder::EndBatch()
+{
+	batching = false;
+}
+
+bool ProgramBuilder::IsReady(GLuint programID)
+{
+	auto pending = std::find_if(pendingPrograms.begin(), pendingPrograms.end(), [programID](const PendingProgram& p) { return p.programID == programID; });
+	if (pending == pendingPrograms.end()) return true;
+
+	// Without the extension there is no way to ask, the first use waits for it
+	if (ParallelCompile())
+	{
+		GLint completed = GL_FALSE;
+		glGetProgramiv(programID, GL_COMPLETION_STATUS_KHR, &completed);
+		if (!completed) return false;
+	}
+	FinishProgram(*pending);
+	pendingPrograms.erase(pending);
+	return true;
+}
+
+bool ProgramBuilder::Poll()
+{
+	for (size_t i = 0; i < pendingPrograms.size();)
+	{
+		if (!IsReady(pendingPrograms[i].programID)) ++i;
+	}
+	return pendingPrograms.empty();
+}
+
+void ProgramBuilder::WaitForAll()
+{
+	CPU_TRACE_SCOPE("ProgramBuilder::WaitForAll");
+	for (const PendingProgram& pending : pendingPrograms) FinishProgram(pending);
+	pendingPrograms.clear();
 }
 
 ProgramBuilder& ProgramBuilder::ShaderStage(const GLuint shaderType, const std::filesystem::path& fileName)
 {
-	GLuint shaderID = glCreateShader(shaderType);
-	shaderIDs.push_back(shaderID); // We want to clean up later
-	LoadShader(shaderID, fileName);
+	std::vector<std::filesystem::path> files;
+	std::string source = LoadShader(fileName, files);
 
-	// Add shader to the program
-	glAttachShader(programID, shaderID);
+	std::string fileList;
+	for (size_t i = 0; i < files.size(); ++i) fileList += (i ? ", " : "") + std::to_string(i) + ": " + files[i].string();
+	stages.push_back({ shaderType, std::move(source), std::move(fileList) });
 	return *this;
 }
 
+ProgramBuilder& ProgramBuilder::Define(const std::string& name, const std::string& value)
+{
+	defines += "#define " + name + " " + value + "\n";
+	return *this;
+}
+
+ProgramBuilder& ProgramBuilder::Define(const std::string& name, int value)
+{
+	return Define(name, std::to_string(value));
+}
+
 void ProgramBuilder::Link()
 {
-	// We link the shaders (connecting outgoing-incoming variables etc.)
-	glLinkProgram(programID);
+	CPU_TRACE_SCOPE("ProgramBuilder::Link");
 
-	// Check for linking errors
-	GLint infoLogLength = 0, result = 0;
+	for (Stage& stage : stages) stage.source = InsertDefines(stage.source, defines);
 
-	glGetProgramiv(programID, GL_LINK_STATUS, &result);
-	glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &infoLogLength);
-	if (GL_FALSE == result || infoLogLength != 0)
+	// The key covers every stage with its defines, and the driver
+	const bool cached = ProgramCache::Supported();
+	uint64_t key = 0;
+	if (cached)
 	{
-		std::string ErrorMessage(infoLogLength, '\0');
-		glGetProgramInfoLog(programID, infoLogLength, nullptr, ErrorMessage.data());
-		SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
-			(result) ? SDL_LOG_PRIORITY_WARN : SDL_LOG_PRIORITY_ERROR,
-			"[glLinkProgram] Shader linking error: %s", ErrorMessage.data());
+		key = ProgramCache::DriverHash();
+		for (const Stage& stage : stages)
+		{
+			key = MeshCache::Hash(&stage.type, sizeof(stage.type), key);
+			key = MeshCache::Hash(stage.source.data(), stage.source.size(), key);
+		}
+		if (ProgramCache::Load(programID, key))
+		{
+			stages.clear();
+			return;
+		}
+	}
+
+	PendingProgram pending{ programID, {}, {}, cached, key };
+	for (const Stage& stage : stages)
+	{
+		GLuint shaderID = glCreateShader(stage.type);
+		pending.shaderIDs.push_back(shaderID); // We want to clean up later
+		pending.shaderFiles.push_back(stage.files);
+		CompileShaderFromSource(shaderID, stage.source);
+
+		// Add shader to the program
+		glAttachShader(programID, shaderID);
 	}
+	stages.clear();
+
+	// We link the shaders (connecting outgoing-incoming variables etc.)
+	if (cached) glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(programID);
 
-	// No need for these
-	std::for_each(shaderIDs.begin(), shaderIDs.end(), glDeleteShader);
-	shaderIDs.clear();
+	// In a batch the driver compiles in the background, the status is checked when the program is needed
+	if (batching) pendingPrograms.push_back(std::move(pending));
+	else FinishProgram(pending);
 }
\ No newline at end of file
@@ -2,20 +2,46 @@
 
 #include <filesystem>
 #include <GL/glew.h>
+#include <string>
 #include <vector>
 
+// The stages are only read by ShaderStage, Link compiles them, or loads the program from the ProgramCache
+// if the same sources were linked before with the same driver.
+// The sources may #include "file" (relative to the including file, once per stage), and the defines of the program
+// are inserted into every stage after the #version line, like the compile time switches of the C++ side.
+// Between BeginBatch and EndBatch Link only submits the work: with GL_KHR_parallel_shader_compile the driver compiles
+// the programs on its own threads, and the status is only checked when IsReady or Poll finds them done.
+// Using a program before that is still correct, GL waits for it then.
 class ProgramBuilder
 {
 private:
+	struct Stage
+	{
+		GLenum type;
+		std::string source;
+		std::string files; // The source string numbers of the #line directives, for the errors
+	};
+
 	const GLuint programID;
-	std::vector<GLuint> shaderIDs{};
+	std::vector<Stage> stages{};
+	std::string defines{};
 protected:
-	void LoadShader(const GLuint, const std::filesystem::path&);
+	std::string LoadShader(const std::filesystem::path&, std::vector<std::filesystem::path>&);
 	void CompileShaderFromSource(const GLuint, std::string_view);
-	void AttachShader(const GLuint, const std::filesystem::path&);
 public:
 	ProgramBuilder(GLuint);
 	~ProgramBuilder();
 	ProgramBuilder& ShaderStage(const GLuint, const std::filesystem::path&);
+	ProgramBuilder& Define(const std::string& name, const std::string& value = "");
+	ProgramBuilder& Define(const std::string& name, int value);
 	void Link();
+
+	static void BeginBatch();
+	static void EndBatch();
+	// False while the program is compiling, true for programs outside of the batches
+	static bool IsReady(GLuint);
+	// True once every program of the batches is ready
+	static bool Poll();
+	// Before deleting programs that may still be pending
+	static void WaitForAll();
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "ProgramCache.h"
+#include "CPUTrace.h"
+#include "MappedFile.h"
+#include "MeshCache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "SDL2/SDL_log.h"
+
+std::filesystem::path ProgramCache::Directory()
+{
+	return "ShaderCache";
+}
+
+std::filesystem::path ProgramCache::CachePath(uint64_t key)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016" PRIx64 ".progcache", key);
+	return Directory() / name;
+}
+
+bool ProgramCache::Supported()
+{
+	static const bool supported = []()
+	{
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}();
+	return supported;
+}
+
+uint64_t ProgramCache::DriverHash()
+{
+	static const uint64_t hash = []()
+	{
+		uint64_t result = Magic;
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		{
+			const char* value = reinterpret_cast<const char*>(glGetString(name));
+			if (value) result = MeshCache::Hash(value, std::char_traits<char>::length(value), result);
+		}
+		return result;
+	}();
+	return hash;
+}
+
+bool ProgramCache::Load(GLuint program, uint64_t key)
+{
+	CPU_TRACE_SCOPE("ProgramCache::Load");
+	MappedFile file;
+	if (!file.Open(CachePath(key)) || file.Size() < sizeof(Header)) return false;
+
+	const Header* header = reinterpret_cast<const Header*>(file.Data());
+	if (header->magic != Magic || header->version != Version || header->key != key) return false;
+	if (header->binarySize != file.Size() - sizeof(Header)) return false;
+
+	glProgramBinary(program, header->binaryFormat, file.Data() + sizeof(Header), static_cast<GLsizei>(header->binarySize));
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+bool ProgramCache::Store(GLuint program, uint64_t key)
+{
+	CPU_TRACE_SCOPE("ProgramCache::Store");
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return false;
+
+	Header header = {};
+	header.magic = Magic;
+	header.version = Version;
+	header.key = key;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	header.binaryFormat = format;
+	header.binarySize = static_cast<uint64_t>(length);
+
+	std::error_code ec;
+	std::filesystem::create_directories(Directory(), ec);
+
+	// Written under a temporary name first, a crash mid-write must not leave a valid looking cache behind
+	const std::filesystem::path cachePath = CachePath(key);
+	std::filesystem::path tempPath = cachePath;
+	tempPath += ".tmp";
+	{
+		std::ofstream cacheFile(tempPath, std::ios::binary | std::ios::trunc);
+		if (!cacheFile)
+		{
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+				SDL_LOG_PRIORITY_WARN,
+				"[ProgramCache] Error while opening %s!", tempPath.string().c_str());
+			return false;
+		}
+		cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		cacheFile.write(binary.data(), length);
+		if (!cacheFile) return false;
+	}
+
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#include <GL/glew.h>
+
+// Linked program binaries (glGetProgramBinary) on disk, so a launch only compiles the programs whose shaders changed.
+// One file per program in Directory, named after its key: the hash of the stage sources and of the GL vendor, renderer
+// and version, as a binary is only valid for the driver that produced it. Layout: Header, the binary.
+// The driver may still reject a binary (e.g. after an update with the same version string), then the program is compiled.
+class ProgramCache
+{
+public:
+	static constexpr uint32_t Magic = 0x47525042; // "BPRG"
+	static constexpr uint32_t Version = 1;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t reserved;
+		uint64_t binarySize;
+	};
+
+	static std::filesystem::path Directory();
+	static std::filesystem::path CachePath(uint64_t key);
+
+	// False if the driver has no binary formats, then there is nothing to cache. Needs a current context
+	static bool Supported();
+	// The seed of the keys, the hash of the driver's strings
+	static uint64_t DriverHash();
+
+	// False if there is no cache for the key or the driver rejects it, the program is left unlinked then
+	static bool Load(GLuint program, uint64_t key);
+	// The program has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	static bool Store(GLuint program, uint64_t key);
+};
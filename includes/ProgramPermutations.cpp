@@ -0,0 +1,31 @@
+#include "ProgramPermutations.h"
+
+#include <utility>
+
+ProgramPermutations::ProgramPermutations(Build build) : m_build(std::move(build))
+{
+}
+
+ProgramPermutations::~ProgramPermutations()
+{
+	Clean();
+}
+
+GLuint ProgramPermutations::Get(uint32_t features)
+{
+	auto found = m_programs.find(features);
+	if (found != m_programs.end()) return found->second;
+
+	GLuint program = glCreateProgram();
+	ProgramBuilder builder{ program };
+	m_build(builder, features);
+	builder.Link();
+	m_programs.emplace(features, program);
+	return program;
+}
+
+void ProgramPermutations::Clean()
+{
+	for (const auto& [features, program] : m_programs) glDeleteProgram(program);
+	m_programs.clear();
+}
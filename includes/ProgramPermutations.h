@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include <GL/glew.h>
+
+#include "ProgramBuilder.h"
+
+// The variants of a program, one per feature mask (quality tiers, optional features), each compiled the first time
+// it is asked for. build adds the stages and the defines of the mask to the builder, Get links it.
+// Variants compiled inside a batch follow it, see ProgramBuilder::BeginBatch
+class ProgramPermutations
+{
+public:
+	using Build = std::function<void(ProgramBuilder&, uint32_t features)>;
+
+	explicit ProgramPermutations(Build build);
+	~ProgramPermutations();
+	ProgramPermutations(const ProgramPermutations&) = delete;
+	ProgramPermutations& operator=(const ProgramPermutations&) = delete;
+
+	GLuint Get(uint32_t features);
+	void Clean();
+
+private:
+	Build m_build;
+	std::unordered_map<uint32_t, GLuint> m_programs;
+};
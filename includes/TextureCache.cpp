@@ -0,0 +1,120 @@
+#include "TextureCache.h"
+#include "CPUTrace.h"
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "SDL2/SDL_log.h"
+
+namespace
+{
+	bool SourceInfo(const std::filesystem::path& source, uint64_t& size, int64_t& time)
+	{
+		std::error_code ec;
+		size = std::filesystem::file_size(source, ec);
+		if (ec) return false;
+		time = std::filesystem::last_write_time(source, ec).time_since_epoch().count();
+		return !ec;
+	}
+}
+
+std::filesystem::path TextureCache::CachePath(const std::filesystem::path& source)
+{
+	std::filesystem::path cache = source;
+	cache += ".texcache";
+	return cache;
+}
+
+bool TextureCache::Load(const std::filesystem::path& source, View& view, uint32_t flags)
+{
+	CPU_TRACE_SCOPE("TextureCache::Load");
+	view = View();
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!SourceInfo(source, sourceSize, sourceTime)) return false;
+
+	const std::filesystem::path cachePath = CachePath(source);
+	MappedFile file;
+	if (!file.Open(cachePath) || file.Size() < sizeof(Header)) return false;
+
+	const Header* header = reinterpret_cast<const Header*>(file.Data());
+	if (header->magic != Magic || header->version != Version || header->flags != flags) return false;
+	if (header->format != BlockCompression::Format::BC1 && header->format != BlockCompression::Format::BC3) return false;
+	if (header->levelCount == 0 || header->levelCount > MaxLevels || header->sourceSize != sourceSize) return false;
+	// Like MeshCache, the offsets and sizes from the file are never added before they are known to fit
+	const uint64_t payloadSize = file.Size() - sizeof(Header);
+	for (uint32_t i = 0; i < header->levelCount; ++i)
+	{
+		const BlockCompression::Level& level = header->levels[i];
+		if (level.offset > payloadSize || level.size > payloadSize - level.offset) return false;
+	}
+
+	if (header->sourceTime != sourceTime)
+	{
+		if (MeshCache::HashFile(source) != header->sourceHash) return false;
+
+		// Same content, only touched. Refresh the time stamp so the next start skips the hashing,
+		// the mapping is dropped meanwhile since Windows doesn't let us write a mapped file
+		Header updated = *header;
+		updated.sourceTime = sourceTime;
+		file.Close();
+		{
+			std::fstream cacheFile(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+			if (cacheFile) cacheFile.write(reinterpret_cast<const char*>(&updated), sizeof(Header));
+		}
+		if (!file.Open(cachePath) || file.Size() < sizeof(Header)) return false;
+		header = reinterpret_cast<const Header*>(file.Data());
+		if (std::memcmp(header, &updated, sizeof(Header)) != 0) return false;
+	}
+
+	view.header = header;
+	view.data = reinterpret_cast<const uint8_t*>(file.Data() + sizeof(Header));
+	view.file = std::move(file);
+	return true;
+}
+
+bool TextureCache::Store(const std::filesystem::path& source, const BlockCompression::CompressedImage& image, uint32_t flags)
+{
+	CPU_TRACE_SCOPE("TextureCache::Store");
+	if (image.levels.empty() || image.levels.size() > MaxLevels) return false;
+
+	Header header = {};
+	header.magic = Magic;
+	header.version = Version;
+	header.flags = flags;
+	header.format = image.format;
+	if (!SourceInfo(source, header.sourceSize, header.sourceTime)) return false;
+	header.sourceHash = MeshCache::HashFile(source);
+	header.levelCount = static_cast<uint32_t>(image.levels.size());
+	std::copy(image.levels.begin(), image.levels.end(), header.levels);
+
+	// Written under a temporary name first, a crash mid-write must not leave a valid looking cache behind
+	const std::filesystem::path cachePath = CachePath(source);
+	std::filesystem::path tempPath = cachePath;
+	tempPath += ".tmp";
+	{
+		std::ofstream cacheFile(tempPath, std::ios::binary | std::ios::trunc);
+		if (!cacheFile)
+		{
+			SDL_LogMessage(SDL_LOG_CATEGORY_ERROR,
+				SDL_LOG_PRIORITY_WARN,
+				"[TextureCache] Error while opening %s!", tempPath.string().c_str());
+			return false;
+		}
+		cacheFile.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		cacheFile.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+		if (!cacheFile) return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#include "BlockCompression.h"
+#include "MappedFile.h"
+
+// Block compressed copy of an image file with its mip chain, stored next to the source as <source>.texcache,
+// so the PNG decoding and the encoding only happen on the first run. Layout: Header, the levels' blocks.
+// Validated against the source like MeshCache: size and time stamp, then the content hash.
+class TextureCache
+{
+public:
+	static constexpr uint32_t Magic = 0x58455442; // "BTEX"
+	static constexpr uint32_t Version = 2;
+	static constexpr uint32_t MaxLevels = 16;
+
+	// Header flags, a cache is only used if they match the requested ones
+	static constexpr uint32_t FlippedRows = 1 << 0; // Bottom-up rows, see DecodeImage
+	static constexpr uint32_t Mipmaps = 1 << 1;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t flags;
+		BlockCompression::Format format;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t sourceHash;
+		uint32_t levelCount;
+		uint32_t reserved;
+		BlockCompression::Level levels[MaxLevels]; // Offsets from the end of the header
+	};
+
+	// The pointers are valid while the view (its mapping) is alive
+	struct View
+	{
+		MappedFile file;
+		const Header* header = nullptr;
+		const uint8_t* data = nullptr;
+	};
+
+	static std::filesystem::path CachePath(const std::filesystem::path& source);
+
+	// False if there is no cache or it is stale, corrupt or from another version
+	static bool Load(const std::filesystem::path& source, View&, uint32_t flags);
+	static bool Store(const std::filesystem::path& source, const BlockCompression::CompressedImage&, uint32_t flags);
+};
@@ -0,0 +1,67 @@
+#include "VertexQuantization.h"
+#include "CPUTrace.h"
+
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace VertexQuantization
+{
+	// A flat axis would make the dequantize matrix singular, any scale works there since the coordinate is 0
+	static glm::vec3 Extent(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		glm::vec3 extent = boundsMax - boundsMin;
+		for (int i = 0; i < 3; ++i)
+			if (extent[i] <= 0.0f) extent[i] = 1.0f;
+		return extent;
+	}
+
+	glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+	{
+		glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+		glm::vec2 result(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			result.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			result.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return result;
+	}
+
+	MeshObject<VertexQuantized> QuantizeMesh(const MeshObject<Vertex>& mesh, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		CPU_TRACE_SCOPE("VertexQuantization::QuantizeMesh");
+		const glm::vec3 extent = Extent(boundsMin, boundsMax);
+
+		MeshObject<VertexQuantized> result;
+		result.indexArray = mesh.indexArray;
+		result.vertexArray.resize(mesh.vertexArray.size());
+
+		for (size_t i = 0; i < mesh.vertexArray.size(); ++i)
+		{
+			const Vertex& vertex = mesh.vertexArray[i];
+			VertexQuantized& quantized = result.vertexArray[i];
+
+			glm::vec3 position = glm::clamp((vertex.position - boundsMin) / extent, 0.0f, 1.0f);
+			for (int c = 0; c < 3; ++c)
+				quantized.position[c] = static_cast<uint16_t>(std::lround(position[c] * 65535.0f));
+			quantized.position[3] = 0;
+
+			glm::vec3 normal = vertex.normal * extent;
+			float length = glm::length(normal);
+			glm::vec2 octahedral = length > 0.0f ? EncodeOctahedral(normal / length) : glm::vec2(0.0f);
+			quantized.normal[0] = static_cast<int16_t>(glm::packSnorm1x16(octahedral.x));
+			quantized.normal[1] = static_cast<int16_t>(glm::packSnorm1x16(octahedral.y));
+
+			quantized.texcoord[0] = glm::packHalf1x16(vertex.texcoord.x);
+			quantized.texcoord[1] = glm::packHalf1x16(vertex.texcoord.y);
+		}
+		return result;
+	}
+
+	glm::mat4 DequantizeMatrix(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		return glm::translate(glm::mat4(1.0f), boundsMin) * glm::scale(glm::mat4(1.0f), Extent(boundsMin, boundsMax));
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "GLUtils.hpp"
+
+// Conversion of Vertex meshes to VertexQuantized.
+// Positions are stored as unorm16 in [boundsMin, boundsMax], DequantizeMatrix maps them back and is applied before the model matrix.
+// Normals are scaled by the bounds extent before the octahedral encoding, so the inverse transpose of the dequantize matrix
+// (part of the usual normal matrix) turns them back to the original direction.
+namespace VertexQuantization
+{
+	MeshObject<VertexQuantized> QuantizeMesh(const MeshObject<Vertex>&, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	glm::mat4 DequantizeMatrix(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// Octahedral mapping of a unit vector to [-1,1]^2
+	glm::vec2 EncodeOctahedral(const glm::vec3&);
+}
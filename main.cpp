@@ -13,11 +13,45 @@
 // Standard
 #include <iostream>
 #include <sstream>
+#include <string_view>
 
 #include "MyApp.h"
+#include "CPUTrace.h"
+#include "Headless.h"
+#include "ObjParser.h"
+#include "ProgramBuilder.h"
 
 int main(int argc, char* args[])
 {
+	// --headless: render offscreen through EGL without a window, see Headless.h for the options
+	// --bench-obj <file>: log the OBJ parser throughput per thread count, compare the vertex dedup maps and exit
+	// --obj-streaming: parse every OBJ file in pieces instead of only the ones bigger than ObjParser::StreamingThreshold
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::string_view(args[i]) == "--obj-streaming") ObjParser::StreamingThreshold = 0;
+	}
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::string_view(args[i]) == "--headless") return RunHeadless(argc, args);
+		if (std::string_view(args[i]) == "--bench-obj")
+		{
+			if (i + 1 >= argc)
+			{
+				SDL_LogError(SDL_LOG_CATEGORY_ERROR, "[ObjParser] Missing file for %s", args[i]);
+				return 1;
+			}
+			ObjParser::Benchmark(args[i + 1]);
+			return 0;
+		}
+	}
+
+	// --trace <file>: write the CPU trace of the last frames on exit (F9 writes cpu_trace.json at any time)
+	const char* traceFile = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::string_view(args[i]) == "--trace" && i + 1 < argc) traceFile = args[++i];
+	}
+
 	//
 	// 1: Initialize SDL
 	//
@@ -144,9 +178,12 @@ int main(int argc, char* args[])
 		bool quit = false;	// Should we terminate?
 		SDL_Event ev;		// Event to be processed
 
-		// App instance
+		// App instance. Its shaders compile in the background, the first frames only show the background
+		ProgramBuilder::BeginBatch();
 		CMyApp app;
-		if (!app.Init())
+		const bool initialized = app.Init();
+		ProgramBuilder::EndBatch();
+		if (!initialized)
 		{
 			SDL_GL_DeleteContext(context);
 			SDL_DestroyWindow(win);
@@ -156,6 +193,7 @@ int main(int argc, char* args[])
 
 		while (!quit)
 		{
+			CPU_TRACE_SCOPE("Frame");
 			// As long as there are events to be processed, we process them all:
 			while (SDL_PollEvent(&ev))
 			{
@@ -243,8 +281,12 @@ int main(int argc, char* args[])
 			ImGui::Render();
 
 			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-			SDL_GL_SwapWindow(win);
+			{
+				CPU_TRACE_SCOPE("SDL_GL_SwapWindow");
+				SDL_GL_SwapWindow(win);
+			}
 		}
+		if (traceFile) CPUTrace::WriteJSON(traceFile);
 		app.Clean(); // Let our object clean up after itself
 	} // This way the destructor of the app can run while our context is still alive => the destructors of the classes that include GPU resources also run here
 